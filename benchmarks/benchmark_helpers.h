@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * benchmark_helpers.h -- header with helpers for benchmarks
+ */
+
+#ifndef BENCHMARK_HELPERS_H
+#define BENCHMARK_HELPERS_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "core/os.h"
+
+#define NSEC_IN_SEC 1000000000ULL
+
+/*
+ * benchmark_time_ns -- returns the current value of the monotonic clock
+ */
+static inline uint64_t
+benchmark_time_ns(void)
+{
+	struct timespec ts;
+	os_clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * benchmark_arg -- returns the numeric value of the n-th command line
+ * argument or the default value if it wasn't provided
+ */
+static inline uint64_t
+benchmark_arg(int argc, char *argv[], int n, uint64_t default_value)
+{
+	if (argc <= n)
+		return default_value;
+
+	return strtoull(argv[n], NULL, 0);
+}
+
+/*
+ * benchmark_ops_per_sec -- calculates the throughput of an operation
+ */
+static inline double
+benchmark_ops_per_sec(uint64_t nops, uint64_t time_ns)
+{
+	if (time_ns == 0)
+		return 0;
+
+	return (double)nops * (double)NSEC_IN_SEC / (double)time_ns;
+}
+
+#endif /* BENCHMARK_HELPERS_H */
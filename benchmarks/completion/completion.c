@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * completion.c -- compares the throughput of completing and polling
+ * operations whose completion words are packed next to each other, the way
+ * the threads data mover used to lay them out, with the one of operations
+ * whose words are each on its own cache line. Workers complete interleaved
+ * operations of an array of them, dropping a reference and setting
+ * the completion word, while the main thread polls them in order.
+ *
+ * Usage: benchmark-completion [nops] [max_workers] [nslots]
+ *	nops - number of operations completed (default 4000000),
+ *	max_workers - the largest number of worker threads,
+ *		it's doubled starting from 1 (default 4),
+ *	nslots - number of operations in the array, reused in rounds
+ *		(default 4096).
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "core/os_thread.h"
+#include "core/util.h"
+#include "benchmark_helpers.h"
+
+#define MAX_WORKERS 64
+
+/* words of an operation next to each other, as in the previous layout */
+struct slot_packed {
+	uint64_t complete;
+	uint64_t started;
+	uint64_t next_part;
+	uint64_t pending;
+};
+
+/* the words written by the workers on separate cache lines */
+struct slot_padded {
+	CACHELINE_PADDING(uint64_t, complete);
+	CACHELINE_PADDING(uint64_t, next_part);
+	CACHELINE_PADDING(uint64_t, pending);
+	uint64_t started;
+};
+
+struct layout {
+	const char *name;
+	size_t size;
+	size_t complete_off;
+	size_t pending_off;
+};
+
+static const struct layout layouts[] = {
+	{"packed", sizeof(struct slot_packed),
+		offsetof(struct slot_packed, complete),
+		offsetof(struct slot_packed, pending)},
+	{"padded", ALIGN_UP(sizeof(struct slot_padded), CACHELINE_SIZE),
+		offsetof(struct slot_padded, complete_padded.complete),
+		offsetof(struct slot_padded, pending_padded.pending)},
+};
+
+struct worker {
+	const struct layout *layout;
+	char *slots;
+	uint64_t nslots;
+	uint64_t nrounds;
+	uint64_t first; /* index of the first operation of the worker */
+	uint64_t stride; /* number of workers */
+};
+
+/*
+ * slot_word -- returns the word at the given offset of the i-th operation
+ */
+static uint64_t *
+slot_word(const struct layout *layout, char *slots, uint64_t i, size_t off)
+{
+	return (uint64_t *)(slots + i * layout->size + off);
+}
+
+/*
+ * worker -- completes every stride-th operation in each round, marking it
+ * with the number of the round
+ */
+static void *
+worker(void *arg)
+{
+	struct worker *w = arg;
+
+	for (uint64_t r = 1; r <= w->nrounds; ++r) {
+		for (uint64_t i = w->first; i < w->nslots; i += w->stride) {
+			util_fetch_and_sub64(slot_word(w->layout, w->slots, i,
+				w->layout->pending_off), 1);
+			util_atomic_store_explicit64(slot_word(w->layout,
+				w->slots, i, w->layout->complete_off), r,
+				memory_order_release);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * run -- returns the time in nanoseconds of completing and polling nops
+ * operations with nworkers threads
+ */
+static uint64_t
+run(const struct layout *layout, uint64_t nops, uint64_t nworkers,
+	uint64_t nslots)
+{
+	size_t size = nslots * layout->size;
+	char *slots = util_aligned_malloc(CACHELINE_SIZE, size);
+	if (slots == NULL) {
+		fprintf(stderr, "failed to allocate the operations\n");
+		exit(1);
+	}
+	memset(slots, 0, size);
+
+	uint64_t nrounds = nops / nslots;
+	os_thread_t threads[MAX_WORKERS];
+	struct worker w[MAX_WORKERS];
+
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t i = 0; i < nworkers; ++i) {
+		w[i] = (struct worker){layout, slots, nslots, nrounds, i,
+			nworkers};
+		os_thread_create(&threads[i], NULL, worker, &w[i]);
+	}
+
+	/* poll the operations in order, like a runtime waiting for them */
+	for (uint64_t r = 1; r <= nrounds; ++r) {
+		for (uint64_t i = 0; i < nslots; ++i) {
+			uint64_t *complete = slot_word(layout, slots, i,
+				layout->complete_off);
+			uint64_t round;
+			do {
+				util_atomic_load_explicit64(complete, &round,
+					memory_order_acquire);
+			} while (round < r);
+		}
+	}
+	uint64_t time = benchmark_time_ns() - start;
+
+	for (uint64_t i = 0; i < nworkers; ++i)
+		os_thread_join(&threads[i], NULL);
+	util_aligned_free(slots);
+
+	return time;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t nops = benchmark_arg(argc, argv, 1, 4000000);
+	uint64_t max_workers = benchmark_arg(argc, argv, 2, 4);
+	uint64_t nslots = benchmark_arg(argc, argv, 3, 4096);
+
+	if (max_workers == 0 || max_workers > MAX_WORKERS) {
+		fprintf(stderr, "max_workers must be between 1 and %d\n",
+			MAX_WORKERS);
+		return 1;
+	}
+	if (nslots == 0 || nops < nslots) {
+		fprintf(stderr, "nslots must be between 1 and nops\n");
+		return 1;
+	}
+
+	printf("%10s", "workers");
+	for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); ++i)
+		printf(" %16s", layouts[i].name);
+	printf("\n");
+
+	for (uint64_t nworkers = 1; nworkers <= max_workers; nworkers *= 2) {
+		printf("%10llu", (unsigned long long)nworkers);
+		for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]);
+				++i) {
+			uint64_t time = run(&layouts[i], nops, nworkers,
+				nslots);
+			printf(" %12.0f/sec", benchmark_ops_per_sec(
+				nops / nslots * nslots, time));
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
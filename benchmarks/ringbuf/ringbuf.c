@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * ringbuf.c -- compares the throughput of the mpmc ring buffer used by
+ * the threads data mover with its previous, semaphore based implementation.
+ * Producers enqueue values with the blocking enqueue and consumers take
+ * them with the blocking dequeue, so both the lock-free path and
+ * the parking of threads on a full or empty buffer are measured.
+ *
+ * Usage: benchmark-ringbuf [nops] [max_threads] [length]
+ *	nops - number of values passed through the buffer (default 1000000),
+ *	max_threads - the largest number of producers and of consumers,
+ *		it's doubled starting from 1 (default 4),
+ *	length - number of slots in the buffer (default 128).
+ */
+
+#include "core/os_thread.h"
+#include "core/ringbuf.h"
+#include "benchmark_helpers.h"
+#include "ringbuf_sem.h"
+
+#define MAX_THREADS 64
+
+struct impl {
+	const char *name;
+	void *(*new)(unsigned length);
+	void (*delete)(void *rbuf);
+	void (*stop)(void *rbuf);
+	int (*enqueue)(void *rbuf, void *data);
+	void *(*dequeue)(void *rbuf);
+};
+
+struct worker {
+	const struct impl *impl;
+	void *rbuf;
+	uint64_t nops;
+};
+
+static void *
+seq_new(unsigned length)
+{
+	return ringbuf_new(length);
+}
+
+static void
+seq_delete(void *rbuf)
+{
+	ringbuf_delete(rbuf);
+}
+
+static void
+seq_stop(void *rbuf)
+{
+	ringbuf_stop(rbuf);
+}
+
+static int
+seq_enqueue(void *rbuf, void *data)
+{
+	return ringbuf_enqueue(rbuf, data);
+}
+
+static void *
+seq_dequeue(void *rbuf)
+{
+	return ringbuf_dequeue(rbuf);
+}
+
+static void *
+sem_new(unsigned length)
+{
+	return ringbuf_sem_new(length);
+}
+
+static void
+sem_delete(void *rbuf)
+{
+	ringbuf_sem_delete(rbuf);
+}
+
+static void
+sem_stop(void *rbuf)
+{
+	ringbuf_sem_stop(rbuf);
+}
+
+static int
+sem_enqueue(void *rbuf, void *data)
+{
+	return ringbuf_sem_enqueue(rbuf, data);
+}
+
+static void *
+sem_dequeue(void *rbuf)
+{
+	return ringbuf_sem_dequeue(rbuf);
+}
+
+static const struct impl impls[] = {
+	{"semaphores", sem_new, sem_delete, sem_stop, sem_enqueue,
+		sem_dequeue},
+	{"sequences", seq_new, seq_delete, seq_stop, seq_enqueue,
+		seq_dequeue},
+};
+
+/*
+ * producer -- enqueues its share of the values
+ */
+static void *
+producer(void *arg)
+{
+	struct worker *w = arg;
+
+	for (uint64_t i = 0; i < w->nops; ++i)
+		w->impl->enqueue(w->rbuf, (void *)(uintptr_t)(i + 1));
+
+	return NULL;
+}
+
+/*
+ * consumer -- dequeues values until the buffer is stopped
+ */
+static void *
+consumer(void *arg)
+{
+	struct worker *w = arg;
+
+	while (w->impl->dequeue(w->rbuf) != NULL)
+		;
+
+	return NULL;
+}
+
+/*
+ * run -- returns the time in nanoseconds of passing nops values through
+ * the buffer with nthreads producers and nthreads consumers
+ */
+static uint64_t
+run(const struct impl *impl, uint64_t nops, uint64_t nthreads,
+	unsigned length)
+{
+	void *rbuf = impl->new(length);
+	if (rbuf == NULL) {
+		fprintf(stderr, "failed to create the ring buffer\n");
+		exit(1);
+	}
+
+	os_thread_t producers[MAX_THREADS];
+	os_thread_t consumers[MAX_THREADS];
+	struct worker w = {impl, rbuf, nops / nthreads};
+
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t i = 0; i < nthreads; ++i) {
+		os_thread_create(&consumers[i], NULL, consumer, &w);
+		os_thread_create(&producers[i], NULL, producer, &w);
+	}
+	for (uint64_t i = 0; i < nthreads; ++i)
+		os_thread_join(&producers[i], NULL);
+
+	/* returns once the consumers took all the values */
+	impl->stop(rbuf);
+	uint64_t time = benchmark_time_ns() - start;
+
+	for (uint64_t i = 0; i < nthreads; ++i)
+		os_thread_join(&consumers[i], NULL);
+	impl->delete(rbuf);
+
+	return time;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t nops = benchmark_arg(argc, argv, 1, 1000000);
+	uint64_t max_threads = benchmark_arg(argc, argv, 2, 4);
+	uint64_t length = benchmark_arg(argc, argv, 3, 128);
+
+	if (max_threads == 0 || max_threads > MAX_THREADS) {
+		fprintf(stderr, "max_threads must be between 1 and %d\n",
+			MAX_THREADS);
+		return 1;
+	}
+
+	printf("%10s", "threads");
+	for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i)
+		printf(" %16s", impls[i].name);
+	printf("\n");
+
+	for (uint64_t nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+		printf("%4llu x %-3llu", (unsigned long long)nthreads,
+			(unsigned long long)nthreads);
+		for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+			uint64_t time = run(&impls[i], nops, nthreads,
+				(unsigned)length);
+			printf(" %12.0f/sec", benchmark_ops_per_sec(
+				nops / nthreads * nthreads, time));
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
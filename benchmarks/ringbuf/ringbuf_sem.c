@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2017-2022, Intel Corporation */
+
+/*
+ * ringbuf_sem.c -- the previous implementation of the mpmc ring buffer, with
+ * a fetch-and-add of the position and a pair of semaphores counting the free
+ * and the used slots
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/os_thread.h"
+#include "core/sys_util.h"
+#include "core/util.h"
+#include "ringbuf_sem.h"
+
+#define RINGBUF_MAX_CONSUMER_THREADS 1024
+
+struct ringbuf_sem {
+	CACHELINE_PADDING(uint64_t, read_pos);
+	CACHELINE_PADDING(uint64_t, write_pos);
+
+	CACHELINE_PADDING(os_semaphore_t, nfree);
+	CACHELINE_PADDING(os_semaphore_t, nused);
+
+	uint64_t len_mask;
+	int running;
+
+	void *data[];
+};
+
+/*
+ * ringbuf_sem_new -- creates a new ring buffer instance
+ */
+struct ringbuf_sem *
+ringbuf_sem_new(unsigned length)
+{
+	struct ringbuf_sem *rbuf =
+		calloc(1, sizeof(*rbuf) + length * sizeof(void *));
+	if (rbuf == NULL)
+		return NULL;
+
+	util_semaphore_init(&rbuf->nfree_padded.nfree, length);
+	util_semaphore_init(&rbuf->nused_padded.nused, 0);
+	rbuf->len_mask = length - 1;
+	rbuf->running = 1;
+
+	return rbuf;
+}
+
+/*
+ * ringbuf_sem_delete -- destroys an existing ring buffer instance
+ */
+void
+ringbuf_sem_delete(struct ringbuf_sem *rbuf)
+{
+	util_semaphore_destroy(&rbuf->nfree_padded.nfree);
+	util_semaphore_destroy(&rbuf->nused_padded.nused);
+	free(rbuf);
+}
+
+/*
+ * ringbuf_sem_stop -- waits for the buffer to become empty and unblocks
+ * the consumers
+ */
+void
+ringbuf_sem_stop(struct ringbuf_sem *rbuf)
+{
+	while (rbuf->read_pos_padded.read_pos !=
+		rbuf->write_pos_padded.write_pos)
+		__sync_synchronize();
+
+	util_bool_compare_and_swap32(&rbuf->running, 1, 0);
+
+	for (int64_t i = 0; i < RINGBUF_MAX_CONSUMER_THREADS; ++i)
+		util_semaphore_post(&rbuf->nused_padded.nused);
+}
+
+/*
+ * ringbuf_sem_enqueue -- places a new value into the buffer, blocks if
+ * there's no space in it
+ */
+int
+ringbuf_sem_enqueue(struct ringbuf_sem *rbuf, void *data)
+{
+	util_semaphore_wait(&rbuf->nfree_padded.nfree);
+
+	size_t w = util_fetch_and_add64(&rbuf->write_pos_padded.write_pos, 1)
+		& rbuf->len_mask;
+	while (!util_bool_compare_and_swap64(&rbuf->data[w], NULL, data))
+		;
+
+	util_semaphore_post(&rbuf->nused_padded.nused);
+
+	return 0;
+}
+
+/*
+ * ringbuf_sem_dequeue -- retrieves one value from the buffer, blocks if
+ * there are no values in it
+ */
+void *
+ringbuf_sem_dequeue(struct ringbuf_sem *rbuf)
+{
+	util_semaphore_wait(&rbuf->nused_padded.nused);
+
+	if (!rbuf->running)
+		return NULL;
+
+	size_t r = util_fetch_and_add64(&rbuf->read_pos_padded.read_pos, 1)
+		& rbuf->len_mask;
+	void *data = NULL;
+	do {
+		do {
+			util_atomic_load64(&rbuf->data[r], &data);
+		} while (data == NULL);
+	} while (!util_bool_compare_and_swap64(&rbuf->data[r], data, NULL));
+
+	util_semaphore_post(&rbuf->nfree_padded.nfree);
+
+	return data;
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * ringbuf_sem.h -- the previous implementation of the mpmc ring buffer,
+ * kept as the baseline of the ringbuf benchmark
+ */
+
+#ifndef RINGBUF_SEM_H
+#define RINGBUF_SEM_H 1
+
+struct ringbuf_sem;
+
+struct ringbuf_sem *ringbuf_sem_new(unsigned length);
+void ringbuf_sem_delete(struct ringbuf_sem *rbuf);
+void ringbuf_sem_stop(struct ringbuf_sem *rbuf);
+int ringbuf_sem_enqueue(struct ringbuf_sem *rbuf, void *data);
+void *ringbuf_sem_dequeue(struct ringbuf_sem *rbuf);
+
+#endif
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * runtime_policy.c -- compares the wait policies of the runtime for
+ * operations of different durations. A helper thread completes each
+ * operation the given time after it was started and wakes the waiting
+ * thread up. For each policy, the benchmark reports the average time from
+ * a completion until runtime_wait returns and the cpu time the waiting
+ * thread used per operation.
+ *
+ * Usage: benchmark-runtime-policy [nops] [max_duration_us]
+ *	nops - number of operations for each duration (default 2000),
+ *	max_duration_us - the longest duration of an operation in microseconds,
+ *		it's multiplied by 10 starting from 1 (default 1000).
+ */
+
+#include "libminiasync.h"
+#include "core/os_thread.h"
+#include "core/sys_util.h"
+#include "core/util.h"
+#include "benchmark_helpers.h"
+
+struct delay_data {
+	os_mutex_t lock; /* protects the fields below */
+	int done;
+	struct future_waker waker;
+};
+
+struct delay_output {
+	uint64_t done_ns; /* when the helper thread completed the operation */
+};
+
+FUTURE(delay_fut, struct delay_data, struct delay_output);
+
+/*
+ * delay_task -- completes once the helper thread is done with the operation
+ */
+static enum future_state
+delay_task(struct future_context *context, struct future_notifier *notifier)
+{
+	struct delay_data *data = future_context_get_data(context);
+
+	util_mutex_lock(&data->lock);
+	if (data->done) {
+		util_mutex_unlock(&data->lock);
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (notifier != NULL) {
+		data->waker = notifier->waker;
+		notifier->notifier_used = FUTURE_NOTIFIER_WAKER;
+	}
+	util_mutex_unlock(&data->lock);
+
+	return FUTURE_STATE_RUNNING;
+}
+
+struct helper {
+	struct delay_fut *fut; /* the operation in progress, if any */
+	uint64_t start_ns;
+	uint64_t duration_ns;
+	uint64_t stop;
+};
+
+/*
+ * helper_thread -- completes each operation once its duration passed,
+ * spinning so that it's on time
+ */
+static void *
+helper_thread(void *arg)
+{
+	struct helper *h = arg;
+
+	for (;;) {
+		struct delay_fut *fut;
+		uint64_t stop;
+		do {
+			util_atomic_load_explicit64(&h->stop, &stop,
+				memory_order_acquire);
+			if (stop)
+				return NULL;
+			util_atomic_load_explicit64(&h->fut, &fut,
+				memory_order_acquire);
+		} while (fut == NULL);
+
+		while (benchmark_time_ns() - h->start_ns < h->duration_ns)
+			WAIT();
+
+		util_atomic_store_explicit64(&h->fut, NULL,
+			memory_order_relaxed);
+
+		util_mutex_lock(&fut->data.lock);
+		fut->data.done = 1;
+		fut->output.done_ns = benchmark_time_ns();
+		if (fut->data.waker.wake != NULL)
+			FUTURE_WAKER_WAKE(&fut->data.waker);
+		util_mutex_unlock(&fut->data.lock);
+	}
+}
+
+/*
+ * cpu_time_ns -- returns the cpu time used by the calling thread, 0 if
+ * the platform can't tell
+ */
+static uint64_t
+cpu_time_ns(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + (uint64_t)ts.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+struct policy {
+	const char *name;
+	enum runtime_wait_policy policy;
+};
+
+static const struct policy policies[] = {
+	{"block", RUNTIME_WAIT_BLOCK},
+	{"hybrid", RUNTIME_WAIT_HYBRID},
+	{"busy-poll", RUNTIME_WAIT_BUSY_POLL},
+	{"adaptive", RUNTIME_WAIT_ADAPTIVE},
+};
+
+/*
+ * run -- waits for nops operations of the given duration, returns the sum
+ * of their wake-up latencies and the cpu time of the waiting thread
+ */
+static void
+run(struct runtime *runtime, struct helper *h, uint64_t nops,
+	uint64_t duration_ns, uint64_t *latency_ns, uint64_t *cpu_ns)
+{
+	h->duration_ns = duration_ns;
+	*latency_ns = 0;
+
+	uint64_t cpu_start = cpu_time_ns();
+	for (uint64_t i = 0; i < nops; ++i) {
+		struct delay_fut fut = {.output.done_ns = 0};
+		FUTURE_INIT(&fut, delay_task);
+		util_mutex_init(&fut.data.lock);
+		fut.data.done = 0;
+		fut.data.waker = (struct future_waker){NULL, NULL};
+
+		h->start_ns = benchmark_time_ns();
+		util_atomic_store_explicit64(&h->fut, &fut,
+			memory_order_release);
+
+		runtime_wait(runtime, FUTURE_AS_RUNNABLE(&fut));
+		uint64_t now = benchmark_time_ns();
+
+		/* the helper releases the lock only after the wake-up */
+		util_mutex_lock(&fut.data.lock);
+		util_mutex_unlock(&fut.data.lock);
+		util_mutex_destroy(&fut.data.lock);
+
+		*latency_ns += now - fut.output.done_ns;
+	}
+	*cpu_ns = cpu_time_ns() - cpu_start;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t nops = benchmark_arg(argc, argv, 1, 2000);
+	uint64_t max_duration_us = benchmark_arg(argc, argv, 2, 1000);
+
+	if (nops == 0) {
+		fprintf(stderr, "nops must be at least 1\n");
+		return 1;
+	}
+
+	struct runtime *runtimes[sizeof(policies) / sizeof(policies[0])];
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+		struct runtime_config *cfg = runtime_config_new();
+		if (cfg == NULL) {
+			fprintf(stderr, "failed to create the configuration\n");
+			return 1;
+		}
+		runtime_config_set_wait_policy(cfg, policies[i].policy);
+		runtime_config_set_spin_count(cfg, 1000);
+		runtimes[i] = runtime_new_ext(cfg);
+		runtime_config_delete(cfg);
+		if (runtimes[i] == NULL) {
+			fprintf(stderr, "failed to create the runtime\n");
+			return 1;
+		}
+	}
+
+	struct helper h = {NULL, 0, 0, 0};
+	os_thread_t thread;
+	os_thread_create(&thread, NULL, helper_thread, &h);
+
+	printf("%12s", "duration[us]");
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i)
+		printf(" %24s", policies[i].name);
+	printf("\n%12s", "");
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i)
+		printf(" %11s %12s", "latency[ns]", "cpu/op[ns]");
+	printf("\n");
+
+	for (uint64_t us = 1; us <= max_duration_us; us *= 10) {
+		printf("%12llu", (unsigned long long)us);
+		for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]);
+				++i) {
+			uint64_t latency_ns;
+			uint64_t cpu_ns;
+			run(runtimes[i], &h, nops, us * 1000, &latency_ns,
+				&cpu_ns);
+			printf(" %11llu %12llu",
+				(unsigned long long)(latency_ns / nops),
+				(unsigned long long)(cpu_ns / nops));
+		}
+		printf("\n");
+	}
+
+	util_atomic_store_explicit64(&h.stop, 1, memory_order_release);
+	os_thread_join(&thread, NULL);
+
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i)
+		runtime_delete(runtimes[i]);
+
+	return 0;
+}
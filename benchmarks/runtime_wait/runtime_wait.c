@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * runtime_wait.c -- measures how runtime_wait_multiple scales with
+ * the number of futures it waits for, compared with its previous loop,
+ * which sorted all the futures by their properties and scanned the complete
+ * ones on every pass. Every other future is asynchronous and the futures
+ * need from 1 to max_polls polls to complete, so they complete at
+ * different passes.
+ *
+ * Usage: benchmark-runtime-wait [max_futures] [max_polls]
+ *	max_futures - the largest number of futures waited for,
+ *		it's multiplied by 4 starting from 1 (default 1048576),
+ *	max_polls - the largest number of polls a future needs (default 16).
+ */
+
+#include "libminiasync.h"
+#include "benchmark_helpers.h"
+
+struct countdown_data {
+	uint64_t counter;
+};
+
+struct countdown_output {
+	uint64_t polls;
+};
+
+FUTURE(countdown_fut, struct countdown_data, struct countdown_output);
+
+/*
+ * countdown_task -- completes the future once its counter drops to zero
+ */
+static enum future_state
+countdown_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countdown_data *data = future_context_get_data(context);
+	struct countdown_output *output = future_context_get_output(context);
+	output->polls++;
+
+	return --data->counter == 0 ?
+		FUTURE_STATE_COMPLETE : FUTURE_STATE_RUNNING;
+}
+
+/*
+ * countdown_async_property -- marks the future as an asynchronous one
+ */
+static int
+countdown_async_property(void *fut, enum future_property property)
+{
+	return property == FUTURE_PROPERTY_ASYNC;
+}
+
+/*
+ * futures_init -- initializes the futures and the array of pointers to them
+ */
+static void
+futures_init(struct countdown_fut *futs, struct future **runnables,
+	uint64_t nfuts, uint64_t max_polls)
+{
+	for (uint64_t i = 0; i < nfuts; ++i) {
+		FUTURE_INIT(&futs[i], countdown_task);
+		futs[i].data.counter = 1 + i % max_polls;
+		futs[i].output.polls = 0;
+		if (i % 2)
+			futs[i].base.has_property = countdown_async_property;
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+}
+
+/*
+ * compare_async -- the comparison function of the previous loop
+ */
+static int
+compare_async(const void *first_fut, const void *second_fut)
+{
+	struct future *fut1 = *(struct future **)first_fut;
+	struct future *fut2 = *(struct future **)second_fut;
+	int async1 = future_has_property(fut1, FUTURE_PROPERTY_ASYNC);
+	int async2 = future_has_property(fut2, FUTURE_PROPERTY_ASYNC);
+
+	return async2 - async1;
+}
+
+/*
+ * wait_qsort -- the previous loop of runtime_wait_multiple, futures of this
+ * benchmark always make progress, so it never sleeps
+ */
+static void
+wait_qsort(struct runtime *runtime, struct future *futs[], size_t nfuts)
+{
+	size_t ndone = 0;
+
+	while (ndone != nfuts) {
+		qsort(futs, nfuts, sizeof(struct future *), compare_async);
+		for (size_t f = 0; f < nfuts; ++f) {
+			struct future *fut = futs[f];
+			if (fut->context.state == FUTURE_STATE_COMPLETE)
+				continue;
+
+			if (future_poll(fut, NULL) == FUTURE_STATE_COMPLETE)
+				ndone++;
+		}
+	}
+}
+
+struct impl {
+	const char *name;
+	void (*wait)(struct runtime *runtime, struct future *futs[],
+		size_t nfuts);
+};
+
+static const struct impl impls[] = {
+	{"qsort", wait_qsort},
+	{"pending", runtime_wait_multiple},
+};
+
+/*
+ * run -- returns the time in nanoseconds of waiting for nfuts futures
+ */
+static uint64_t
+run(const struct impl *impl, struct runtime *runtime, uint64_t nfuts,
+	uint64_t max_polls)
+{
+	struct countdown_fut *futs = malloc(sizeof(*futs) * nfuts);
+	struct future **runnables = malloc(sizeof(*runnables) * nfuts);
+	if (futs == NULL || runnables == NULL) {
+		fprintf(stderr, "failed to allocate the futures\n");
+		exit(1);
+	}
+	futures_init(futs, runnables, nfuts, max_polls);
+
+	uint64_t start = benchmark_time_ns();
+	impl->wait(runtime, runnables, nfuts);
+	uint64_t time = benchmark_time_ns() - start;
+
+	for (uint64_t i = 0; i < nfuts; ++i) {
+		if (futs[i].output.polls != 1 + i % max_polls) {
+			fprintf(stderr, "future polled %llu times\n",
+				(unsigned long long)futs[i].output.polls);
+			exit(1);
+		}
+	}
+
+	free(runnables);
+	free(futs);
+
+	return time;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t max_futures = benchmark_arg(argc, argv, 1, 1 << 20);
+	uint64_t max_polls = benchmark_arg(argc, argv, 2, 16);
+
+	if (max_polls == 0) {
+		fprintf(stderr, "max_polls must be at least 1\n");
+		return 1;
+	}
+
+	struct runtime *runtime = runtime_new();
+	if (runtime == NULL) {
+		fprintf(stderr, "failed to create the runtime\n");
+		return 1;
+	}
+
+	printf("%10s", "futures");
+	for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i)
+		printf(" %16s", impls[i].name);
+	printf("\n");
+
+	for (uint64_t nfuts = 1; nfuts <= max_futures; nfuts *= 4) {
+		printf("%10llu", (unsigned long long)nfuts);
+		for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+			uint64_t time = run(&impls[i], runtime, nfuts,
+				max_polls);
+			printf(" %12.0f/sec", benchmark_ops_per_sec(nfuts,
+				time));
+		}
+		printf("\n");
+	}
+
+	runtime_delete(runtime);
+
+	return 0;
+}
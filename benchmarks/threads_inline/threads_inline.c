@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * threads_inline.c -- measures the time of memcpy operations submitted in
+ * batches and executed by the worker threads of the threads data mover or
+ * inline by the thread that starts them, to find the size up to which inline
+ * execution is faster. Worker threads execute a batch in parallel, but each
+ * operation pays for the handoff.
+ *
+ * Usage: benchmark-threads-inline [max_size] [nops] [nthreads]
+ *	max_size - the largest operation size to test (default 1MB),
+ *		the size is doubled starting from 64 bytes,
+ *	nops - number of operations for each size (default 10000),
+ *	nthreads - number of worker threads of the mover (default 4).
+ */
+
+#include <string.h>
+#include "libminiasync.h"
+#include "benchmark_helpers.h"
+
+#define MIN_SIZE 64
+#define BATCH_SIZE 16
+#define RINGBUF_SIZE 128
+
+/*
+ * run -- returns the average time in nanoseconds of a memcpy operation
+ * of the given size
+ */
+static double
+run(struct data_mover_threads *dmt, struct runtime *r, char *dst,
+	char *src, size_t size, uint64_t nops)
+{
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	struct vdm_operation_future futs[BATCH_SIZE];
+	struct future *runnable[BATCH_SIZE];
+
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t done = 0; done < nops; done += BATCH_SIZE) {
+		for (size_t i = 0; i < BATCH_SIZE; ++i) {
+			futs[i] = vdm_memcpy(vdm, dst + i * size, src,
+				size, 0);
+			runnable[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+		}
+		runtime_wait_multiple(r, runnable, BATCH_SIZE);
+	}
+	uint64_t time = benchmark_time_ns() - start;
+
+	return (double)time / (double)nops;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t max_size = benchmark_arg(argc, argv, 1, 1 << 20);
+	uint64_t nops = benchmark_arg(argc, argv, 2, 10000);
+	uint64_t nthreads = benchmark_arg(argc, argv, 3, 4);
+
+	struct data_mover_threads *dmt = data_mover_threads_new(nthreads,
+		RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	struct runtime *r = runtime_new();
+	char *src = malloc(max_size);
+	char *dst = malloc(max_size * BATCH_SIZE);
+	if (dmt == NULL || r == NULL || src == NULL || dst == NULL) {
+		fprintf(stderr, "failed to initialize the benchmark\n");
+		return 1;
+	}
+	memset(src, 0xC, max_size);
+	memset(dst, 0, max_size * BATCH_SIZE);
+
+	/* measure the latency of whole operations, without splitting */
+	data_mover_threads_set_chunk_size(dmt, 0);
+
+	/* the largest size for which inline execution was faster so far */
+	uint64_t crossover = 0;
+	int inline_faster = 1;
+	printf("%12s %16s %16s\n", "size", "offload ns/op", "inline ns/op");
+	for (uint64_t size = MIN_SIZE; size <= max_size; size *= 2) {
+		data_mover_threads_set_inline_threshold(dmt, 0);
+		double offload = run(dmt, r, dst, src, size, nops);
+
+		data_mover_threads_set_inline_threshold(dmt, SIZE_MAX);
+		double inl = run(dmt, r, dst, src, size, nops);
+
+		printf("%12llu %16.0f %16.0f\n", (unsigned long long)size,
+			offload, inl);
+
+		if (inline_faster && inl <= offload)
+			crossover = size;
+		else
+			inline_faster = 0;
+	}
+
+	if (crossover == 0) {
+		printf("inline execution is never faster\n");
+	} else {
+		printf("inline execution is faster for operations of up to "
+			"%llu bytes\n", (unsigned long long)crossover);
+	}
+
+	free(dst);
+	free(src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
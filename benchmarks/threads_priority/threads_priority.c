@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * threads_priority.c -- measures the latency of small memcpy operations
+ * in the threads data mover while large memcpy operations keep its queue
+ * busy, with and without the VDM_F_PRIORITY flag on the small ones.
+ * Each small operation is started once the previous one completed and
+ * the large ones are restarted as soon as they complete, so that there are
+ * always nbulk of them queued or running.
+ *
+ * Usage: benchmark-threads-priority [nops] [nthreads] [nbulk] [bulk_size]
+ *	nops - number of small operations (default 1000),
+ *	nthreads - number of worker threads of the mover (default 2),
+ *	nbulk - number of large operations in flight (default 8),
+ *	bulk_size - size of a large operation (default 4MB).
+ */
+
+#include <string.h>
+#include "libminiasync.h"
+#include "benchmark_helpers.h"
+
+#define SMALL_SIZE 4096
+#define RINGBUF_SIZE 128
+#define MAX_BULK 64
+
+/*
+ * cmp_u64 -- compares two latencies for qsort
+ */
+static int
+cmp_u64(const void *lhs, const void *rhs)
+{
+	uint64_t l = *(const uint64_t *)lhs;
+	uint64_t r = *(const uint64_t *)rhs;
+
+	return l < r ? -1 : l > r;
+}
+
+/*
+ * percentile -- returns the p-th percentile of the sorted latencies
+ */
+static uint64_t
+percentile(const uint64_t *lat, uint64_t n, uint64_t p)
+{
+	return lat[(n - 1) * p / 100];
+}
+
+/*
+ * run -- runs the mixed load, prints the latency percentiles of the small
+ * operations and the throughput of the large ones
+ */
+static void
+run(struct vdm *vdm, struct runtime *r, uint64_t nops, uint64_t nbulk,
+	size_t bulk_size, char *bulk_dst, char *bulk_src, unsigned flags)
+{
+	char small_src[SMALL_SIZE];
+	char small_dst[SMALL_SIZE];
+	memset(small_src, 0xA, SMALL_SIZE);
+
+	uint64_t *lat = malloc(sizeof(uint64_t) * nops);
+	if (lat == NULL) {
+		fprintf(stderr, "failed to allocate the latencies\n");
+		exit(1);
+	}
+
+	struct vdm_operation_future bulk[MAX_BULK];
+	for (uint64_t b = 0; b < nbulk; ++b) {
+		bulk[b] = vdm_memcpy(vdm, bulk_dst + b * bulk_size, bulk_src,
+			bulk_size, 0);
+		future_poll(FUTURE_AS_RUNNABLE(&bulk[b]), NULL);
+	}
+
+	uint64_t nbulk_done = 0;
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t i = 0; i < nops; ++i) {
+		/* keep the queue full of large operations */
+		for (uint64_t b = 0; b < nbulk; ++b) {
+			if (future_poll(FUTURE_AS_RUNNABLE(&bulk[b]), NULL) !=
+					FUTURE_STATE_COMPLETE)
+				continue;
+			nbulk_done++;
+			bulk[b] = vdm_memcpy(vdm, bulk_dst + b * bulk_size,
+				bulk_src, bulk_size, 0);
+			future_poll(FUTURE_AS_RUNNABLE(&bulk[b]), NULL);
+		}
+
+		uint64_t t = benchmark_time_ns();
+		struct vdm_operation_future fut = vdm_memcpy(vdm, small_dst,
+			small_src, SMALL_SIZE, flags);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		lat[i] = benchmark_time_ns() - t;
+	}
+	uint64_t time = benchmark_time_ns() - start;
+
+	/* let the remaining large operations finish */
+	for (uint64_t b = 0; b < nbulk; ++b) {
+		if (future_poll(FUTURE_AS_RUNNABLE(&bulk[b]), NULL) !=
+				FUTURE_STATE_COMPLETE)
+			runtime_wait(r, FUTURE_AS_RUNNABLE(&bulk[b]));
+	}
+
+	qsort(lat, nops, sizeof(uint64_t), cmp_u64);
+	printf("%10s %12llu %12llu %12llu %12.0f\n",
+		flags & VDM_F_PRIORITY ? "priority" : "normal",
+		(unsigned long long)percentile(lat, nops, 50),
+		(unsigned long long)percentile(lat, nops, 99),
+		(unsigned long long)lat[nops - 1],
+		benchmark_ops_per_sec(nbulk_done, time));
+
+	free(lat);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t nops = benchmark_arg(argc, argv, 1, 1000);
+	uint64_t nthreads = benchmark_arg(argc, argv, 2, 2);
+	uint64_t nbulk = benchmark_arg(argc, argv, 3, 8);
+	size_t bulk_size = (size_t)benchmark_arg(argc, argv, 4, 4 << 20);
+
+	if (nops == 0 || nbulk == 0 || nbulk > MAX_BULK) {
+		fprintf(stderr, "nops must be greater than 0 and nbulk must be "
+			"between 1 and %d\n", MAX_BULK);
+		return 1;
+	}
+
+	struct data_mover_threads *dmt = data_mover_threads_new(nthreads,
+		RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	struct runtime *r = runtime_new();
+	char *bulk_src = malloc(bulk_size);
+	char *bulk_dst = malloc(bulk_size * nbulk);
+	if (dmt == NULL || r == NULL || bulk_src == NULL ||
+			bulk_dst == NULL) {
+		fprintf(stderr, "failed to initialize the benchmark\n");
+		return 1;
+	}
+	memset(bulk_src, 0xB, bulk_size);
+	memset(bulk_dst, 0, bulk_size * nbulk);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	printf("%10s %12s %12s %12s %12s\n", "small ops", "p50 ns",
+		"p99 ns", "max ns", "bulk ops/s");
+	run(vdm, r, nops, nbulk, bulk_size, bulk_dst, bulk_src, 0);
+	run(vdm, r, nops, nbulk, bulk_size, bulk_dst, bulk_src,
+		VDM_F_PRIORITY);
+
+	free(bulk_dst);
+	free(bulk_src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * threads_scheduling.c -- measures the throughput of small memcpy operations
+ * in the threads data mover, depending on the number of worker threads and
+ * the scheduling mode.
+ *
+ * Usage: benchmark-threads-scheduling [max_threads] [nsubmitters] [nops]
+ *	max_threads - the largest number of worker threads to test (default 8),
+ *		the number of threads is doubled starting from 1,
+ *	nsubmitters - number of threads submitting operations (default 2),
+ *	nops - number of operations per submitter (default 100000).
+ */
+
+#include <string.h>
+#include "libminiasync.h"
+#include "core/os_thread.h"
+#include "benchmark_helpers.h"
+
+#define OP_SIZE 64
+#define BATCH_SIZE 128
+#define RINGBUF_SIZE 128
+
+struct submitter_args {
+	struct vdm *vdm;
+	uint64_t nops;
+};
+
+/*
+ * submitter -- submits the requested number of operations in batches
+ */
+static void *
+submitter(void *arg)
+{
+	struct submitter_args *args = arg;
+	struct runtime *r = runtime_new();
+	char src[OP_SIZE];
+	char dst[BATCH_SIZE][OP_SIZE];
+	struct vdm_operation_future futs[BATCH_SIZE];
+	struct future *runnable[BATCH_SIZE];
+
+	memset(src, 0xC, OP_SIZE);
+
+	for (uint64_t done = 0; done < args->nops; done += BATCH_SIZE) {
+		for (size_t i = 0; i < BATCH_SIZE; ++i) {
+			futs[i] = vdm_memcpy(args->vdm, dst[i], src,
+				OP_SIZE, 0);
+			runnable[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+		}
+		runtime_wait_multiple(r, runnable, BATCH_SIZE);
+	}
+
+	runtime_delete(r);
+
+	return NULL;
+}
+
+/*
+ * run -- returns the throughput of the mover created from the configuration
+ */
+static double
+run(struct data_mover_threads_config *cfg, uint64_t nsubmitters,
+	uint64_t nops)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	if (dmt == NULL) {
+		fprintf(stderr, "failed to create the threads data mover\n");
+		exit(1);
+	}
+
+	os_thread_t *threads = malloc(sizeof(os_thread_t) * nsubmitters);
+	struct submitter_args args = {data_mover_threads_get_vdm(dmt), nops};
+	if (threads == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t i = 0; i < nsubmitters; ++i)
+		os_thread_create(&threads[i], NULL, submitter, &args);
+	for (uint64_t i = 0; i < nsubmitters; ++i)
+		os_thread_join(&threads[i], NULL);
+	uint64_t time = benchmark_time_ns() - start;
+
+	free(threads);
+	data_mover_threads_delete(dmt);
+
+	return benchmark_ops_per_sec(nops * nsubmitters, time);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t max_threads = benchmark_arg(argc, argv, 1, 8);
+	uint64_t nsubmitters = benchmark_arg(argc, argv, 2, 2);
+	uint64_t nops = benchmark_arg(argc, argv, 3, 100000);
+
+	struct {
+		const char *name;
+		enum data_mover_threads_scheduling scheduling;
+		enum data_mover_threads_placement placement;
+	} modes[] = {
+		{"shared", DATA_MOVER_THREADS_SCHEDULING_SHARED,
+			DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN},
+		{"stealing-rr", DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING,
+			DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN},
+		{"stealing-local", DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING,
+			DATA_MOVER_THREADS_PLACEMENT_LOCAL},
+	};
+
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	if (cfg == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	data_mover_threads_config_set_ringbuf_size(cfg, RINGBUF_SIZE);
+
+	printf("%-16s %8s %16s\n", "mode", "threads", "ops/s");
+	for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+		data_mover_threads_config_set_scheduling(cfg,
+			modes[m].scheduling);
+		data_mover_threads_config_set_placement(cfg,
+			modes[m].placement);
+
+		for (uint64_t t = 1; t <= max_threads; t *= 2) {
+			data_mover_threads_config_set_nthreads(cfg, t);
+			printf("%-16s %8llu %16.0f\n", modes[m].name,
+				(unsigned long long)t,
+				run(cfg, nsubmitters, nops));
+		}
+	}
+
+	data_mover_threads_config_delete(cfg);
+
+	return 0;
+}
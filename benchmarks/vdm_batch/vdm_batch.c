@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * vdm_batch.c -- compares the throughput of small memcpy operations submitted
+ * to the threads data mover as separate futures and as a single batch.
+ *
+ * Usage: benchmark-vdm-batch [nops] [size] [nthreads]
+ *	nops - number of operations (default 10000),
+ *	size - size of each operation (default 64),
+ *	nthreads - number of worker threads of the mover (default 4).
+ */
+
+#include <string.h>
+#include "libminiasync.h"
+#include "benchmark_helpers.h"
+
+#define RINGBUF_SIZE 128
+#define NREPEATS 10
+
+/*
+ * run_separate -- returns the time in nanoseconds of nops memcpy operations,
+ * each started by its own future
+ */
+static uint64_t
+run_separate(struct vdm *vdm, struct runtime *r,
+	struct vdm_operation_future *futs, char *dst, char *src,
+	uint64_t nops, uint64_t size)
+{
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t i = 0; i < nops; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst + i * size, src, size, 0);
+		future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL);
+	}
+	for (uint64_t i = 0; i < nops; ++i) {
+		struct future *fut = FUTURE_AS_RUNNABLE(&futs[i]);
+		if (future_poll(fut, NULL) != FUTURE_STATE_COMPLETE)
+			runtime_wait(r, fut);
+	}
+
+	return benchmark_time_ns() - start;
+}
+
+/*
+ * run_batch -- returns the time in nanoseconds of nops memcpy operations
+ * started by a single batch future
+ */
+static uint64_t
+run_batch(struct vdm *vdm, struct runtime *r, struct vdm_operation *ops,
+	struct vdm_operation_output *outputs, char *dst, char *src,
+	uint64_t nops, uint64_t size)
+{
+	uint64_t start = benchmark_time_ns();
+	for (uint64_t i = 0; i < nops; ++i) {
+		ops[i].type = VDM_OPERATION_MEMCPY;
+		ops[i].data.memcpy.dest = dst + i * size;
+		ops[i].data.memcpy.src = src;
+		ops[i].data.memcpy.n = size;
+		ops[i].data.memcpy.flags = 0;
+	}
+	struct vdm_batch_future fut = vdm_batch(vdm, ops, outputs, nops);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+
+	return benchmark_time_ns() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t nops = benchmark_arg(argc, argv, 1, 10000);
+	uint64_t size = benchmark_arg(argc, argv, 2, 64);
+	uint64_t nthreads = benchmark_arg(argc, argv, 3, 4);
+
+	struct data_mover_threads *dmt = data_mover_threads_new(nthreads,
+		RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	struct runtime *r = runtime_new();
+	char *src = malloc(size);
+	char *dst = malloc(size * nops);
+	struct vdm_operation_future *futs = malloc(sizeof(*futs) * nops);
+	struct vdm_operation *ops = malloc(sizeof(*ops) * nops);
+	struct vdm_operation_output *outputs = malloc(sizeof(*outputs) * nops);
+	if (dmt == NULL || r == NULL || src == NULL || dst == NULL ||
+			futs == NULL || ops == NULL || outputs == NULL) {
+		fprintf(stderr, "failed to initialize the benchmark\n");
+		return 1;
+	}
+	memset(src, 0xC, size);
+	memset(dst, 0, size * nops);
+
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	uint64_t separate = 0;
+	uint64_t batch = 0;
+	for (int i = 0; i < NREPEATS; ++i) {
+		separate += run_separate(vdm, r, futs, dst, src, nops, size);
+		batch += run_batch(vdm, r, ops, outputs, dst, src, nops, size);
+	}
+
+	printf("%12s %16s\n", "submission", "ops/s");
+	printf("%12s %16.0f\n", "separate",
+		benchmark_ops_per_sec(nops * NREPEATS, separate));
+	printf("%12s %16.0f\n", "batch",
+		benchmark_ops_per_sec(nops * NREPEATS, batch));
+
+	free(outputs);
+	free(ops);
+	free(futs);
+	free(dst);
+	free(src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
@@ -11,6 +11,7 @@
 #include "libminiasync-vdm-dml.h"
 
 #define SUPPORTED_FLAGS VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT
+#define DATA_MOVER_DML_DEFAULT_MAX_BUFFERS 16 /* 32MB per thread */
 /*
  * XXX: This flag should be defined in DML header but for some reason isn't
  * this flag is needed to guarantee that writes to persistent memory
@@ -49,6 +50,8 @@ data_mover_dml_translate_flags(uint64_t flags, uint64_t *dml_flags)
 			case VDM_F_NO_CACHE_HINT:
 				*dml_flags &= ~DML_FLAG_PREFETCH_CACHE;
 				break;
+			case VDM_F_PRIORITY: /* not supported, ignored */
+				break;
 			default: /* shouldn't be possible */
 				ASSERT(0);
 		}
@@ -363,7 +366,10 @@ data_mover_dml_new(enum data_mover_dml_type type)
 	if (vdm_dml == NULL)
 		return NULL;
 
-	vdm_dml->membuf = membuf_new(vdm_dml);
+	/* a long operation mustn't keep the space of short ones from reuse */
+	vdm_dml->membuf = membuf_new_ext(vdm_dml, MEMBUF_MODE_FREE_LISTS);
+	membuf_set_max_threadbufs(vdm_dml->membuf,
+		DATA_MOVER_DML_DEFAULT_MAX_BUFFERS);
 	vdm_dml->base = data_mover_dml_vdm;
 	switch (type) {
 		case DATA_MOVER_DML_HARDWARE:
@@ -382,6 +388,17 @@ data_mover_dml_new(enum data_mover_dml_type type)
 	return vdm_dml;
 }
 
+/*
+ * data_mover_dml_set_max_buffers -- sets the number of 2MB buffers up to which
+ * the space for jobs of a single submitting thread grows
+ */
+void
+data_mover_dml_set_max_buffers(struct data_mover_dml *dmd,
+	size_t max_buffers)
+{
+	membuf_set_max_threadbufs(dmd->membuf, max_buffers);
+}
+
 /*
  * data_mover_dml_get_vdm -- returns the vdm for dml data mover
  */
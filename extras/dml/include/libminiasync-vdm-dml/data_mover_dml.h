@@ -21,6 +21,8 @@ enum data_mover_dml_type {
 
 struct data_mover_dml *data_mover_dml_new(enum data_mover_dml_type type);
 struct vdm *data_mover_dml_get_vdm(struct data_mover_dml *dmd);
+void data_mover_dml_set_max_buffers(struct data_mover_dml *dmd,
+	size_t max_buffers);
 void data_mover_dml_delete(struct data_mover_dml *dmd);
 
 #ifdef __cplusplus
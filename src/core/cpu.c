@@ -52,6 +52,22 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 #define bit_MOVDIR64B (1 << 28)
 #endif
 
+#ifndef bit_WAITPKG
+#define bit_WAITPKG (1 << 5)
+#endif
+
+#ifndef bit_CLFSH
+#define bit_CLFSH (1 << 19)
+#endif
+
+#ifndef bit_CLFLUSHOPT
+#define bit_CLFLUSHOPT (1 << 23)
+#endif
+
+#ifndef bit_CLWB
+#define bit_CLWB (1 << 24)
+#endif
+
 /*
  * is_cpu_feature_present -- (internal) checks if CPU feature is supported
  */
@@ -78,6 +94,96 @@ is_cpu_movdir64b_present(void)
 	return is_cpu_feature_present(0x7, ECX_IDX, bit_MOVDIR64B);
 }
 
+/*
+ * is_cpu_waitpkg_present -- checks if umonitor and umwait instructions are
+ * supported
+ */
+int
+is_cpu_waitpkg_present(void)
+{
+	return is_cpu_feature_present(0x7, ECX_IDX, bit_WAITPKG);
+}
+
+/*
+ * is_cpu_clflush_present -- checks if clflush instruction is supported
+ */
+int
+is_cpu_clflush_present(void)
+{
+	return is_cpu_feature_present(0x1, EDX_IDX, bit_CLFSH);
+}
+
+/*
+ * is_cpu_clflushopt_present -- checks if clflushopt instruction is supported
+ */
+int
+is_cpu_clflushopt_present(void)
+{
+	return is_cpu_feature_present(0x7, EBX_IDX, bit_CLFLUSHOPT);
+}
+
+/*
+ * is_cpu_clwb_present -- checks if clwb instruction is supported
+ */
+int
+is_cpu_clwb_present(void)
+{
+	return is_cpu_feature_present(0x7, EBX_IDX, bit_CLWB);
+}
+
+/*
+ * cpu_cache_leaf_size -- (internal) returns the size of the largest cache
+ * described by the deterministic cache parameters leaf, 0 if there's none
+ */
+static size_t
+cpu_cache_leaf_size(unsigned func)
+{
+	unsigned cpuinfo[4] = { 0 };
+	size_t size = 0;
+
+	for (unsigned sub = 0; ; ++sub) {
+		cpuid(func, sub, cpuinfo);
+
+		/* cache type 0 terminates the list */
+		if ((cpuinfo[EAX_IDX] & 0x1F) == 0)
+			break;
+
+		size_t ways = ((cpuinfo[EBX_IDX] >> 22) & 0x3FF) + 1;
+		size_t partitions = ((cpuinfo[EBX_IDX] >> 12) & 0x3FF) + 1;
+		size_t line = (cpuinfo[EBX_IDX] & 0xFFF) + 1;
+		size_t sets = (size_t)cpuinfo[ECX_IDX] + 1;
+
+		size_t cache = ways * partitions * line * sets;
+		if (cache > size)
+			size = cache;
+	}
+
+	return size;
+}
+
+/*
+ * cpu_llc_size -- returns the size of the last level cache, 0 if unknown
+ */
+size_t
+cpu_llc_size(void)
+{
+	unsigned cpuinfo[4] = { 0 };
+
+	cpuid(0x0, 0x0, cpuinfo);
+	if (cpuinfo[EAX_IDX] >= 0x4) {
+		size_t size = cpu_cache_leaf_size(0x4);
+		if (size != 0)
+			return size;
+	}
+
+	/* amd describes its caches in the extended leaf */
+	cpuid(0x80000000, 0x0, cpuinfo);
+	if (cpuinfo[EAX_IDX] >= 0x8000001D)
+		return cpu_cache_leaf_size(0x8000001D);
+
+	return 0;
+}
+
 #else
 
 /*
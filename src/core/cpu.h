@@ -8,10 +8,18 @@
  * cpu.h -- definitions for "cpu" module
  */
 
+#include <stddef.h>
+
 #if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
 	defined(_M_AMD64)
 
 int is_cpu_movdir64b_present(void);
+int is_cpu_waitpkg_present(void);
+int is_cpu_clflush_present(void);
+int is_cpu_clflushopt_present(void);
+int is_cpu_clwb_present(void);
+
+size_t cpu_llc_size(void);
 
 #endif
 
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * flush.c -- flushing of cache lines, using the best instruction
+ * supported by the cpu
+ */
+
+#include "flush.h"
+#include "util.h"
+
+#if FLUSH_DURABLE
+
+#include "cpu.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+enum flush_kind {
+	FLUSH_KIND_UNKNOWN, /* not detected yet */
+	FLUSH_KIND_FENCE, /* no flush instruction, only ordering */
+	FLUSH_KIND_CLFLUSH,
+	FLUSH_KIND_CLFLUSHOPT,
+	FLUSH_KIND_CLWB,
+};
+
+static uint64_t Flush_kind;
+
+#ifdef _MSC_VER
+#define flush_clflushopt(addr) _mm_clflushopt((void *)(addr))
+#define flush_clwb(addr) _mm_clwb((void *)(addr))
+#else
+/*
+ * The instructions are encoded by hand, so that they don't require
+ * the compiler to target a cpu which supports them.
+ */
+#define flush_clflushopt(addr)\
+	asm volatile(".byte 0x66; clflush %0" :\
+		"+m" (*(volatile char *)(addr)))
+#define flush_clwb(addr)\
+	asm volatile(".byte 0x66; xsaveopt %0" :\
+		"+m" (*(volatile char *)(addr)))
+#endif
+
+/*
+ * flush_detect -- (internal) returns the best flush instruction of the cpu
+ */
+static enum flush_kind
+flush_detect(void)
+{
+	uint64_t kind;
+	util_atomic_load_explicit64(&Flush_kind, &kind, memory_order_relaxed);
+	if (kind != FLUSH_KIND_UNKNOWN)
+		return (enum flush_kind)kind;
+
+	if (is_cpu_clwb_present())
+		kind = FLUSH_KIND_CLWB;
+	else if (is_cpu_clflushopt_present())
+		kind = FLUSH_KIND_CLFLUSHOPT;
+	else if (is_cpu_clflush_present())
+		kind = FLUSH_KIND_CLFLUSH;
+	else
+		kind = FLUSH_KIND_FENCE;
+
+	util_atomic_store_explicit64(&Flush_kind, kind, memory_order_relaxed);
+
+	return (enum flush_kind)kind;
+}
+
+/*
+ * flush_range -- writes back all the cache lines of the range and waits
+ * until that's done
+ */
+void
+flush_range(const void *addr, size_t len)
+{
+	uintptr_t line = (uintptr_t)addr & ~(FLUSH_ALIGN - 1);
+	uintptr_t end = (uintptr_t)addr + len;
+
+	switch (flush_detect()) {
+		case FLUSH_KIND_CLWB:
+			for (; line < end; line += FLUSH_ALIGN)
+				flush_clwb(line);
+			break;
+		case FLUSH_KIND_CLFLUSHOPT:
+			for (; line < end; line += FLUSH_ALIGN)
+				flush_clflushopt(line);
+			break;
+		case FLUSH_KIND_CLFLUSH:
+			for (; line < end; line += FLUSH_ALIGN)
+				_mm_clflush((const void *)line);
+			break;
+		default:
+			/* as on the other architectures */
+			_mm_mfence();
+			return;
+	}
+
+	/* clwb and clflushopt are weakly ordered */
+	_mm_sfence();
+}
+
+#else
+
+#ifdef _WIN32
+#define __sync_synchronize() MemoryBarrier()
+#endif
+
+/*
+ * flush_range -- there's no portable way to write back cache lines on
+ * the other architectures yet, only the ordering of stores is enforced
+ */
+void
+flush_range(const void *addr, size_t len)
+{
+	SUPPRESS_UNUSED(addr, len);
+
+	__sync_synchronize();
+}
+
+#endif
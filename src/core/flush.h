@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef MINIASYNC_FLUSH_H
+#define MINIASYNC_FLUSH_H 1
+
+/*
+ * flush.h -- definitions for "flush" module
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLUSH_ALIGN ((uintptr_t)64)
+
+/* whether flushed stores reach the persistence domain on this platform */
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+#define FLUSH_DURABLE 1
+#else
+#define FLUSH_DURABLE 0
+#endif
+
+void flush_range(const void *addr, size_t len);
+
+#endif
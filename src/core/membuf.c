@@ -5,24 +5,78 @@
  * membuf.c -- membuf implementation
  */
 
+#include <string.h>
+
 #include "membuf.h"
 #include "core/os_thread.h"
 #include "core/out.h"
+#include "core/util.h"
 
 #define MEMBUF_ALIGNMENT (1 << 21) /* 2MB */
 #define MEMBUF_LEN (1 << 21) /* 2MB */
+#define MEMBUF_PREFAULT_STRIDE 4096 /* the smallest page size */
+
+/* free lists of entries of sizes between consecutive powers of two */
+#define MEMBUF_NCLASSES 22 /* up to MEMBUF_LEN */
+#define MEMBUF_ENTRY_ALIGNMENT ((size_t)8)
+
+#define MEMBUF_ENTRY_FREE 0
+#define MEMBUF_ENTRY_ALLOCATED 1
+#define MEMBUF_ENTRY_LISTED 2 /* on one of the free lists */
+
+#define MEMBUF_SLAB_PAGE_SIZE ((size_t)1 << 16) /* 64KB */
+#define MEMBUF_SLAB_NPAGES (MEMBUF_LEN / MEMBUF_SLAB_PAGE_SIZE)
+#define MEMBUF_SLAB_NCLASSES 8 /* distinct object sizes in a threadbuf */
+
+/* objects of a single size, used only by the owner of the threadbuf */
+struct membuf_slab_class {
+	size_t size; /* size of an object, 0 if the class is unused */
+	void *local; /* stack of free objects */
+	char *carve; /* next never used object in the current page */
+	char *carve_end; /* end of the current page */
+	size_t nobjects; /* number of objects carved from pages */
+};
+
+struct membuf_entry;
 
 struct threadbuf {
 	struct threadbuf *next; /* next threadbuf */
 	struct threadbuf *unused_next; /* next unused threadbuf */
 
 	struct membuf *membuf;
+	enum membuf_pages pages; /* the memory actually backing the buffer */
+
+	/*
+	 * A thread allocates from a chain of threadbufs, which grows on
+	 * demand. The first one of the chain, kept in the TLS, is the head.
+	 * The current one and the length of the chain are valid in the head.
+	 */
+	struct threadbuf *head;
+	struct threadbuf *chain_next; /* next threadbuf of the same thread */
+	struct threadbuf *current; /* the one allocations come from */
+	size_t chain_len;
 
 	void *user_data; /* user-specified pointer */
 	size_t size; /* size of the buf variable */
 	size_t offset; /* current allocation offset */
 	size_t available; /* free space available in front of the offset */
 	size_t leftovers; /* space left unused on wraparound */
+
+	/*
+	 * In the free lists mode the space up to the offset is divided into
+	 * entries and the space past it was never used. The free lists are
+	 * used only by the owner of the threadbuf.
+	 */
+	struct membuf_entry *free_lists[MEMBUF_NCLASSES];
+
+	/* in the slab mode, each page holds objects of one of the classes */
+	struct membuf_slab_class slab_classes[MEMBUF_SLAB_NCLASSES];
+	unsigned char slab_page_class[MEMBUF_SLAB_NPAGES];
+	size_t slab_next_page; /* pages past this one were never used */
+	/* stacks of objects freed by other threads, away from the rest */
+	uint64_t slab_remote_padding[8];
+	void *slab_remote[MEMBUF_SLAB_NCLASSES];
+
 	char buf[]; /* buffer with data */
 };
 
@@ -33,14 +87,28 @@ struct membuf {
 
 	os_tls_key_t bufkey; /* TLS key for threadbuf */
 	void *user_data; /* user-provided buffer data */
+	enum membuf_mode mode;
+	enum membuf_pages pages; /* requested backing of new threadbufs */
+	int prefault; /* touch all pages of new threadbufs */
+	size_t max_threadbufs; /* the longest chain of a single thread */
 };
 
 struct membuf_entry {
-	int32_t allocated; /* 1 - allocated, 0 - unused */
+	int32_t allocated; /* one of MEMBUF_ENTRY_* */
 	uint32_t size; /* size of the entry */
 	char data[]; /* user data */
 };
 
+/* links of an entry on a free list, kept in place of its data */
+struct membuf_links {
+	struct membuf_entry *prev;
+	struct membuf_entry *next;
+};
+
+#define MEMBUF_LINKS(entry) ((struct membuf_links *)(entry)->data)
+#define MEMBUF_MIN_ENTRY \
+	(sizeof(struct membuf_entry) + sizeof(struct membuf_links))
+
 /*
  * membuf_key_destructor -- thread destructor for threadbuf
  */
@@ -52,14 +120,18 @@ membuf_key_destructor(void *data)
 	 * the Windows FLS implementation also calls it when the key itself
 	 * is destroyed. To handle this difference, membuf only actually
 	 * deallocates thread buffers on module delete and this callback
-	 * puts the now unused thread buffer on a list to be reused.
+	 * puts the now unused thread buffers on a list to be reused.
 	 */
-	struct threadbuf *tbuf = data;
-	struct membuf *membuf = tbuf->membuf;
+	struct threadbuf *head = data;
+	struct membuf *membuf = head->membuf;
 
 	os_mutex_lock(&membuf->lists_lock);
-	tbuf->unused_next = membuf->tbuf_unused_first;
-	membuf->tbuf_unused_first = tbuf;
+	for (struct threadbuf *tbuf = head; tbuf != NULL;
+			tbuf = tbuf->chain_next) {
+		tbuf->head = NULL; /* objects freed from now on are remote */
+		tbuf->unused_next = membuf->tbuf_unused_first;
+		membuf->tbuf_unused_first = tbuf;
+	}
 	os_mutex_unlock(&membuf->lists_lock);
 }
 
@@ -68,12 +140,26 @@ membuf_key_destructor(void *data)
  */
 struct membuf *
 membuf_new(void *user_data)
+{
+	return membuf_new_ext(user_data, MEMBUF_MODE_RING);
+}
+
+/*
+ * membuf_new_ext -- allocates and initializes a new membuf instance which
+ * reclaims the space of freed objects according to the mode
+ */
+struct membuf *
+membuf_new_ext(void *user_data, enum membuf_mode mode)
 {
 	struct membuf *membuf = malloc(sizeof(struct membuf));
 	if (membuf == NULL)
 		return NULL;
 
 	membuf->user_data = user_data;
+	membuf->mode = mode;
+	membuf->pages = MEMBUF_PAGES_DEFAULT;
+	membuf->prefault = 0;
+	membuf->max_threadbufs = 1;
 	membuf->tbuf_first = NULL;
 	membuf->tbuf_unused_first = NULL;
 	os_mutex_init(&membuf->lists_lock);
@@ -92,13 +178,37 @@ membuf_delete(struct membuf *membuf)
 	os_tls_key_delete(membuf->bufkey);
 	for (struct threadbuf *tbuf = membuf->tbuf_first; tbuf != NULL; ) {
 		struct threadbuf *next = tbuf->next;
-		util_aligned_free(tbuf);
+		if (tbuf->pages == MEMBUF_PAGES_DEFAULT)
+			util_aligned_free(tbuf);
+		else
+			util_huge_unmap(tbuf, MEMBUF_LEN);
 		tbuf = next;
 	}
 	os_mutex_destroy(&membuf->lists_lock);
 	free(membuf);
 }
 
+/*
+ * membuf_set_pages -- sets the memory backing the threadbufs created from now
+ * on and whether all of their pages are touched when they are created
+ */
+void
+membuf_set_pages(struct membuf *membuf, enum membuf_pages pages, int prefault)
+{
+	membuf->pages = pages;
+	membuf->prefault = prefault;
+}
+
+/*
+ * membuf_set_max_threadbufs -- sets the number of threadbufs up to which
+ * the chain of each thread grows once the ones it has are full
+ */
+void
+membuf_set_max_threadbufs(struct membuf *membuf, size_t max_threadbufs)
+{
+	membuf->max_threadbufs = MAX(max_threadbufs, 1);
+}
+
 /*
  * membuf_entry_get_size -- returns the size of an entry
  */
@@ -155,6 +265,188 @@ membuf_threadbuf_prune(struct membuf *membuf,
 	}
 }
 
+/*
+ * membuf_class -- returns the index of the free list for entries of
+ * the given size, all of them are at least as large as its power of two
+ */
+static unsigned
+membuf_class(size_t size)
+{
+	return util_mssb_index64((uint64_t)size);
+}
+
+/*
+ * membuf_list_insert -- puts a free entry on its free list
+ */
+static void
+membuf_list_insert(struct threadbuf *tbuf, struct membuf_entry *entry)
+{
+	struct membuf_entry **head =
+		&tbuf->free_lists[membuf_class(entry->size)];
+
+	MEMBUF_LINKS(entry)->prev = NULL;
+	MEMBUF_LINKS(entry)->next = *head;
+	if (*head != NULL)
+		MEMBUF_LINKS(*head)->prev = entry;
+	*head = entry;
+
+	util_atomic_store_explicit32(&entry->allocated, MEMBUF_ENTRY_LISTED,
+		memory_order_relaxed);
+}
+
+/*
+ * membuf_list_remove -- takes the entry off its free list
+ */
+static void
+membuf_list_remove(struct threadbuf *tbuf, struct membuf_entry *entry)
+{
+	struct membuf_links *links = MEMBUF_LINKS(entry);
+
+	if (links->prev != NULL)
+		MEMBUF_LINKS(links->prev)->next = links->next;
+	else
+		tbuf->free_lists[membuf_class(entry->size)] = links->next;
+	if (links->next != NULL)
+		MEMBUF_LINKS(links->next)->prev = links->prev;
+}
+
+/*
+ * membuf_list_take -- takes a free entry of at least real_size bytes off
+ * the free lists, the rest of a much larger entry is put back as a new one
+ */
+static struct membuf_entry *
+membuf_list_take(struct threadbuf *tbuf, size_t real_size)
+{
+	unsigned c = membuf_class(real_size);
+	struct membuf_entry *entry = tbuf->free_lists[c];
+
+	/* every entry of the larger classes fits */
+	if (entry == NULL || entry->size < real_size) {
+		entry = NULL;
+		for (unsigned i = c + 1; i < MEMBUF_NCLASSES && !entry; ++i)
+			entry = tbuf->free_lists[i];
+	}
+
+	/* some entries of the same class might fit */
+	if (entry == NULL) {
+		for (entry = tbuf->free_lists[c]; entry != NULL;
+				entry = MEMBUF_LINKS(entry)->next) {
+			if (entry->size >= real_size)
+				break;
+		}
+		if (entry == NULL)
+			return NULL;
+	}
+
+	membuf_list_remove(tbuf, entry);
+
+	if (entry->size - real_size >= MEMBUF_MIN_ENTRY) {
+		struct membuf_entry *rest = (struct membuf_entry *)
+			((char *)entry + real_size);
+		rest->size = entry->size - (uint32_t)real_size;
+		membuf_list_insert(tbuf, rest);
+		entry->size = (uint32_t)real_size;
+	}
+
+	return entry;
+}
+
+/*
+ * membuf_threadbuf_scavenge -- puts the entries freed since the last call
+ * on the free lists, merging the adjacent ones, free space at the end is
+ * given back to the never used space
+ */
+static void
+membuf_threadbuf_scavenge(struct threadbuf *tbuf)
+{
+	struct membuf_entry *run = NULL; /* merged free entries */
+
+	for (size_t pos = 0; pos < tbuf->offset; ) {
+		struct membuf_entry *entry =
+			(struct membuf_entry *)&tbuf->buf[pos];
+		pos += entry->size;
+
+		int state = membuf_entry_is_allocated(entry);
+		if (state == MEMBUF_ENTRY_ALLOCATED) {
+			if (run != NULL)
+				membuf_list_insert(tbuf, run);
+			run = NULL;
+			continue;
+		}
+
+		if (state == MEMBUF_ENTRY_LISTED)
+			membuf_list_remove(tbuf, entry);
+
+		if (run == NULL)
+			run = entry;
+		else
+			run->size += entry->size;
+	}
+
+	if (run != NULL)
+		tbuf->offset = (size_t)((char *)run - tbuf->buf);
+}
+
+/*
+ * membuf_slab_take_remote -- takes all the objects of the class freed by
+ * other threads, the whole stack is taken at once, so there's no ABA problem
+ */
+static void *
+membuf_slab_take_remote(struct threadbuf *tbuf, unsigned c)
+{
+	void *head;
+	do {
+		util_atomic_load_explicit64(&tbuf->slab_remote[c], &head,
+			memory_order_acquire);
+	} while (head != NULL && !util_bool_compare_and_swap64(
+		&tbuf->slab_remote[c], head, NULL));
+
+	return head;
+}
+
+/*
+ * membuf_slab_is_empty -- checks if all the objects of the slab were freed,
+ * takes back the ones freed by other threads
+ */
+static int
+membuf_slab_is_empty(struct threadbuf *tbuf)
+{
+	for (unsigned c = 0; c < MEMBUF_SLAB_NCLASSES; ++c) {
+		struct membuf_slab_class *cls = &tbuf->slab_classes[c];
+		void *remote = membuf_slab_take_remote(tbuf, c);
+		while (remote != NULL) {
+			void *next = *(void **)remote;
+			*(void **)remote = cls->local;
+			cls->local = remote;
+			remote = next;
+		}
+
+		size_t nfree = 0;
+		for (void *obj = cls->local; obj != NULL; obj = *(void **)obj)
+			nfree++;
+		if (nfree != cls->nobjects)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * membuf_threadbuf_reset -- makes the whole buffer space available
+ */
+static void
+membuf_threadbuf_reset(struct threadbuf *tbuf)
+{
+	tbuf->size = MEMBUF_LEN - sizeof(*tbuf);
+	tbuf->offset = 0;
+	tbuf->leftovers = 0;
+	tbuf->available = tbuf->size;
+	memset(tbuf->free_lists, 0, sizeof(tbuf->free_lists));
+	memset(tbuf->slab_classes, 0, sizeof(tbuf->slab_classes));
+	memset(tbuf->slab_remote, 0, sizeof(tbuf->slab_remote));
+	tbuf->slab_next_page = 0;
+}
+
 /*
  * tbuf_check_safe_for_reuse -- verifies if the thread buffer doesn't contain
  * any live allocations that would prevent it from being reused.
@@ -162,31 +454,75 @@ membuf_threadbuf_prune(struct membuf *membuf,
 static int
 tbuf_check_safe_for_reuse(struct threadbuf *tbuf)
 {
+	if (tbuf->membuf->mode == MEMBUF_MODE_FREE_LISTS) {
+		membuf_threadbuf_scavenge(tbuf);
+		return tbuf->offset == 0;
+	}
+
+	if (tbuf->membuf->mode == MEMBUF_MODE_SLAB)
+		return membuf_slab_is_empty(tbuf);
+
 	membuf_threadbuf_prune(tbuf->membuf, tbuf);
 	return tbuf->available == tbuf->size;
 }
 
 /*
- * membuf_get_threadbuf -- returns thread-local buffer for allocations
+ * membuf_threadbuf_alloc -- allocates a new threadbuf backed by the requested
+ * pages or, if those are not available, by the next best ones
  */
 static struct threadbuf *
-membuf_get_threadbuf(struct membuf *membuf)
+membuf_threadbuf_alloc(struct membuf *membuf)
 {
-	struct threadbuf *tbuf = os_tls_get(membuf->bufkey);
-	if (tbuf != NULL)
-		return tbuf;
+	enum membuf_pages pages = membuf->pages;
+	struct threadbuf *tbuf = NULL;
 
+	/*
+	 * Make sure buffer is aligned to 2MB so that we can align down
+	 * from contained pointers to access metadata (like user_data).
+	 */
+	if (pages == MEMBUF_PAGES_HUGETLB) {
+		tbuf = util_huge_map(MEMBUF_ALIGNMENT, MEMBUF_LEN, 1);
+		if (tbuf == NULL)
+			pages = MEMBUF_PAGES_TRANSPARENT_HUGE;
+	}
+	if (pages == MEMBUF_PAGES_TRANSPARENT_HUGE) {
+		tbuf = util_huge_map(MEMBUF_ALIGNMENT, MEMBUF_LEN, 0);
+		if (tbuf == NULL)
+			pages = MEMBUF_PAGES_DEFAULT;
+	}
+	if (pages == MEMBUF_PAGES_DEFAULT) {
+		tbuf = util_aligned_malloc(MEMBUF_ALIGNMENT, MEMBUF_LEN);
+		if (tbuf == NULL)
+			return NULL;
+	}
+
+	/* fault the pages in now, not on the first allocations */
+	if (membuf->prefault) {
+		volatile char *mem = (volatile char *)tbuf;
+		for (size_t off = 0; off < MEMBUF_LEN;
+				off += MEMBUF_PREFAULT_STRIDE)
+			mem[off] = 0;
+	}
+
+	tbuf->pages = pages;
+
+	return tbuf;
+}
+
+/*
+ * membuf_threadbuf_acquire -- takes a threadbuf off the list of unused ones,
+ * if it can be reused, or allocates a new one
+ */
+static struct threadbuf *
+membuf_threadbuf_acquire(struct membuf *membuf, struct threadbuf *head)
+{
 	os_mutex_lock(&membuf->lists_lock);
 
-	tbuf = membuf->tbuf_unused_first;
+	struct threadbuf *tbuf = membuf->tbuf_unused_first;
 	if (tbuf != NULL && tbuf_check_safe_for_reuse(tbuf)) {
 		membuf->tbuf_unused_first = tbuf->unused_next;
 	} else {
-		/*
-		 * Make sure buffer is aligned to 2MB so that we can align down
-		 * from contained pointers to access metadata (like user_data).
-		 */
-		tbuf = util_aligned_malloc(MEMBUF_ALIGNMENT, MEMBUF_LEN);
+		tbuf = membuf_threadbuf_alloc(membuf);
 		if (tbuf == NULL) {
 			os_mutex_unlock(&membuf->lists_lock);
 			return NULL;
@@ -196,14 +532,14 @@ membuf_get_threadbuf(struct membuf *membuf)
 		membuf->tbuf_first = tbuf;
 	}
 
-	tbuf->size = MEMBUF_LEN - sizeof(*tbuf);
-	tbuf->offset = 0;
-	tbuf->leftovers = 0;
+	membuf_threadbuf_reset(tbuf);
 	tbuf->unused_next = NULL;
 	tbuf->membuf = membuf;
-	tbuf->available = tbuf->size;
 	tbuf->user_data = membuf->user_data;
-	os_tls_set(membuf->bufkey, tbuf);
+	tbuf->head = head != NULL ? head : tbuf;
+	tbuf->chain_next = NULL;
+	tbuf->current = tbuf;
+	tbuf->chain_len = 1;
 
 	os_mutex_unlock(&membuf->lists_lock);
 
@@ -211,15 +547,162 @@ membuf_get_threadbuf(struct membuf *membuf)
 }
 
 /*
- * membuf_alloc -- allocate linearly from the available memory location.
+ * membuf_threadbuf_release -- puts a threadbuf of a chain that is no longer
+ * used on the list of unused ones
  */
-void *
-membuf_alloc(struct membuf *membuf, size_t size)
+static void
+membuf_threadbuf_release(struct membuf *membuf, struct threadbuf *tbuf)
 {
-	struct threadbuf *tbuf = membuf_get_threadbuf(membuf);
-	if (tbuf == NULL)
+	os_mutex_lock(&membuf->lists_lock);
+	tbuf->head = NULL;
+	tbuf->unused_next = membuf->tbuf_unused_first;
+	membuf->tbuf_unused_first = tbuf;
+	os_mutex_unlock(&membuf->lists_lock);
+}
+
+/*
+ * membuf_get_threadbuf -- returns the head of the thread-local chain of
+ * buffers for allocations
+ */
+static struct threadbuf *
+membuf_get_threadbuf(struct membuf *membuf)
+{
+	struct threadbuf *tbuf = os_tls_get(membuf->bufkey);
+	if (tbuf != NULL)
+		return tbuf;
+
+	tbuf = membuf_threadbuf_acquire(membuf, NULL);
+	if (tbuf != NULL)
+		os_tls_set(membuf->bufkey, tbuf);
+
+	return tbuf;
+}
+
+/*
+ * membuf_register_thread -- sets up the buffer of the calling thread ahead of
+ * its first allocation, pre-faulting it if requested
+ */
+int
+membuf_register_thread(struct membuf *membuf)
+{
+	return membuf_get_threadbuf(membuf) == NULL ? -1 : 0;
+}
+
+/*
+ * membuf_alloc_free_lists -- allocate from the free lists or from the never
+ * used space, collect the freed entries if neither has enough space
+ */
+static void *
+membuf_alloc_free_lists(struct threadbuf *tbuf, size_t size)
+{
+	size_t real_size = ALIGN_UP(MAX(size + sizeof(struct membuf_entry),
+		MEMBUF_MIN_ENTRY), MEMBUF_ENTRY_ALIGNMENT);
+
+	if (real_size > tbuf->size)
+		return NULL;
+
+	struct membuf_entry *entry = membuf_list_take(tbuf, real_size);
+	if (entry == NULL && tbuf->offset + real_size > tbuf->size) {
+		membuf_threadbuf_scavenge(tbuf);
+		entry = membuf_list_take(tbuf, real_size);
+	}
+
+	if (entry == NULL) {
+		if (tbuf->offset + real_size > tbuf->size)
+			return NULL;
+
+		entry = (struct membuf_entry *)&tbuf->buf[tbuf->offset];
+		entry->size = (uint32_t)real_size;
+		tbuf->offset += real_size;
+	}
+
+	util_atomic_store_explicit32(&entry->allocated, MEMBUF_ENTRY_ALLOCATED,
+		memory_order_relaxed);
+
+	return &entry->data;
+}
+
+/*
+ * membuf_slab_class -- returns the index of the class of objects of the given
+ * size, a new class is created for a new size, fails if there are too many
+ */
+static int
+membuf_slab_class(struct threadbuf *tbuf, size_t size)
+{
+	for (unsigned c = 0; c < MEMBUF_SLAB_NCLASSES; ++c) {
+		struct membuf_slab_class *cls = &tbuf->slab_classes[c];
+		if (cls->size == size)
+			return (int)c;
+		if (cls->size == 0) {
+			cls->size = size;
+			return (int)c;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * membuf_slab_base -- returns the beginning of the first page of the slab,
+ * aligned to the cache line so that objects of sizes which are multiples
+ * of it never share one
+ */
+static char *
+membuf_slab_base(struct threadbuf *tbuf)
+{
+	return (char *)ALIGN_UP((uintptr_t)tbuf->buf, CACHELINE_SIZE);
+}
+
+/*
+ * membuf_alloc_slab -- allocate an object from the free ones of its class,
+ * from the ones freed by other threads or from a never used page
+ */
+static void *
+membuf_alloc_slab(struct threadbuf *tbuf, size_t size)
+{
+	size = ALIGN_UP(MAX(size, sizeof(void *)), MEMBUF_ENTRY_ALIGNMENT);
+	if (size > MEMBUF_SLAB_PAGE_SIZE)
 		return NULL;
 
+	int c = membuf_slab_class(tbuf, size);
+	if (c < 0)
+		return NULL;
+
+	struct membuf_slab_class *cls = &tbuf->slab_classes[c];
+	if (cls->local == NULL)
+		cls->local = membuf_slab_take_remote(tbuf, (unsigned)c);
+
+	void *obj = cls->local;
+	if (obj != NULL) {
+		cls->local = *(void **)obj;
+		return obj;
+	}
+
+	if (cls->carve == NULL || cls->carve + size > cls->carve_end) {
+		char *page = membuf_slab_base(tbuf) +
+			tbuf->slab_next_page * MEMBUF_SLAB_PAGE_SIZE;
+		if (page + MEMBUF_SLAB_PAGE_SIZE > tbuf->buf + tbuf->size)
+			return NULL;
+
+		tbuf->slab_page_class[tbuf->slab_next_page] = (unsigned char)c;
+		cls->carve = page;
+		cls->carve_end = cls->carve + MEMBUF_SLAB_PAGE_SIZE;
+		tbuf->slab_next_page++;
+	}
+
+	obj = cls->carve;
+	cls->carve += size;
+	cls->nobjects++;
+
+	return obj;
+}
+
+/*
+ * membuf_alloc_ring -- allocate linearly from the available memory location.
+ */
+static void *
+membuf_alloc_ring(struct membuf *membuf, struct threadbuf *tbuf, size_t size)
+{
 	size_t real_size = size + sizeof(struct membuf_entry);
 
 	if (real_size > tbuf->size)
@@ -253,16 +736,137 @@ membuf_alloc(struct membuf *membuf, size_t size)
 	return &entry->data;
 }
 
+/*
+ * membuf_alloc_from -- allocate from a single threadbuf in the way of the mode
+ */
+static void *
+membuf_alloc_from(struct membuf *membuf, struct threadbuf *tbuf, size_t size)
+{
+	if (membuf->mode == MEMBUF_MODE_FREE_LISTS)
+		return membuf_alloc_free_lists(tbuf, size);
+
+	if (membuf->mode == MEMBUF_MODE_SLAB)
+		return membuf_alloc_slab(tbuf, size);
+
+	return membuf_alloc_ring(membuf, tbuf, size);
+}
+
+/*
+ * membuf_chain_alloc -- allocates from the other threadbufs of the chain or
+ * from a new one, if none of them has enough space and the chain can grow,
+ * the empty ones past the one used from now on are given back for reuse
+ */
+static void *
+membuf_chain_alloc(struct membuf *membuf, struct threadbuf *head, size_t size)
+{
+	struct threadbuf *tried = head->current;
+	void *ptr = NULL;
+
+	struct threadbuf **prev = &head;
+	for (struct threadbuf *tbuf = head; tbuf != NULL; tbuf = *prev) {
+		if (ptr == NULL && tbuf != tried) {
+			ptr = membuf_alloc_from(membuf, tbuf, size);
+			if (ptr != NULL)
+				head->current = tbuf;
+		} else if (ptr != NULL && tbuf != head &&
+				tbuf_check_safe_for_reuse(tbuf)) {
+			*prev = tbuf->chain_next;
+			head->chain_len--;
+			membuf_threadbuf_release(membuf, tbuf);
+			continue;
+		}
+		prev = &tbuf->chain_next;
+	}
+
+	if (ptr != NULL || head->chain_len >= membuf->max_threadbufs)
+		return ptr;
+
+	struct threadbuf *tbuf = membuf_threadbuf_acquire(membuf, head);
+	if (tbuf == NULL)
+		return NULL;
+
+	ptr = membuf_alloc_from(membuf, tbuf, size);
+	if (ptr == NULL) {
+		/* too large for any threadbuf */
+		membuf_threadbuf_release(membuf, tbuf);
+		return NULL;
+	}
+
+	tbuf->chain_next = head->chain_next;
+	head->chain_next = tbuf;
+	head->chain_len++;
+	head->current = tbuf;
+
+	return ptr;
+}
+
+/*
+ * membuf_alloc -- allocate from the current threadbuf of the thread, other
+ * ones of its chain are used once it's full
+ */
+void *
+membuf_alloc(struct membuf *membuf, size_t size)
+{
+	struct threadbuf *head = membuf_get_threadbuf(membuf);
+	if (head == NULL)
+		return NULL;
+
+	void *ptr = membuf_alloc_from(membuf, head->current, size);
+	if (ptr != NULL)
+		return ptr;
+
+	return membuf_chain_alloc(membuf, head, size);
+}
+
+/*
+ * membuf_free_slab -- puts the object back on the stack of its class, a lock
+ * free one if it's not freed by the owner of the threadbuf
+ */
+static void
+membuf_free_slab(struct threadbuf *tbuf, void *ptr)
+{
+	size_t page = (size_t)((char *)ptr - membuf_slab_base(tbuf)) /
+		MEMBUF_SLAB_PAGE_SIZE;
+	unsigned c = tbuf->slab_page_class[page];
+
+	/*
+	 * The head of a threadbuf whose owner exited is NULL, just like
+	 * the TLS of a thread which never allocated from the membuf.
+	 */
+	struct threadbuf *head = tbuf->head;
+	if (head != NULL && os_tls_get(tbuf->membuf->bufkey) == head) {
+		struct membuf_slab_class *cls = &tbuf->slab_classes[c];
+		*(void **)ptr = cls->local;
+		cls->local = ptr;
+		return;
+	}
+
+	void *top;
+	do {
+		util_atomic_load_explicit64(&tbuf->slab_remote[c], &top,
+			memory_order_relaxed);
+		*(void **)ptr = top;
+	} while (!util_bool_compare_and_swap64(&tbuf->slab_remote[c], top,
+		ptr));
+}
+
 /*
  * membuf_free -- deallocates an entry
  */
 void
 membuf_free(void *ptr)
 {
+	struct threadbuf *tbuf = (struct threadbuf *)ALIGN_DOWN((ptrdiff_t)ptr,
+		MEMBUF_ALIGNMENT);
+	if (tbuf->membuf->mode == MEMBUF_MODE_SLAB) {
+		membuf_free_slab(tbuf, ptr);
+		return;
+	}
+
 	struct membuf_entry *entry = (struct membuf_entry *)
 		((uintptr_t)ptr - sizeof(struct membuf_entry));
 
-	util_atomic_store_explicit64(&entry->allocated, 0,
+	util_atomic_store_explicit64(&entry->allocated, MEMBUF_ENTRY_FREE,
 		memory_order_release);
 }
 
@@ -10,6 +10,24 @@
  * Allocation is linear and very cheap. The expectation is that objects within
  * the buffer will be reclaimable long before the linear allocator might need
  * to wraparound to reuse memory.
+ *
+ * That doesn't hold if some objects live much longer than others, a single
+ * one blocks the reuse of the whole buffer. In the free lists mode, objects
+ * freed out of order are collected into lists of free space of similar size
+ * once the buffer is full and they are reused from there.
+ *
+ * In the slab mode, the buffer is divided into pages of objects of the same
+ * size, meant for the few fixed sizes of objects allocated by the users of
+ * membuf. Both allocation and free take constant time, objects freed by
+ * other threads are pushed onto a lock-free stack and taken back all at once.
+ *
+ * Once the buffer of a thread is full, further ones are chained to it on
+ * demand, up to a configurable number of them. The ones that became empty
+ * are given back for reuse by any thread.
+ *
+ * Per-thread buffers can be backed by huge pages and pre-faulted when
+ * a thread registers, so that neither the TLB misses nor the page faults
+ * of the first touch of the buffer happen in the allocation path.
  */
 
 #ifndef MEMBUF_H
@@ -19,8 +37,25 @@
 
 struct membuf;
 
+enum membuf_mode {
+	MEMBUF_MODE_RING, /* space is reclaimed in allocation order */
+	MEMBUF_MODE_FREE_LISTS, /* freed space is reused in any order */
+	MEMBUF_MODE_SLAB, /* objects of a few fixed sizes */
+};
+
+enum membuf_pages {
+	MEMBUF_PAGES_DEFAULT, /* regular heap memory */
+	MEMBUF_PAGES_TRANSPARENT_HUGE, /* advised to use transparent ones */
+	MEMBUF_PAGES_HUGETLB, /* reserved ones, transparent if none are left */
+};
+
 struct membuf *membuf_new(void *user_data);
+struct membuf *membuf_new_ext(void *user_data, enum membuf_mode mode);
 void membuf_delete(struct membuf *membuf);
+void membuf_set_pages(struct membuf *membuf, enum membuf_pages pages,
+	int prefault);
+void membuf_set_max_threadbufs(struct membuf *membuf, size_t max_threadbufs);
+int membuf_register_thread(struct membuf *membuf);
 
 void *membuf_alloc(struct membuf *membuf, size_t size);
 void membuf_free(void *ptr);
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * memops.c -- memory copy and fill kernels using non-temporal stores,
+ * which write the destination without pulling it into the caches
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "memops.h"
+#include "util.h"
+
+/* used when the size of the last level cache can't be read */
+#define MEMOPS_DEFAULT_LLC_SIZE ((size_t)16 << 20) /* 16MB */
+
+#if MEMOPS_NT
+
+#include <emmintrin.h>
+#include "cpu.h"
+
+/* a single iteration of the kernels writes a whole cache line */
+#define MEMOPS_LINE ((uintptr_t)64)
+
+/* below that, the head and the tail of the range would dominate */
+#define MEMOPS_NT_MIN_SIZE 256
+
+/*
+ * memops_line_offset -- (internal) returns the number of bytes from addr
+ * to the next cache line boundary
+ */
+static inline size_t
+memops_line_offset(const void *addr)
+{
+	return (size_t)((MEMOPS_LINE - ((uintptr_t)addr & (MEMOPS_LINE - 1))) &
+		(MEMOPS_LINE - 1));
+}
+
+/*
+ * memops_copy_line -- (internal) copies a cache line to the aligned dest,
+ * whole source line is loaded first so that the ranges may overlap
+ */
+static inline void
+memops_copy_line(char *dest, const char *src)
+{
+	__m128i x0 = _mm_loadu_si128((const __m128i *)src);
+	__m128i x1 = _mm_loadu_si128((const __m128i *)(src + 16));
+	__m128i x2 = _mm_loadu_si128((const __m128i *)(src + 32));
+	__m128i x3 = _mm_loadu_si128((const __m128i *)(src + 48));
+
+	_mm_stream_si128((__m128i *)dest, x0);
+	_mm_stream_si128((__m128i *)(dest + 16), x1);
+	_mm_stream_si128((__m128i *)(dest + 32), x2);
+	_mm_stream_si128((__m128i *)(dest + 48), x3);
+}
+
+/*
+ * memops_copy_fwd -- (internal) copies from the lowest addresses up, safe
+ * for overlapping ranges if dest is below src
+ */
+static void
+memops_copy_fwd(char *dest, const char *src, size_t n)
+{
+	size_t head = memops_line_offset(dest);
+	memmove(dest, src, head);
+	dest += head;
+	src += head;
+	n -= head;
+
+	for (; n >= MEMOPS_LINE; n -= MEMOPS_LINE) {
+		memops_copy_line(dest, src);
+		dest += MEMOPS_LINE;
+		src += MEMOPS_LINE;
+	}
+
+	memmove(dest, src, n);
+}
+
+/*
+ * memops_copy_bwd -- (internal) copies from the highest addresses down,
+ * safe for overlapping ranges if dest is above src
+ */
+static void
+memops_copy_bwd(char *dest, const char *src, size_t n)
+{
+	size_t tail = (uintptr_t)(dest + n) & (MEMOPS_LINE - 1);
+	n -= tail;
+	memmove(dest + n, src + n, tail);
+
+	for (; n >= MEMOPS_LINE; n -= MEMOPS_LINE)
+		memops_copy_line(dest + n - MEMOPS_LINE,
+			src + n - MEMOPS_LINE);
+
+	memmove(dest, src, n);
+}
+
+/*
+ * memops_memcpy_nt -- copies non-overlapping ranges with non-temporal
+ * stores, the stores are complete when the function returns
+ */
+void *
+memops_memcpy_nt(void *dest, const void *src, size_t n)
+{
+	if (n < MEMOPS_NT_MIN_SIZE)
+		return memcpy(dest, src, n);
+
+	memops_copy_fwd(dest, src, n);
+
+	/* non-temporal stores are weakly ordered */
+	_mm_sfence();
+
+	return dest;
+}
+
+/*
+ * memops_memmove_nt -- copies possibly overlapping ranges with
+ * non-temporal stores, the stores are complete when the function returns
+ */
+void *
+memops_memmove_nt(void *dest, const void *src, size_t n)
+{
+	if (n < MEMOPS_NT_MIN_SIZE)
+		return memmove(dest, src, n);
+
+	if ((uintptr_t)dest - (uintptr_t)src >= n)
+		memops_copy_fwd(dest, src, n);
+	else
+		memops_copy_bwd(dest, src, n);
+
+	_mm_sfence();
+
+	return dest;
+}
+
+/*
+ * memops_memset_nt -- fills the range with non-temporal stores, the stores
+ * are complete when the function returns
+ */
+void *
+memops_memset_nt(void *dest, int c, size_t n)
+{
+	if (n < MEMOPS_NT_MIN_SIZE)
+		return memset(dest, c, n);
+
+	char *d = dest;
+	size_t head = memops_line_offset(d);
+	memset(d, c, head);
+	d += head;
+	n -= head;
+
+	__m128i x = _mm_set1_epi8((char)c);
+	for (; n >= MEMOPS_LINE; n -= MEMOPS_LINE) {
+		_mm_stream_si128((__m128i *)d, x);
+		_mm_stream_si128((__m128i *)(d + 16), x);
+		_mm_stream_si128((__m128i *)(d + 32), x);
+		_mm_stream_si128((__m128i *)(d + 48), x);
+		d += MEMOPS_LINE;
+	}
+
+	memset(d, c, n);
+
+	_mm_sfence();
+
+	return dest;
+}
+
+/*
+ * memops_llc_size -- (internal) returns the size of the last level cache
+ */
+static size_t
+memops_llc_size(void)
+{
+	size_t size = cpu_llc_size();
+
+	return size != 0 ? size : MEMOPS_DEFAULT_LLC_SIZE;
+}
+
+#else
+
+/*
+ * There are no non-temporal stores available on the other architectures
+ * yet, the regular functions are used instead.
+ */
+
+void *
+memops_memcpy_nt(void *dest, const void *src, size_t n)
+{
+	return memcpy(dest, src, n);
+}
+
+void *
+memops_memmove_nt(void *dest, const void *src, size_t n)
+{
+	return memmove(dest, src, n);
+}
+
+void *
+memops_memset_nt(void *dest, int c, size_t n)
+{
+	return memset(dest, c, n);
+}
+
+static size_t
+memops_llc_size(void)
+{
+	return MEMOPS_DEFAULT_LLC_SIZE;
+}
+
+#endif
+
+static uint64_t Nt_threshold;
+
+/*
+ * memops_nt_threshold -- returns the size of an operation from which
+ * it's worth bypassing the caches: a copy that large would evict most of
+ * the last level cache anyway, only to leave it filled with data which is
+ * not going to be read soon
+ */
+size_t
+memops_nt_threshold(void)
+{
+	uint64_t threshold;
+	util_atomic_load_explicit64(&Nt_threshold, &threshold,
+		memory_order_relaxed);
+	if (threshold != 0)
+		return (size_t)threshold;
+
+	threshold = memops_llc_size() / 2;
+	util_atomic_store_explicit64(&Nt_threshold, threshold,
+		memory_order_relaxed);
+
+	return (size_t)threshold;
+}
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef MINIASYNC_MEMOPS_H
+#define MINIASYNC_MEMOPS_H 1
+
+/*
+ * memops.h -- definitions for "memops" module
+ */
+
+#include <stddef.h>
+
+/* whether the non-temporal variants bypass the caches on this platform */
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+#define MEMOPS_NT 1
+#else
+#define MEMOPS_NT 0
+#endif
+
+void *memops_memcpy_nt(void *dest, const void *src, size_t n);
+void *memops_memmove_nt(void *dest, const void *src, size_t n);
+void *memops_memset_nt(void *dest, int c, size_t n);
+
+size_t memops_nt_threshold(void);
+
+#endif
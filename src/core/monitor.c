@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * monitor.c -- waiting for a write to a memory word with umonitor and
+ * umwait, on the cpus which support them
+ */
+
+#include "monitor.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+
+#include "cpu.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+/* umwait enters C0.1, which is left faster than the deeper C0.2 */
+#define MONITOR_UMWAIT_C01 1U
+
+enum monitor_kind {
+	MONITOR_KIND_UNKNOWN, /* not detected yet */
+	MONITOR_KIND_NONE,
+	MONITOR_KIND_WAITPKG,
+};
+
+static uint64_t Monitor_kind;
+
+#ifdef _MSC_VER
+#define monitor_umonitor(addr) _umonitor((void *)(addr))
+#define monitor_umwait(deadline) _umwait(MONITOR_UMWAIT_C01, (deadline))
+#else
+/*
+ * The instructions are encoded by hand, so that they don't require
+ * the compiler to target a cpu which supports them.
+ */
+#define monitor_umonitor(addr)\
+	asm volatile(".byte 0xf3, 0x0f, 0xae, 0xf0" :: "a" (addr))
+#define monitor_umwait(deadline)\
+	asm volatile(".byte 0xf2, 0x0f, 0xae, 0xf1" ::\
+		"c" (MONITOR_UMWAIT_C01),\
+		"a" ((uint32_t)(deadline)),\
+		"d" ((uint32_t)((deadline) >> 32)) : "cc", "memory")
+#endif
+
+/*
+ * monitor_detect -- (internal) returns the way of monitoring words supported
+ * by the cpu
+ */
+static enum monitor_kind
+monitor_detect(void)
+{
+	uint64_t kind;
+	util_atomic_load_explicit64(&Monitor_kind, &kind, memory_order_relaxed);
+	if (kind != MONITOR_KIND_UNKNOWN)
+		return (enum monitor_kind)kind;
+
+	kind = is_cpu_waitpkg_present() ?
+		MONITOR_KIND_WAITPKG : MONITOR_KIND_NONE;
+
+	util_atomic_store_explicit64(&Monitor_kind, kind, memory_order_relaxed);
+
+	return (enum monitor_kind)kind;
+}
+
+/*
+ * monitor_wait_supported -- checks if monitor_wait can stop the cpu until
+ * the word is written
+ */
+int
+monitor_wait_supported(void)
+{
+	return monitor_detect() == MONITOR_KIND_WAITPKG;
+}
+
+/*
+ * monitor_wait -- waits until the word no longer holds the value, at most
+ * for the given number of tsc cycles, the wait can also end early
+ * (e.g. on an interrupt or once the time limit set by the os runs out)
+ */
+void
+monitor_wait(uint64_t *addr, uint64_t value, uint64_t cycles)
+{
+	if (monitor_detect() != MONITOR_KIND_WAITPKG) {
+		WAIT();
+		return;
+	}
+
+	uint64_t deadline = __rdtsc() + cycles;
+
+	/* a write after the check wakes the cpu up, it's monitored already */
+	monitor_umonitor(addr);
+
+	uint64_t cur;
+	util_atomic_load_explicit64(addr, &cur, memory_order_acquire);
+	if (cur == value)
+		monitor_umwait(deadline);
+}
+
+#else
+
+/*
+ * monitor_wait_supported -- there's no way to wait for a write on the other
+ * architectures yet
+ */
+int
+monitor_wait_supported(void)
+{
+	return 0;
+}
+
+/*
+ * monitor_wait -- only pauses, the caller checks the word itself
+ */
+void
+monitor_wait(uint64_t *addr, uint64_t value, uint64_t cycles)
+{
+	SUPPRESS_UNUSED(addr, value, cycles);
+
+	WAIT();
+}
+
+#endif
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef MINIASYNC_MONITOR_H
+#define MINIASYNC_MONITOR_H 1
+
+/*
+ * monitor.h -- definitions for "monitor" module
+ */
+
+#include <stdint.h>
+
+int monitor_wait_supported(void);
+void monitor_wait(uint64_t *addr, uint64_t value, uint64_t cycles);
+
+#endif
@@ -173,8 +173,15 @@ int os_semaphore_init(os_semaphore_t *sem, unsigned value);
 int os_semaphore_destroy(os_semaphore_t *sem);
 int os_semaphore_wait(os_semaphore_t *sem);
 int os_semaphore_trywait(os_semaphore_t *sem);
+int os_semaphore_timedwait(os_semaphore_t *sem,
+	const struct timespec *abstime);
 int os_semaphore_post(os_semaphore_t *sem);
 
+int os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *abstime);
+int os_futex_wake_one(uint32_t *addr);
+int os_futex_wake_all(uint32_t *addr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,13 @@
 #include <pthread_np.h>
 #endif
 #include <semaphore.h>
+#include <errno.h>
+#include <limits.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "os_thread.h"
 #include "util.h"
@@ -428,6 +435,16 @@ os_semaphore_trywait(os_semaphore_t *sem)
 	return sem_trywait((sem_t *)sem);
 }
 
+/*
+ * os_semaphore_timedwait -- decreases the value of the semaphore, waits no
+ * longer than until abstime (CLOCK_REALTIME)
+ */
+int
+os_semaphore_timedwait(os_semaphore_t *sem, const struct timespec *abstime)
+{
+	return sem_timedwait((sem_t *)sem, abstime);
+}
+
 /*
  * os_semaphore_post -- increases the value of the semaphore
  */
@@ -436,3 +453,141 @@ os_semaphore_post(os_semaphore_t *sem)
 {
 	return sem_post((sem_t *)sem);
 }
+
+#ifdef __linux__
+
+/*
+ * os_futex_wait -- blocks while the value at addr equals expected, but no
+ * longer than until abstime (CLOCK_REALTIME) unless it's NULL. It can also
+ * return spuriously.
+ */
+int
+os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *abstime)
+{
+	/* only the bitset variant takes an absolute timeout */
+	long ret = syscall(SYS_futex, addr,
+		FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME, expected,
+		abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+
+	/* the value has already changed */
+	if (ret != 0 && errno == EAGAIN)
+		return 0;
+
+	return ret == 0 ? 0 : -1;
+}
+
+/*
+ * os_futex_wake_one -- wakes up one of the threads waiting on addr
+ */
+int
+os_futex_wake_one(uint32_t *addr)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1,
+		NULL, NULL, 0) < 0 ? -1 : 0;
+}
+
+/*
+ * os_futex_wake_all -- wakes up all the threads waiting on addr
+ */
+int
+os_futex_wake_all(uint32_t *addr)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX,
+		NULL, NULL, 0) < 0 ? -1 : 0;
+}
+
+#else
+
+/*
+ * Without futexes, waiters sleep on one of a fixed number of condition
+ * variables chosen by the address they wait on.
+ */
+#define OS_FUTEX_NBUCKETS 64
+
+static struct os_futex_bucket {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Futex_buckets[OS_FUTEX_NBUCKETS];
+
+static pthread_once_t Futex_once = PTHREAD_ONCE_INIT;
+
+/*
+ * os_futex_init -- (internal) initializes the buckets of waiters
+ */
+static void
+os_futex_init(void)
+{
+	for (size_t i = 0; i < OS_FUTEX_NBUCKETS; ++i) {
+		pthread_mutex_init(&Futex_buckets[i].lock, NULL);
+		pthread_cond_init(&Futex_buckets[i].cond, NULL);
+	}
+}
+
+/*
+ * os_futex_bucket -- (internal) returns the bucket of waiters on addr
+ */
+static struct os_futex_bucket *
+os_futex_bucket(uint32_t *addr)
+{
+	pthread_once(&Futex_once, os_futex_init);
+
+	return &Futex_buckets[((uintptr_t)addr >> 2) % OS_FUTEX_NBUCKETS];
+}
+
+/*
+ * os_futex_wait -- blocks while the value at addr equals expected, but no
+ * longer than until abstime (CLOCK_REALTIME) unless it's NULL. It can also
+ * return spuriously.
+ */
+int
+os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *abstime)
+{
+	struct os_futex_bucket *bucket = os_futex_bucket(addr);
+	int ret = 0;
+
+	pthread_mutex_lock(&bucket->lock);
+	if (__atomic_load_n(addr, __ATOMIC_SEQ_CST) == expected) {
+		if (abstime != NULL)
+			ret = pthread_cond_timedwait(&bucket->cond,
+				&bucket->lock, abstime);
+		else
+			ret = pthread_cond_wait(&bucket->cond, &bucket->lock);
+	}
+	pthread_mutex_unlock(&bucket->lock);
+
+	if (ret != 0) {
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * os_futex_wake_all -- wakes up all the threads waiting on addr
+ */
+int
+os_futex_wake_all(uint32_t *addr)
+{
+	struct os_futex_bucket *bucket = os_futex_bucket(addr);
+
+	/* a waiter either sees the new value or is already asleep */
+	pthread_mutex_lock(&bucket->lock);
+	pthread_mutex_unlock(&bucket->lock);
+
+	return pthread_cond_broadcast(&bucket->cond) == 0 ? 0 : -1;
+}
+
+/*
+ * os_futex_wake_one -- wakes up one of the threads waiting on addr, other
+ * addresses share the condition variable, so all of them are woken up
+ */
+int
+os_futex_wake_one(uint32_t *addr)
+{
+	return os_futex_wake_all(addr);
+}
+
+#endif
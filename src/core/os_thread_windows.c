@@ -49,6 +49,9 @@
 #include "util.h"
 #include "out.h"
 
+/* WaitOnAddress and WakeByAddress* live in a separate library */
+#pragma comment(lib, "Synchronization.lib")
+
 typedef struct {
 	CRITICAL_SECTION lock;
 	unsigned attr;
@@ -657,6 +660,23 @@ os_semaphore_trywait(os_semaphore_t *sem)
 	return ret == WAIT_OBJECT_0 ? 0 : -1;
 }
 
+/*
+ * os_semaphore_timedwait -- decreases the value of the semaphore, waits no
+ * longer than until abstime
+ */
+int
+os_semaphore_timedwait(os_semaphore_t *sem, const struct timespec *abstime)
+{
+	internal_semaphore_t *internal_sem = (internal_semaphore_t *)sem;
+	DWORD ret = WaitForSingleObject(internal_sem->handle,
+		get_rel_wait(abstime));
+
+	if (ret == WAIT_TIMEOUT)
+		errno = ETIMEDOUT;
+
+	return ret == WAIT_OBJECT_0 ? 0 : -1;
+}
+
 /*
  * os_semaphore_post -- increases the value of the semaphore
  */
@@ -667,3 +687,42 @@ os_semaphore_post(os_semaphore_t *sem)
 	BOOL ret = ReleaseSemaphore(internal_sem->handle, 1, NULL);
 	return ret ? 0 : -1;
 }
+
+/*
+ * os_futex_wait -- blocks while the value at addr equals expected, but no
+ * longer than until abstime unless it's NULL. It can also return spuriously.
+ */
+int
+os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *abstime)
+{
+	DWORD ms = abstime != NULL ? get_rel_wait(abstime) : INFINITE;
+
+	if (!WaitOnAddress(addr, &expected, sizeof(expected), ms)) {
+		if (GetLastError() == ERROR_TIMEOUT)
+			errno = ETIMEDOUT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * os_futex_wake_one -- wakes up one of the threads waiting on addr
+ */
+int
+os_futex_wake_one(uint32_t *addr)
+{
+	WakeByAddressSingle(addr);
+	return 0;
+}
+
+/*
+ * os_futex_wake_all -- wakes up all the threads waiting on addr
+ */
+int
+os_futex_wake_all(uint32_t *addr)
+{
+	WakeByAddressAll(addr);
+	return 0;
+}
@@ -3,8 +3,11 @@
 
 /*
  * ringbuf.c -- implementation of a simple multi-producer/multi-consumer (MPMC)
- * ring buffer. It uses atomic instructions for correctness and semaphores for
- * waiting.
+ * ring buffer. Each slot carries a sequence number which tells whether it's
+ * ready to be written or read in the current lap over the buffer, so that
+ * both enqueue and dequeue take a single compare-and-swap of the position
+ * in the common case. Threads block on a futex only when the buffer is full
+ * or empty.
  */
 
 /* disable conditional expression is const warning */
@@ -25,31 +28,36 @@
 #define __sync_synchronize() MemoryBarrier()
 #endif
 
-#if 1
 /*
- * This number defines by how much the relevant semaphore will be increased to
- * unlock waiting threads and thus defines how many threads can wait on
- *  the ring buffer at the same time.
+ * Threads blocked on a full or empty buffer wait for the event counter
+ * to change, it's bumped only if there are any waiters.
  */
-#define RINGBUF_MAX_CONSUMER_THREADS 1024
-#endif
+struct ringbuf_waitq {
+	uint32_t event;
+	uint32_t nwaiters;
+};
 
-/* avoid false sharing by padding the variable */
-#define CACHELINE_PADDING(type, name)\
-union { type name; uint64_t name##_padding[8]; } name##_padded
+struct ringbuf_slot {
+	/*
+	 * Equal to the position of the next write to the slot when it's
+	 * free, to that position plus one when it holds a value.
+	 */
+	uint64_t seq;
+	void *data;
+};
 
 struct ringbuf {
 	CACHELINE_PADDING(uint64_t, read_pos);
 	CACHELINE_PADDING(uint64_t, write_pos);
 
-	CACHELINE_PADDING(os_semaphore_t, nfree);
-	CACHELINE_PADDING(os_semaphore_t, nused);
+	CACHELINE_PADDING(struct ringbuf_waitq, consumers);
+	CACHELINE_PADDING(struct ringbuf_waitq, producers);
 
 	uint64_t len_mask;
 	unsigned len;
 	int running;
 
-	void *data[];
+	struct ringbuf_slot slots[];
 };
 
 /*
@@ -64,21 +72,13 @@ ringbuf_new(unsigned length)
 	if (util_popcount(length) > 1)
 		return NULL;
 
-	struct ringbuf *rbuf =
-		calloc(length * sizeof(void *), sizeof(*rbuf));
+	struct ringbuf *rbuf = calloc(1,
+		sizeof(*rbuf) + length * sizeof(struct ringbuf_slot));
 	if (rbuf == NULL)
 		return NULL;
 
-	if (os_semaphore_init(&rbuf->nfree_padded.nfree, length)) {
-		free(rbuf);
-		return NULL;
-	}
-
-	if (os_semaphore_init(&rbuf->nused_padded.nused, 0)) {
-		util_semaphore_destroy(&rbuf->nfree_padded.nfree);
-		free(rbuf);
-		return NULL;
-	}
+	for (unsigned i = 0; i < length; ++i)
+		rbuf->slots[i].seq = i;
 
 	rbuf->read_pos_padded.read_pos = 0;
 	rbuf->write_pos_padded.write_pos = 0;
@@ -90,6 +90,19 @@ ringbuf_new(unsigned length)
 	return rbuf;
 }
 
+/*
+ * ringbuf_running -- (internal) returns whether the buffer wasn't stopped
+ */
+static int
+ringbuf_running(struct ringbuf *rbuf)
+{
+	int running;
+	util_atomic_load_explicit32(&rbuf->running, &running,
+		memory_order_acquire);
+
+	return running;
+}
+
 #if 1
 /*
  * ringbuf_length -- returns the length of the ring buffer
@@ -102,6 +115,28 @@ ringbuf_length(struct ringbuf *rbuf)
 	return rbuf->len;
 }
 
+/*
+ * ringbuf_count -- returns the approximate number of values in the buffer
+ */
+unsigned
+ringbuf_count(struct ringbuf *rbuf)
+{
+	LOG(4, NULL);
+
+	uint64_t read_pos;
+	uint64_t write_pos;
+	util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos, &read_pos,
+		memory_order_relaxed);
+	util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos,
+		&write_pos, memory_order_relaxed);
+
+	/* the positions are read separately and can be briefly inconsistent */
+	if (write_pos <= read_pos)
+		return 0;
+
+	return (unsigned)MIN(write_pos - read_pos, rbuf->len);
+}
+
 /*
  * ringbuf_stop -- if there are any threads stuck waiting on dequeue, unblocks
  *	them. Those threads, if there are no new elements, will return NULL.
@@ -116,12 +151,16 @@ ringbuf_stop(struct ringbuf *rbuf)
 		rbuf->write_pos_padded.write_pos)
 		__sync_synchronize();
 
-	int ret = util_bool_compare_and_swap64(&rbuf->running, 1, 0);
+	int ret = util_bool_compare_and_swap32(&rbuf->running, 1, 0);
 	ASSERTeq(ret, 1);
 
-	/* XXX just unlock all waiting threads somehow... */
-	for (int64_t i = 0; i < RINGBUF_MAX_CONSUMER_THREADS; ++i)
-		util_semaphore_post(&rbuf->nused_padded.nused);
+	struct ringbuf_waitq *consumers = &rbuf->consumers_padded.consumers;
+	struct ringbuf_waitq *producers = &rbuf->producers_padded.producers;
+
+	util_fetch_and_add32(&consumers->event, 1);
+	util_futex_wake_all(&consumers->event);
+	util_fetch_and_add32(&producers->event, 1);
+	util_futex_wake_all(&producers->event);
 }
 #endif
 
@@ -135,34 +174,224 @@ ringbuf_delete(struct ringbuf *rbuf)
 
 	ASSERTeq(rbuf->read_pos_padded.read_pos,
 		rbuf->write_pos_padded.write_pos);
-	util_semaphore_destroy(&rbuf->nfree_padded.nfree);
-	util_semaphore_destroy(&rbuf->nused_padded.nused);
 	free(rbuf);
 }
 
 /*
- * ringbuf_enqueue_atomic -- (internal) performs the lockfree insert of
- * an element into the ringbuf data array
+ * ringbuf_notify -- (internal) wakes up the threads waiting for the event,
+ * if there are any, n is the number of values which changed hands
  */
 static void
-ringbuf_enqueue_atomic(struct ringbuf *rbuf, void *data)
+ringbuf_notify(struct ringbuf_waitq *waitq, unsigned n)
+{
+	/*
+	 * Pairs with the increment of nwaiters in ringbuf_wait, either
+	 * the waiter sees the change of the buffer or it's seen here.
+	 */
+	__sync_synchronize();
+
+	uint32_t nwaiters;
+	util_atomic_load_explicit32(&waitq->nwaiters, &nwaiters,
+		memory_order_relaxed);
+	if (nwaiters == 0)
+		return;
+
+	util_fetch_and_add32(&waitq->event, 1);
+	if (n == 1)
+		util_futex_wake_one(&waitq->event);
+	else
+		util_futex_wake_all(&waitq->event);
+}
+
+/*
+ * ringbuf_tryenqueue_atomic -- (internal) performs the lockfree insert of
+ * up to n elements into consecutive slots of the ringbuf data array, returns
+ * the number of elements inserted, 0 if the buffer is full
+ */
+static unsigned
+ringbuf_tryenqueue_atomic(struct ringbuf *rbuf, void *const *data,
+	unsigned n)
 {
 	LOG(4, NULL);
 
-	size_t w = util_fetch_and_add64(&rbuf->write_pos_padded.write_pos, 1)
-		& rbuf->len_mask;
+	uint64_t *write_pos = &rbuf->write_pos_padded.write_pos;
+	uint64_t pos;
+	uint64_t seq;
+	unsigned k;
+
+	util_atomic_load_explicit64(write_pos, &pos, memory_order_relaxed);
+	for (;;) {
+		/* count the slots which are free in this lap */
+		for (k = 0; k < n; ++k) {
+			util_atomic_load_explicit64(
+				&rbuf->slots[(pos + k) & rbuf->len_mask].seq,
+				&seq, memory_order_acquire);
+			if (seq != pos + k)
+				break;
+		}
+
+		if (k != 0) {
+			/* a single atomic reserves all of them */
+			if (util_bool_compare_and_swap64(write_pos, pos,
+					pos + k))
+				break;
+		} else if ((int64_t)(seq - pos) < 0) {
+			/* the value from the previous lap wasn't read yet */
+			return 0;
+		}
+
+		/* another producer took the slots */
+		util_atomic_load_explicit64(write_pos, &pos,
+			memory_order_relaxed);
+	}
+
+	for (unsigned i = 0; i < k; ++i) {
+		struct ringbuf_slot *slot =
+			&rbuf->slots[(pos + i) & rbuf->len_mask];
+		slot->data = data[i];
+		VALGRIND_ANNOTATE_HAPPENS_BEFORE(&slot->seq);
+		util_atomic_store_explicit64(&slot->seq, pos + i + 1,
+			memory_order_release);
+	}
 
-	ASSERT(rbuf->running);
+	ringbuf_notify(&rbuf->consumers_padded.consumers, k);
 
-	/*
-	 * In most cases, this won't loop even once, but sometimes if
-	 * the semaphore is incremented concurrently in dequeue,
-	 * we need to wait.
-	 */
-	while (!util_bool_compare_and_swap64(&rbuf->data[w], NULL, data))
-		;
+	return k;
+}
+
+/*
+ * ringbuf_trydequeue_atomic -- (internal) performs a lockfree retrieval of
+ * up to n elements from consecutive slots of the ringbuf, returns the number
+ * of elements retrieved, 0 if the buffer is empty
+ */
+static unsigned
+ringbuf_trydequeue_atomic(struct ringbuf *rbuf, void **data, unsigned n)
+{
+	LOG(4, NULL);
+
+	uint64_t *read_pos = &rbuf->read_pos_padded.read_pos;
+	uint64_t pos;
+	uint64_t seq;
+	unsigned k;
+
+	util_atomic_load_explicit64(read_pos, &pos, memory_order_relaxed);
+	for (;;) {
+		/* count the slots which were written in this lap */
+		for (k = 0; k < n; ++k) {
+			util_atomic_load_explicit64(
+				&rbuf->slots[(pos + k) & rbuf->len_mask].seq,
+				&seq, memory_order_acquire);
+			if (seq != pos + k + 1)
+				break;
+		}
+
+		if (k != 0) {
+			if (util_bool_compare_and_swap64(read_pos, pos,
+					pos + k))
+				break;
+		} else if ((int64_t)(seq - (pos + 1)) < 0) {
+			/* the slot wasn't written in this lap yet */
+			return 0;
+		}
+
+		/* another consumer took the slots */
+		util_atomic_load_explicit64(read_pos, &pos,
+			memory_order_relaxed);
+	}
 
-	VALGRIND_ANNOTATE_HAPPENS_BEFORE(&rbuf->data[w]);
+	for (unsigned i = 0; i < k; ++i) {
+		struct ringbuf_slot *slot =
+			&rbuf->slots[(pos + i) & rbuf->len_mask];
+		VALGRIND_ANNOTATE_HAPPENS_AFTER(&slot->seq);
+		data[i] = slot->data;
+		util_atomic_store_explicit64(&slot->seq, pos + i + rbuf->len,
+			memory_order_release);
+	}
+
+	ringbuf_notify(&rbuf->producers_padded.producers, k);
+
+	return k;
+}
+
+/*
+ * ringbuf_wait -- (internal) blocks until the event of the wait queue
+ * changes, unless the attempt succeeds after registering as a waiter.
+ * Returns the result of the attempt, or -1 with errno set to ETIMEDOUT
+ * if the time ran out.
+ */
+static int
+ringbuf_wait(struct ringbuf *rbuf, struct ringbuf_waitq *waitq,
+	int (*attempt)(struct ringbuf *rbuf, void *arg), void *arg,
+	const struct timespec *abstime)
+{
+	util_fetch_and_add32(&waitq->nwaiters, 1);
+
+	uint32_t event;
+	util_atomic_load_explicit32(&waitq->event, &event,
+		memory_order_acquire);
+
+	/* the buffer could have changed before the waiter was registered */
+	int ret = attempt(rbuf, arg);
+	if (ret == 0 && ringbuf_running(rbuf))
+		ret = util_futex_wait(&waitq->event, event, abstime);
+
+	util_fetch_and_sub32(&waitq->nwaiters, 1);
+
+	return ret;
+}
+
+struct ringbuf_bulk {
+	void *const *data;
+	unsigned n;
+	unsigned done; /* number of elements already enqueued */
+};
+
+/*
+ * ringbuf_enqueue_attempt -- (internal) enqueues as many of the remaining
+ * values as fit, returns 1 if all of them were enqueued
+ */
+static int
+ringbuf_enqueue_attempt(struct ringbuf *rbuf, void *arg)
+{
+	struct ringbuf_bulk *bulk = arg;
+	bulk->done += ringbuf_tryenqueue_atomic(rbuf, bulk->data + bulk->done,
+		bulk->n - bulk->done);
+
+	return bulk->done == bulk->n;
+}
+
+/*
+ * ringbuf_dequeue_attempt -- (internal) returns 1 if a value was dequeued,
+ * it's stored in arg
+ */
+static int
+ringbuf_dequeue_attempt(struct ringbuf *rbuf, void *arg)
+{
+	return ringbuf_trydequeue_atomic(rbuf, arg, 1) == 1;
+}
+
+/*
+ * ringbuf_enqueue_n -- places n new values into the collection, the values
+ * which fit into the buffer at once take consecutive slots
+ *
+ * This function blocks until there's space for all of the values.
+ */
+int
+ringbuf_enqueue_n(struct ringbuf *rbuf, void *const *data, unsigned n)
+{
+	LOG(4, NULL);
+
+	ASSERT(ringbuf_running(rbuf));
+
+	struct ringbuf_waitq *producers = &rbuf->producers_padded.producers;
+	struct ringbuf_bulk bulk = {data, n, 0};
+	while (!ringbuf_enqueue_attempt(rbuf, &bulk)) {
+		if (ringbuf_wait(rbuf, producers, ringbuf_enqueue_attempt,
+				&bulk, NULL) == 1)
+			break;
+	}
+
+	return 0;
 }
 
 #if 1
@@ -176,13 +405,7 @@ ringbuf_enqueue(struct ringbuf *rbuf, void *data)
 {
 	LOG(4, NULL);
 
-	util_semaphore_wait(&rbuf->nfree_padded.nfree);
-
-	ringbuf_enqueue_atomic(rbuf, data);
-
-	util_semaphore_post(&rbuf->nused_padded.nused);
-
-	return 0;
+	return ringbuf_enqueue_n(rbuf, &data, 1);
 }
 #endif
 
@@ -196,41 +419,61 @@ ringbuf_tryenqueue(struct ringbuf *rbuf, void *data)
 {
 	LOG(4, NULL);
 
-	if (util_semaphore_trywait(&rbuf->nfree_padded.nfree) != 0)
-		return -1;
-
-	ringbuf_enqueue_atomic(rbuf, data);
-
-	util_semaphore_post(&rbuf->nused_padded.nused);
+	ASSERT(ringbuf_running(rbuf));
 
-	return 0;
+	return ringbuf_tryenqueue_atomic(rbuf, &data, 1) == 1 ? 0 : -1;
 }
 
 /*
- * ringbuf_dequeue_atomic -- performs a lockfree retrieval of data from ringbuf
+ * ringbuf_tryenqueue_n -- places up to n new values into consecutive slots
+ * of the collection, reserving all of them with a single atomic operation
+ *
+ * This function returns the number of values placed in the buffer, these
+ * are the first ones of the array, 0 if there's no space in the buffer.
  */
-static void *
-ringbuf_dequeue_atomic(struct ringbuf *rbuf)
+unsigned
+ringbuf_tryenqueue_n(struct ringbuf *rbuf, void *const *data, unsigned n)
 {
 	LOG(4, NULL);
 
-	size_t r = util_fetch_and_add64(&rbuf->read_pos_padded.read_pos, 1)
-		& rbuf->len_mask;
-	/*
-	 * Again, in most cases, there won't be even a single loop, but if one
-	 * thread stalls while others perform work, it might happen that two
-	 * threads get the same read position.
-	 */
-	void *data = NULL;
+	ASSERT(ringbuf_running(rbuf));
 
-	VALGRIND_ANNOTATE_HAPPENS_AFTER(&rbuf->data[r]);
-	do {
-		do {
-			util_atomic_load64(&rbuf->data[r], &data);
-		} while (data == NULL);
-	} while (!util_bool_compare_and_swap64(&rbuf->data[r], data, NULL));
+	return ringbuf_tryenqueue_atomic(rbuf, data, n);
+}
 
-	return data;
+/*
+ * ringbuf_dequeue_wait -- (internal) retrieves one value from the collection,
+ * blocks if there are no values in the buffer, but no longer than until
+ * abstime unless it's NULL
+ */
+static void *
+ringbuf_dequeue_wait(struct ringbuf *rbuf, const struct timespec *abstime)
+{
+	struct ringbuf_waitq *consumers = &rbuf->consumers_padded.consumers;
+	void *data;
+
+	for (;;) {
+		if (!ringbuf_running(rbuf)) {
+			errno = 0;
+			return NULL;
+		}
+
+		if (ringbuf_trydequeue_atomic(rbuf, &data, 1) == 1)
+			return data;
+
+		int ret = ringbuf_wait(rbuf, consumers,
+			ringbuf_dequeue_attempt, &data, abstime);
+		if (ret == 1)
+			return data;
+
+		if (ret < 0) {
+			/* a wake-up could have been meant for this thread */
+			if (ringbuf_trydequeue_atomic(rbuf, &data, 1) == 1)
+				return data;
+			errno = ETIMEDOUT;
+			return NULL;
+		}
+	}
 }
 
 #if 1
@@ -244,18 +487,24 @@ ringbuf_dequeue(struct ringbuf *rbuf)
 {
 	LOG(4, NULL);
 
-	util_semaphore_wait(&rbuf->nused_padded.nused);
-
-	if (!rbuf->running)
-		return NULL;
-
-	void *data = ringbuf_dequeue_atomic(rbuf);
+	return ringbuf_dequeue_wait(rbuf, NULL);
+}
+#endif
 
-	util_semaphore_post(&rbuf->nfree_padded.nfree);
+/*
+ * ringbuf_dequeue_timed -- retrieves one value from the collection
+ *
+ * This function blocks if there are no values in the buffer, but no longer
+ * than until abstime. If the time runs out, it returns NULL with errno set
+ * to ETIMEDOUT.
+ */
+void *
+ringbuf_dequeue_timed(struct ringbuf *rbuf, const struct timespec *abstime)
+{
+	LOG(4, NULL);
 
-	return data;
+	return ringbuf_dequeue_wait(rbuf, abstime);
 }
-#endif
 
 /*
  * ringbuf_trydequeue -- retrieves one value from the collection
@@ -267,17 +516,32 @@ ringbuf_trydequeue(struct ringbuf *rbuf)
 {
 	LOG(4, NULL);
 
-	if (util_semaphore_trywait(&rbuf->nused_padded.nused) != 0)
+	if (!ringbuf_running(rbuf))
 		return NULL;
 
-	if (!rbuf->running)
+	void *data;
+	if (ringbuf_trydequeue_atomic(rbuf, &data, 1) == 0)
 		return NULL;
 
-	void *data = ringbuf_dequeue_atomic(rbuf);
+	return data;
+}
+
+/*
+ * ringbuf_trydequeue_n -- retrieves up to n values from consecutive slots
+ * of the collection, claiming all of them with a single atomic operation
+ *
+ * This function returns the number of values stored in data, 0 if there are
+ * no values in the buffer.
+ */
+unsigned
+ringbuf_trydequeue_n(struct ringbuf *rbuf, void **data, unsigned n)
+{
+	LOG(4, NULL);
 
-	util_semaphore_post(&rbuf->nfree_padded.nfree);
+	if (!ringbuf_running(rbuf))
+		return 0;
 
-	return data;
+	return ringbuf_trydequeue_atomic(rbuf, data, n);
 }
 
 /*
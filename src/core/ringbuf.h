@@ -10,6 +10,7 @@
 
 #include "stddef.h"
 #include "stdint.h"
+#include "time.h"
 
 #ifdef _WIN32
 #include "windows/include/unistd.h"
@@ -22,12 +23,19 @@ struct ringbuf;
 struct ringbuf *ringbuf_new(unsigned length);
 void ringbuf_delete(struct ringbuf *rbuf);
 unsigned ringbuf_length(struct ringbuf *rbuf);
+unsigned ringbuf_count(struct ringbuf *rbuf);
 void ringbuf_stop(struct ringbuf *rbuf);
 
 int ringbuf_enqueue(struct ringbuf *rbuf, void *data);
 int ringbuf_tryenqueue(struct ringbuf *rbuf, void *data);
+int ringbuf_enqueue_n(struct ringbuf *rbuf, void *const *data, unsigned n);
+unsigned ringbuf_tryenqueue_n(struct ringbuf *rbuf, void *const *data,
+	unsigned n);
 void *ringbuf_dequeue(struct ringbuf *rbuf);
 void *ringbuf_trydequeue(struct ringbuf *rbuf);
+unsigned ringbuf_trydequeue_n(struct ringbuf *rbuf, void **data, unsigned n);
+void *ringbuf_dequeue_timed(struct ringbuf *rbuf,
+	const struct timespec *abstime);
 void *ringbuf_dequeue_s(struct ringbuf *rbuf, size_t data_size);
 void *ringbuf_trydequeue_s(struct ringbuf *rbuf, size_t data_size);
 
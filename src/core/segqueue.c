@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * segqueue.c -- implementation of an unbounded fifo queue made of a linked
+ * list of fixed size segments, which are allocated as the queue grows and
+ * freed as soon as they are drained. The number of segments is capped,
+ * so the memory used by the queue stays within a budget.
+ *
+ * It's meant for the slow path, when a lock-free ring buffer is full,
+ * so a single lock protects the whole queue. Pushers and poppers are
+ * serialized on it, values are moved in bulk to take it less often.
+ * The number of values is kept separately, so that checking for emptiness
+ * doesn't take the lock.
+ */
+
+#include <stdlib.h>
+
+#include "segqueue.h"
+#include "os_thread.h"
+#include "out.h"
+#include "sys_util.h"
+#include "util.h"
+
+struct segqueue_segment {
+	struct segqueue_segment *next;
+	size_t head; /* index of the next value to pop */
+	size_t tail; /* index of the next value to push */
+	void *data[];
+};
+
+struct segqueue {
+	os_mutex_t lock;
+	struct segqueue_segment *first; /* values are popped from here */
+	struct segqueue_segment *last; /* and pushed here */
+	size_t segment_len;
+	size_t max_segments;
+	size_t nsegments;
+	uint64_t count;
+};
+
+/*
+ * segqueue_new -- creates a new queue, with segments of segment_len values,
+ * no more than max_segments of them at once
+ */
+struct segqueue *
+segqueue_new(size_t segment_len, size_t max_segments)
+{
+	LOG(4, NULL);
+
+	if (segment_len == 0 || max_segments == 0)
+		return NULL;
+
+	struct segqueue *q = malloc(sizeof(*q));
+	if (q == NULL)
+		return NULL;
+
+	if (os_mutex_init(&q->lock) != 0) {
+		free(q);
+		return NULL;
+	}
+
+	q->first = NULL;
+	q->last = NULL;
+	q->segment_len = segment_len;
+	q->max_segments = max_segments;
+	q->nsegments = 0;
+	q->count = 0;
+
+	return q;
+}
+
+/*
+ * segqueue_delete -- destroys the queue along with its remaining segments
+ */
+void
+segqueue_delete(struct segqueue *q)
+{
+	LOG(4, NULL);
+
+	while (q->first != NULL) {
+		struct segqueue_segment *next = q->first->next;
+		free(q->first);
+		q->first = next;
+	}
+
+	util_mutex_destroy(&q->lock);
+	free(q);
+}
+
+/*
+ * segqueue_count -- returns the number of values in the queue, it can be
+ * out of date by the time the caller looks at it
+ */
+size_t
+segqueue_count(struct segqueue *q)
+{
+	uint64_t count;
+	util_atomic_load_explicit64(&q->count, &count, memory_order_acquire);
+
+	return (size_t)count;
+}
+
+/*
+ * segqueue_nsegments -- returns the number of allocated segments
+ */
+size_t
+segqueue_nsegments(struct segqueue *q)
+{
+	util_mutex_lock(&q->lock);
+	size_t nsegments = q->nsegments;
+	util_mutex_unlock(&q->lock);
+
+	return nsegments;
+}
+
+/*
+ * segqueue_push_n -- appends up to n values to the queue with the lock taken
+ * once, returns the number of values appended, which is smaller than n if
+ * a new segment would exceed the budget of the queue or couldn't be allocated
+ */
+size_t
+segqueue_push_n(struct segqueue *q, void *const *data, size_t n)
+{
+	LOG(4, NULL);
+
+	size_t pushed = 0;
+	util_mutex_lock(&q->lock);
+
+	while (pushed < n) {
+		struct segqueue_segment *seg = q->last;
+		if (seg == NULL || seg->tail == q->segment_len) {
+			if (q->nsegments == q->max_segments)
+				break;
+
+			seg = malloc(sizeof(*seg) +
+				q->segment_len * sizeof(void *));
+			if (seg == NULL)
+				break;
+			seg->next = NULL;
+			seg->head = 0;
+			seg->tail = 0;
+
+			if (q->last != NULL)
+				q->last->next = seg;
+			else
+				q->first = seg;
+			q->last = seg;
+			q->nsegments++;
+		}
+
+		size_t len = MIN(n - pushed, q->segment_len - seg->tail);
+		for (size_t i = 0; i < len; ++i)
+			seg->data[seg->tail++] = data[pushed++];
+		util_fetch_and_add64(&q->count, len);
+	}
+
+	util_mutex_unlock(&q->lock);
+
+	return pushed;
+}
+
+/*
+ * segqueue_push -- appends a value to the queue, fails if it would take
+ * a new segment and the queue has already used up its budget, or if
+ * the segment couldn't be allocated
+ */
+int
+segqueue_push(struct segqueue *q, void *data)
+{
+	return segqueue_push_n(q, &data, 1) == 1 ? 0 : -1;
+}
+
+/*
+ * segqueue_pop_n -- removes up to n oldest values from the queue with
+ * the lock taken once, returns the number of values stored in data, 0 if
+ * the queue is empty, drained segments are freed right away
+ */
+size_t
+segqueue_pop_n(struct segqueue *q, void **data, size_t n)
+{
+	LOG(4, NULL);
+
+	/* don't bother with the lock when there's nothing to take */
+	if (segqueue_count(q) == 0)
+		return 0;
+
+	size_t popped = 0;
+	util_mutex_lock(&q->lock);
+
+	struct segqueue_segment *seg;
+	while (popped < n && (seg = q->first) != NULL &&
+			seg->head != seg->tail) {
+		size_t len = MIN(n - popped, seg->tail - seg->head);
+		for (size_t i = 0; i < len; ++i)
+			data[popped++] = seg->data[seg->head++];
+		util_fetch_and_sub64(&q->count, len);
+
+		/* the queue doesn't hold on to any memory once it's empty */
+		if (seg->head == seg->tail) {
+			q->first = seg->next;
+			if (q->first == NULL)
+				q->last = NULL;
+			q->nsegments--;
+			free(seg);
+		}
+	}
+
+	util_mutex_unlock(&q->lock);
+
+	return popped;
+}
+
+/*
+ * segqueue_pop -- removes the oldest value from the queue, returns NULL if
+ * the queue is empty
+ */
+void *
+segqueue_pop(struct segqueue *q)
+{
+	void *data;
+
+	return segqueue_pop_n(q, &data, 1) == 1 ? data : NULL;
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * segqueue.h -- internal definitions for the segmented fifo queue
+ */
+
+#ifndef SEGQUEUE_H
+#define SEGQUEUE_H 1
+
+#include <stddef.h>
+
+struct segqueue;
+
+struct segqueue *segqueue_new(size_t segment_len, size_t max_segments);
+void segqueue_delete(struct segqueue *q);
+size_t segqueue_count(struct segqueue *q);
+size_t segqueue_nsegments(struct segqueue *q);
+
+int segqueue_push(struct segqueue *q, void *data);
+size_t segqueue_push_n(struct segqueue *q, void *const *data, size_t n);
+void *segqueue_pop(struct segqueue *q);
+size_t segqueue_pop_n(struct segqueue *q, void **data, size_t n);
+
+#endif
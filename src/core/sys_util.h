@@ -284,6 +284,67 @@ util_semaphore_trywait(os_semaphore_t *sem)
 	return ret;
 }
 
+/*
+ * util_semaphore_timedwait -- decreases the value of the semaphore, waits no
+ * longer than until abstime
+ */
+static inline int
+util_semaphore_timedwait(os_semaphore_t *sem, const struct timespec *abstime)
+{
+	errno = 0;
+	int ret;
+	do {
+		ret = os_semaphore_timedwait(sem, abstime);
+	} while (ret != 0 && errno == EINTR); /* signal interrupt */
+
+	if (ret != 0 && errno != ETIMEDOUT)
+		FATAL("!os_semaphore_timedwait");
+
+	return ret;
+}
+
+/*
+ * util_futex_wait -- blocks while the value at addr equals expected, but no
+ * longer than until abstime unless it's NULL. Returns -1 with errno set to
+ * ETIMEDOUT if the time ran out, 0 otherwise, also when the wait was
+ * interrupted, so the caller has to check the value again.
+ */
+static inline int
+util_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *abstime)
+{
+	if (os_futex_wait(addr, expected, abstime) == 0)
+		return 0;
+
+	if (errno == EINTR)
+		return 0;
+
+	if (errno != ETIMEDOUT)
+		FATAL("!os_futex_wait");
+
+	return -1;
+}
+
+/*
+ * util_futex_wake_one -- wakes up one of the threads waiting on addr
+ */
+static inline void
+util_futex_wake_one(uint32_t *addr)
+{
+	if (os_futex_wake_one(addr) != 0)
+		FATAL("!os_futex_wake_one");
+}
+
+/*
+ * util_futex_wake_all -- wakes up all the threads waiting on addr
+ */
+static inline void
+util_futex_wake_all(uint32_t *addr)
+{
+	if (os_futex_wake_all(addr) != 0)
+		FATAL("!os_futex_wake_all");
+}
+
 /*
  * util_semaphore_post -- increases the value of the semaphore
  */
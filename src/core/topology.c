@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * topology.c -- cpu topology of the machine, os independent part
+ */
+
+#include <stdlib.h>
+#include "topology.h"
+
+/*
+ * topology_rank -- (internal) assigns each cpu its physical core, the rank
+ * of the core in its package and the rank of the cpu among its siblings
+ */
+static void
+topology_rank(struct topology *topo)
+{
+	size_t ncores = 0;
+
+	for (size_t i = 0; i < topo->ncpus; ++i) {
+		struct topology_cpu *cpu = &topo->cpus[i];
+		cpu->sibling = 0;
+		cpu->core = ncores;
+		cpu->core_rank = 0;
+
+		/* look for an earlier cpu on the same core or package */
+		size_t package_cores = 0;
+		int sibling_found = 0;
+		for (size_t j = 0; j < i; ++j) {
+			struct topology_cpu *prev = &topo->cpus[j];
+			if (prev->package != cpu->package)
+				continue;
+
+			if (prev->core_id == cpu->core_id) {
+				cpu->core = prev->core;
+				cpu->core_rank = prev->core_rank;
+				cpu->sibling++;
+				sibling_found = 1;
+			} else if (prev->sibling == 0) {
+				package_cores++;
+			}
+		}
+
+		if (!sibling_found) {
+			cpu->core_rank = package_cores;
+			ncores++;
+		}
+	}
+}
+
+/*
+ * topology_new -- reads the topology of the cpus available to the process
+ */
+struct topology *
+topology_new(void)
+{
+	struct topology *topo = malloc(sizeof(struct topology));
+	if (topo == NULL)
+		return NULL;
+
+	topo->ncpus = 0;
+	topo->cpus = NULL;
+
+	if (topology_read_cpus(topo) != 0 || topo->ncpus == 0) {
+		topology_delete(topo);
+		return NULL;
+	}
+
+	topology_rank(topo);
+
+	return topo;
+}
+
+/*
+ * topology_delete -- deletes the topology
+ */
+void
+topology_delete(struct topology *topo)
+{
+	free(topo->cpus);
+	free(topo);
+}
+
+/*
+ * topology_find -- returns the cpu with the given logical number or NULL
+ * if the cpu is not available to the process
+ */
+struct topology_cpu *
+topology_find(struct topology *topo, size_t id)
+{
+	for (size_t i = 0; i < topo->ncpus; ++i) {
+		if (topo->cpus[i].id == id)
+			return &topo->cpus[i];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * topology.h -- cpu topology of the machine
+ */
+
+#ifndef MINIASYNC_TOPOLOGY_H
+#define MINIASYNC_TOPOLOGY_H 1
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct topology_cpu {
+	size_t id; /* logical cpu number, as used by os_cpu_set */
+	unsigned package; /* physical package (socket) of the cpu */
+	unsigned core_id; /* os identifier of the core within the package */
+	unsigned node; /* numa node of the cpu */
+
+	/* filled in by topology_new */
+	size_t core; /* index of the physical core, unique in the system */
+	size_t core_rank; /* index of the core within its package */
+	size_t sibling; /* index of the cpu among the SMT siblings */
+};
+
+struct topology {
+	size_t ncpus;
+	struct topology_cpu *cpus;
+};
+
+struct topology *topology_new(void);
+void topology_delete(struct topology *topo);
+struct topology_cpu *topology_find(struct topology *topo, size_t id);
+
+/* implemented by the os specific part */
+int topology_read_cpus(struct topology *topo);
+int topology_current_cpu(void);
+int topology_mem_node(const void *addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * topology_posix.c -- cpu topology of the machine (Posix implementation)
+ */
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+#include "topology.h"
+
+#ifdef __linux__
+#define TOPOLOGY_SYSFS_CPU_DIR "/sys/devices/system/cpu/cpu%zu"
+#define TOPOLOGY_SYSFS_CPU TOPOLOGY_SYSFS_CPU_DIR "/topology/%s"
+
+/*
+ * topology_read_value -- (internal) reads a single topology attribute
+ * of the cpu from sysfs
+ */
+static int
+topology_read_value(size_t cpu, const char *attr, unsigned *value)
+{
+	char path[128];
+	snprintf(path, sizeof(path), TOPOLOGY_SYSFS_CPU, cpu, attr);
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+
+	int ret = fscanf(f, "%u", value) == 1 ? 0 : -1;
+	fclose(f);
+
+	return ret;
+}
+
+/*
+ * topology_read_node -- (internal) reads the numa node of the cpu, which is
+ * linked from its sysfs directory as nodeN
+ */
+static int
+topology_read_node(size_t cpu, unsigned *node)
+{
+	char path[128];
+	snprintf(path, sizeof(path), TOPOLOGY_SYSFS_CPU_DIR, cpu);
+
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return -1;
+
+	int ret = -1;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "node", 4) == 0 &&
+				sscanf(entry->d_name + 4, "%u", node) == 1) {
+			ret = 0;
+			break;
+		}
+	}
+	closedir(dir);
+
+	return ret;
+}
+#endif
+
+/*
+ * topology_read_cpus -- reads the cpus the process is allowed to run on,
+ * cpus with unknown topology are treated as separate physical cores
+ */
+int
+topology_read_cpus(struct topology *topo)
+{
+	long nconf = sysconf(_SC_NPROCESSORS_CONF);
+	if (nconf <= 0)
+		return -1;
+
+	topo->cpus = malloc(sizeof(struct topology_cpu) * (size_t)nconf);
+	if (topo->cpus == NULL)
+		return -1;
+
+#ifdef __linux__
+	cpu_set_t allowed;
+	int allowed_known = sched_getaffinity(0, sizeof(allowed),
+		&allowed) == 0;
+#endif
+
+	for (size_t i = 0; i < (size_t)nconf; ++i) {
+		struct topology_cpu *cpu = &topo->cpus[topo->ncpus];
+		cpu->id = i;
+		cpu->package = 0;
+		cpu->core_id = (unsigned)i;
+		cpu->node = 0;
+
+#ifdef __linux__
+		if (i < CPU_SETSIZE && allowed_known && !CPU_ISSET(i, &allowed))
+			continue;
+
+		unsigned value;
+		if (topology_read_value(i, "physical_package_id",
+				&value) == 0)
+			cpu->package = value;
+		if (topology_read_value(i, "core_id", &value) == 0)
+			cpu->core_id = value;
+		if (topology_read_node(i, &value) == 0)
+			cpu->node = value;
+#endif
+
+		topo->ncpus++;
+	}
+
+	return 0;
+}
+
+/*
+ * topology_current_cpu -- returns the cpu the calling thread runs on or -1
+ * if it cannot be determined
+ */
+int
+topology_current_cpu(void)
+{
+#ifdef __linux__
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
+/*
+ * topology_mem_node -- returns the numa node of the page containing addr
+ * or -1 if the page is not present or the node cannot be determined
+ */
+int
+topology_mem_node(const void *addr)
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+	/* move_pages without target nodes only reports the current ones */
+	const void *page = addr;
+	int status;
+	if (syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0) != 0)
+		return -1;
+
+	return status < 0 ? -1 : status;
+#else
+	(void) addr;
+	return -1;
+#endif
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * topology_windows.c -- cpu topology of the machine (Windows implementation)
+ */
+
+#include <windows.h>
+#include <psapi.h>
+#include <stdlib.h>
+#include "topology.h"
+
+/*
+ * topology_group_base -- (internal) returns the logical number of the first
+ * cpu in the processor group, numbered in the same way as in os_cpu_set
+ */
+static size_t
+topology_group_base(WORD group)
+{
+	size_t base = 0;
+	for (WORD g = 0; g < group; ++g)
+		base += GetActiveProcessorCount(g);
+
+	return base;
+}
+
+/*
+ * topology_read_cpus -- reads the cpus and the physical cores they belong to
+ */
+int
+topology_read_cpus(struct topology *topo)
+{
+	DWORD ncpus = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	DWORD len = 0;
+
+	topo->cpus = malloc(sizeof(struct topology_cpu) * ncpus);
+	if (topo->cpus == NULL)
+		return -1;
+
+	GetLogicalProcessorInformationEx(RelationProcessorCore, NULL, &len);
+	char *buf = malloc(len);
+	if (buf == NULL)
+		return -1;
+
+	if (!GetLogicalProcessorInformationEx(RelationProcessorCore,
+			(PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buf, &len)) {
+		free(buf);
+		return -1;
+	}
+
+	/* packages are not distinguished, each core gets its own id */
+	unsigned core_id = 0;
+	for (DWORD off = 0; off < len; ) {
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info =
+			(PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buf + off);
+		GROUP_AFFINITY *aff = &info->Processor.GroupMask[0];
+		size_t base = topology_group_base(aff->Group);
+
+		for (size_t bit = 0; bit < sizeof(KAFFINITY) * 8; ++bit) {
+			if ((aff->Mask & ((KAFFINITY)1 << bit)) == 0 ||
+					topo->ncpus == ncpus)
+				continue;
+
+			struct topology_cpu *cpu = &topo->cpus[topo->ncpus++];
+			cpu->id = base + bit;
+			cpu->package = 0;
+			cpu->core_id = core_id;
+			cpu->node = 0;
+
+			PROCESSOR_NUMBER number = {aff->Group, (BYTE)bit, 0};
+			USHORT node;
+			if (GetNumaProcessorNodeEx(&number, &node))
+				cpu->node = node;
+		}
+
+		core_id++;
+		off += info->Size;
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+/*
+ * topology_current_cpu -- returns the cpu the calling thread runs on
+ */
+int
+topology_current_cpu(void)
+{
+	PROCESSOR_NUMBER number;
+	GetCurrentProcessorNumberEx(&number);
+
+	return (int)(topology_group_base(number.Group) + number.Number);
+}
+
+/*
+ * topology_mem_node -- returns the numa node of the page containing addr
+ * or -1 if the page is not present in the working set
+ */
+int
+topology_mem_node(const void *addr)
+{
+	PSAPI_WORKING_SET_EX_INFORMATION info;
+	info.VirtualAddress = (PVOID)addr;
+
+	if (!QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info)) ||
+			!info.VirtualAttributes.Valid)
+		return -1;
+
+	return (int)info.VirtualAttributes.Node;
+}
@@ -72,6 +72,12 @@ extern unsigned long long Mmap_align;
 #define ALIGN_UP(size, align) (((size) + (align) - 1) & ~((align) - 1))
 #define ALIGN_DOWN(size, align) ((size) & ~((align) - 1))
 
+#define CACHELINE_SIZE ((size_t)64)
+
+/* avoid false sharing by padding the variable to a whole cache line */
+#define CACHELINE_PADDING(type, name)\
+union { type name; uint64_t name##_padding[CACHELINE_SIZE / 8]; } name##_padded
+
 #define ADDR_SUM(vp, lp) ((void *)((char *)(vp) + (lp)))
 
 #define util_alignof(t) offsetof(struct {char _util_c; t _util_m; }, _util_m)
@@ -91,6 +97,8 @@ extern unsigned long long Mmap_align;
 	int util_tmpfile(const char *dir, const char *templ, int flags);
 	void *util_aligned_malloc(size_t alignment, size_t size);
 	void util_aligned_free(void *ptr);
+	void *util_huge_map(size_t alignment, size_t size, int hugetlb);
+	void util_huge_unmap(void *ptr, size_t size);
 	struct tm *util_localtime(const time_t *timep, struct tm *tm);
 	int util_safe_strcpy(char *dst, const char *src, size_t max_length);
 	void util_emit_log(const char *lib, const char *func, int order);
@@ -573,6 +581,7 @@ static
 
 #include <emmintrin.h>
 #define WAIT() _mm_pause()
+#define PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
 
 #else
 
@@ -582,6 +591,7 @@ static
  * and doesn't break the build.
  */
 #define WAIT() do {} while (0)
+#define PREFETCH(addr) do { (void)(addr); } while (0)
 
 #endif
 
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include "os.h"
@@ -144,6 +145,60 @@ util_aligned_free(void *ptr)
 	free(ptr);
 }
 
+/*
+ * util_huge_map -- map anonymous memory aligned to the given power of two,
+ * either backed by reserved huge pages of the size of the alignment or
+ * advised to be backed by transparent huge pages
+ */
+void *
+util_huge_map(size_t alignment, size_t size, int hugetlb)
+{
+	if (hugetlb) {
+#ifdef MAP_HUGETLB
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+		flags |= (int)util_mssb_index64(alignment) << MAP_HUGE_SHIFT;
+#endif
+		/* huge pages are aligned to their size */
+		void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags,
+			-1, 0);
+
+		return addr == MAP_FAILED ? NULL : addr;
+#else
+		errno = ENOTSUP;
+		return NULL;
+#endif
+	}
+
+	/* map more than needed and trim the unaligned head and the tail */
+	size_t len = size + alignment;
+	char *addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	char *aligned = (char *)ALIGN_UP((uintptr_t)addr, alignment);
+	if (aligned != addr)
+		munmap(addr, (size_t)(aligned - addr));
+	munmap(aligned + size, (size_t)(addr + len - (aligned + size)));
+
+#ifdef MADV_HUGEPAGE
+	/* it's only advice, transparent huge pages might be disabled */
+	(void) madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+	return aligned;
+}
+
+/*
+ * util_huge_unmap -- unmap memory mapped in util_huge_map
+ */
+void
+util_huge_unmap(void *ptr, size_t size)
+{
+	munmap(ptr, size);
+}
+
 /*
  * util_getexecname -- return name of current executable
  */
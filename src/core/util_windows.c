@@ -177,6 +177,48 @@ util_aligned_free(void *ptr)
 	_aligned_free(ptr);
 }
 
+/*
+ * util_huge_map -- allocate memory backed by large pages, aligned to the given
+ * power of two, there are no transparent huge pages on Windows
+ *
+ * Large pages are available only to users with the "Lock pages in memory"
+ * privilege.
+ */
+void *
+util_huge_map(size_t alignment, size_t size, int hugetlb)
+{
+	SIZE_T page = GetLargePageMinimum();
+	if (!hugetlb || page == 0) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	void *addr = VirtualAlloc(NULL, ALIGN_UP(size, page),
+		MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (addr == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ((uintptr_t)addr % alignment != 0) {
+		VirtualFree(addr, 0, MEM_RELEASE);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return addr;
+}
+
+/*
+ * util_huge_unmap -- free memory allocated in util_huge_map
+ */
+void
+util_huge_unmap(void *ptr, size_t size)
+{
+	SUPPRESS_UNUSED(size);
+	VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
 /*
  * util_toUTF8 -- allocating conversion from wide char string to UTF8
  */
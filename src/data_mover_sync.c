@@ -8,19 +8,37 @@
 #endif
 
 #include "libminiasync/vdm.h"
+#include "core/flush.h"
 #include "core/membuf.h"
+#include "core/memops.h"
 #include "core/out.h"
 
-#define SUPPORTED_FLAGS 0
+#if FLUSH_DURABLE
+#define DURABLE_FLAGS VDM_F_MEM_DURABLE
+#else
+#define DURABLE_FLAGS 0
+#endif
+
+#if MEMOPS_NT
+#define NT_FLAGS VDM_F_NO_CACHE_HINT
+#else
+#define NT_FLAGS 0
+#endif
+
+/* operations never wait behind others, they're executed once started */
+#define SUPPORTED_FLAGS (DURABLE_FLAGS | NT_FLAGS | VDM_F_PRIORITY)
 
 struct data_mover_sync {
 	struct vdm base; /* must be first */
 
 	struct membuf *membuf;
+	size_t nt_threshold; /* larger operations bypass the caches */
 };
 
 struct data_mover_sync_data {
 	int complete;
+	int owned; /* allocated by the mover, not provided by the caller */
+	size_t nt_threshold; /* of the mover when the operation was created */
 };
 
 /*
@@ -41,21 +59,37 @@ sync_operation_check(void *data, const struct vdm_operation *operation)
 	return complete ? FUTURE_STATE_COMPLETE : FUTURE_STATE_IDLE;
 }
 
+/*
+ * sync_operation_init -- initializes the state of a new sync operation in
+ * the memory provided by the caller
+ */
+static void
+sync_operation_init(struct vdm *vdm, const enum vdm_operation_type type,
+	void *state)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_sync *dms = (struct data_mover_sync *)vdm;
+	struct data_mover_sync_data *sync_data = state;
+	sync_data->complete = 0;
+	sync_data->owned = 0;
+	sync_data->nt_threshold = dms->nt_threshold;
+}
+
 /*
  * sync_operation_new -- creates a new sync operation
  */
 static void *
 sync_operation_new(struct vdm *vdm, const enum vdm_operation_type type)
 {
-	SUPPRESS_UNUSED(type);
-
 	struct data_mover_sync *vdm_sync = (struct data_mover_sync *)vdm;
 	struct data_mover_sync_data *sync_data = membuf_alloc(vdm_sync->membuf,
 		sizeof(struct data_mover_sync_data));
 	if (sync_data == NULL)
 		return NULL;
 
-	sync_data->complete = 0;
+	sync_operation_init(vdm, type, sync_data);
+	sync_data->owned = 1;
 
 	return sync_data;
 }
@@ -85,11 +119,28 @@ sync_operation_delete(void *data, const struct vdm_operation *operation,
 			output->output.memset.str =
 				operation->data.memset.str;
 			break;
+		case VDM_OPERATION_FLUSH:
+			output->type = VDM_OPERATION_FLUSH;
+			output->output.flush.unused = 0;
+			break;
 		default:
 			ASSERT(0);
 	}
 
-	membuf_free(data);
+	struct data_mover_sync_data *sync_data = data;
+	if (sync_data->owned)
+		membuf_free(data);
+}
+
+/*
+ * sync_operation_nt -- returns whether the operation should bypass the caches
+ */
+static int
+sync_operation_nt(struct data_mover_sync_data *sync_data, uint64_t flags,
+	size_t n)
+{
+	return (flags & VDM_F_NO_CACHE_HINT) ||
+		(sync_data->nt_threshold != 0 && n >= sync_data->nt_threshold);
 }
 
 /*
@@ -107,24 +158,54 @@ sync_operation_start(void *data, const struct vdm_operation *operation,
 
 	switch (operation->type) {
 		case VDM_OPERATION_MEMCPY:
-			memcpy(operation->data.memcpy.dest,
-				operation->data.memcpy.src,
-				operation->data.memcpy.n);
+			if (sync_operation_nt(sync_data,
+					operation->data.memcpy.flags,
+					operation->data.memcpy.n))
+				memops_memcpy_nt(operation->data.memcpy.dest,
+					operation->data.memcpy.src,
+					operation->data.memcpy.n);
+			else
+				memcpy(operation->data.memcpy.dest,
+					operation->data.memcpy.src,
+					operation->data.memcpy.n);
+			if (operation->data.memcpy.flags & VDM_F_MEM_DURABLE)
+				flush_range(operation->data.memcpy.dest,
+					operation->data.memcpy.n);
 			break;
 		case VDM_OPERATION_MEMMOVE:
-			memmove(operation->data.memcpy.dest,
-				operation->data.memcpy.src,
-				operation->data.memcpy.n);
+			if (sync_operation_nt(sync_data,
+					operation->data.memmove.flags,
+					operation->data.memmove.n))
+				memops_memmove_nt(operation->data.memmove.dest,
+					operation->data.memmove.src,
+					operation->data.memmove.n);
+			else
+				memmove(operation->data.memmove.dest,
+					operation->data.memmove.src,
+					operation->data.memmove.n);
+			if (operation->data.memmove.flags & VDM_F_MEM_DURABLE)
+				flush_range(operation->data.memmove.dest,
+					operation->data.memmove.n);
 			break;
 		case VDM_OPERATION_MEMSET:
-			memset(operation->data.memset.str,
-				operation->data.memset.c,
-				operation->data.memset.n);
+			if (sync_operation_nt(sync_data,
+					operation->data.memset.flags,
+					operation->data.memset.n))
+				memops_memset_nt(operation->data.memset.str,
+					operation->data.memset.c,
+					operation->data.memset.n);
+			else
+				memset(operation->data.memset.str,
+					operation->data.memset.c,
+					operation->data.memset.n);
+			if (operation->data.memset.flags & VDM_F_MEM_DURABLE)
+				flush_range(operation->data.memset.str,
+					operation->data.memset.n);
 			break;
 		case VDM_OPERATION_FLUSH:
-			printf("flush operation not implemented "
-						"for sync data mover");
-			exit(1);
+			flush_range(operation->data.flush.dest,
+				operation->data.flush.n);
+			break;
 		default:
 			ASSERT(0);
 	}
@@ -142,6 +223,8 @@ static struct vdm data_mover_sync_vdm = {
 	.op_start = sync_operation_start,
 	.capabilities = SUPPORTED_FLAGS,
 	.has_property = NULL,
+	.op_state_size = sizeof(struct data_mover_sync_data),
+	.op_init = sync_operation_init,
 };
 
 /*
@@ -155,7 +238,8 @@ data_mover_sync_new(void)
 		return NULL;
 
 	dms->base = data_mover_sync_vdm;
-	dms->membuf = membuf_new(dms);
+	dms->nt_threshold = memops_nt_threshold();
+	dms->membuf = membuf_new_ext(dms, MEMBUF_MODE_SLAB);
 	if (dms->membuf == NULL)
 		goto membuf_failed;
 
@@ -166,6 +250,19 @@ membuf_failed:
 	return NULL;
 }
 
+/*
+ * data_mover_sync_set_nt_threshold -- sets the size from which memcpy,
+ * memmove and memset operations are executed as if they had
+ * the VDM_F_NO_CACHE_HINT flag. Setting this to 0 disables it, only the flag
+ * is honored then.
+ */
+void
+data_mover_sync_set_nt_threshold(struct data_mover_sync *dms,
+	size_t nt_threshold)
+{
+	dms->nt_threshold = nt_threshold;
+}
+
 /*
  * data_mover_sync_get_vdm -- returns the vdm operations for the sync mover
  */
@@ -6,19 +6,56 @@
 #pragma warning(disable : 4127)
 #endif
 
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include "core/flush.h"
 #include "core/membuf.h"
+#include "core/memops.h"
+#include "core/os.h"
 #include "core/out.h"
 #include "libminiasync/data_mover_threads.h"
 #include "core/util.h"
 #include "core/os_thread.h"
 #include "core/ringbuf.h"
+#include "core/segqueue.h"
+#include "core/sys_util.h"
+#include "core/topology.h"
 
 #define DATA_MOVER_THREADS_DEFAULT_NTHREADS 12
 #define DATA_MOVER_THREADS_DEFAULT_RINGBUF_SIZE 128
+#define DATA_MOVER_THREADS_DEFAULT_CHUNK_SIZE (1 << 20) /* 1MB */
+#define DATA_MOVER_THREADS_MIN_CHUNK_SIZE ((size_t)64)
+#define DATA_MOVER_THREADS_DEFAULT_SPIN_COUNT 4096
+#define DATA_MOVER_THREADS_DEFAULT_GROW_THRESHOLD 4
+#define DATA_MOVER_THREADS_DEFAULT_IDLE_TIMEOUT 1000 /* ms */
+#define DATA_MOVER_THREADS_DEFAULT_GROW_DELAY 1 /* ms */
+/* the most queue entries taken or placed with a single atomic operation */
+#define DATA_MOVER_THREADS_BULK_SIZE 8
+/* priority entries a worker takes in a row while normal ones are waiting */
+#define DATA_MOVER_THREADS_DEFAULT_PRIORITY_QUOTA 16
+/* 2MB buffers of operation data of a single submitting thread */
+#define DATA_MOVER_THREADS_DEFAULT_MAX_BUFFERS 16
 
-#define SUPPORTED_FLAGS 0
+/* numa nodes of destination memory are cached per 2MB range */
+#define DATA_MOVER_THREADS_NODE_RANGE_SHIFT 21
+#define DATA_MOVER_THREADS_NODE_CACHE_SIZE 256
+#define DATA_MOVER_THREADS_NODE_UNKNOWN UINT_MAX
+
+#if FLUSH_DURABLE
+#define DURABLE_FLAGS VDM_F_MEM_DURABLE
+#else
+#define DURABLE_FLAGS 0
+#endif
+
+#if MEMOPS_NT
+#define NT_FLAGS VDM_F_NO_CACHE_HINT
+#else
+#define NT_FLAGS 0
+#endif
+
+#define SUPPORTED_FLAGS (DURABLE_FLAGS | NT_FLAGS | VDM_F_PRIORITY)
 
 struct data_mover_threads_op_fns {
 	memcpy_fn op_memcpy;
@@ -26,30 +63,189 @@ struct data_mover_threads_op_fns {
 	memset_fn op_memset;
 };
 
+struct data_mover_threads_config {
+	size_t nthreads; /* minimum number of worker threads */
+	size_t max_nthreads; /* number of available cpus if 0 */
+	size_t ringbuf_size;
+	enum future_notifier_type desired_notifier;
+	enum data_mover_threads_scheduling scheduling;
+	enum data_mover_threads_placement placement;
+	enum data_mover_threads_affinity affinity;
+	size_t *cpus; /* cpus available to the workers, all if NULL */
+	size_t ncpus;
+	int numa_aware;
+	enum data_mover_threads_wait_policy wait_policy;
+	uint64_t spin_count;
+	size_t grow_threshold;
+	uint64_t grow_delay;
+	uint64_t idle_timeout;
+	size_t overflow_size; /* memory budget of the overflow queue */
+	enum data_mover_threads_pages pages; /* backing of operation data */
+	int prefault;
+	size_t max_buffers; /* per submitting thread */
+};
+
+static const struct data_mover_threads_config config_default = {
+	.nthreads = DATA_MOVER_THREADS_DEFAULT_NTHREADS,
+	/* a fixed pool, elastic only if a range is set */
+	.max_nthreads = DATA_MOVER_THREADS_DEFAULT_NTHREADS,
+	.ringbuf_size = DATA_MOVER_THREADS_DEFAULT_RINGBUF_SIZE,
+	.desired_notifier = FUTURE_NOTIFIER_WAKER,
+	.scheduling = DATA_MOVER_THREADS_SCHEDULING_SHARED,
+	.placement = DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN,
+	.affinity = DATA_MOVER_THREADS_AFFINITY_NONE,
+	.cpus = NULL,
+	.ncpus = 0,
+	.numa_aware = 0,
+	.wait_policy = DATA_MOVER_THREADS_WAIT_BLOCK,
+	.spin_count = DATA_MOVER_THREADS_DEFAULT_SPIN_COUNT,
+	.grow_threshold = DATA_MOVER_THREADS_DEFAULT_GROW_THRESHOLD,
+	.grow_delay = DATA_MOVER_THREADS_DEFAULT_GROW_DELAY,
+	.idle_timeout = DATA_MOVER_THREADS_DEFAULT_IDLE_TIMEOUT,
+	.overflow_size = 0,
+	.pages = DATA_MOVER_THREADS_PAGES_DEFAULT,
+	.prefault = 0,
+	.max_buffers = DATA_MOVER_THREADS_DEFAULT_MAX_BUFFERS,
+};
+
+/*
+ * Workers are divided into groups, one per numa node when the mover is numa
+ * aware, or a single group otherwise. Each group owns a contiguous range
+ * of the queues.
+ */
+struct data_mover_threads_group {
+	unsigned node; /* numa node of the workers in the group */
+	size_t first_queue;
+	size_t nqueues;
+	size_t first_worker;
+	size_t nworkers;
+};
+
+enum data_mover_threads_worker_state {
+	DATA_MOVER_THREADS_WORKER_NONE, /* the thread isn't started */
+	DATA_MOVER_THREADS_WORKER_RUNNING,
+	DATA_MOVER_THREADS_WORKER_RETIRED, /* exited, has to be joined */
+};
+
+struct data_mover_threads_worker {
+	struct data_mover_threads *dmt;
+	enum data_mover_threads_worker_state state; /* protected by pool_lock */
+	size_t group; /* index of the group the worker belongs to */
+	size_t queue; /* index of the queue owned by the worker */
+	/* entries taken from the priority lane since the last normal one */
+	uint64_t priority_streak;
+	os_thread_t thread;
+	int pinned; /* whether the affinity of the worker is restricted */
+	os_cpu_set_t cpus; /* cpus the worker is allowed to run on */
+	/* written only by the worker, read by data_mover_threads_stats */
+	struct data_mover_threads_worker_stats stats;
+	/* set while the worker is about to block, cleared by its waker */
+	uint64_t parked;
+};
+
 struct data_mover_threads {
 	struct vdm base; /* must be first */
 
 	struct data_mover_threads_op_fns op_fns;
-	struct ringbuf *buf;
-	size_t nthreads;
-	os_thread_t *threads;
+	enum data_mover_threads_placement placement;
+	size_t nqueues;
+	struct ringbuf **queues; /* a single shared queue or one per worker */
+	/*
+	 * Operations which don't fit into the queues wait here, if enabled.
+	 * Once it's not empty, it takes the newly started operations too,
+	 * so that they don't overtake the ones already waiting.
+	 */
+	struct segqueue *overflow;
+	/*
+	 * Operations with the VDM_F_PRIORITY flag have a shared queue of
+	 * their own, which the workers drain before their normal queues.
+	 * After priority_quota entries in a row a worker takes a normal one,
+	 * so that bulk work isn't starved.
+	 */
+	struct ringbuf *priority_queue;
+	size_t priority_quota;
+	uint64_t next_queue; /* initial queue for newly seen submitters */
+	os_tls_key_t queue_key; /* queue cursor of the submitting thread */
+	size_t nthreads; /* maximum number of worker threads */
+	struct data_mover_threads_worker *workers;
+
+	/*
+	 * An elastic pool runs between min_nthreads and nthreads workers,
+	 * a new one is started when operations stay piled up in the queues
+	 * for grow_delay ms and a worker that was idle for idle_timeout ms
+	 * exits.
+	 */
+	int elastic;
+	size_t min_nthreads;
+	uint64_t nactive; /* number of running workers */
+	os_mutex_t pool_lock; /* serializes starting and retiring workers */
+	size_t grow_threshold; /* queue depth at which a worker is added */
+	uint64_t grow_delay_ns;
+	/* since when the depth is at the threshold, 0 if it's below it */
+	uint64_t over_since_ns;
+	uint64_t idle_timeout;
+	size_t ngroups;
+	struct data_mover_threads_group *groups;
+	/* numa node of each 2MB range of memory, indexed by a hash of it */
+	uint64_t node_cache[DATA_MOVER_THREADS_NODE_CACHE_SIZE];
 	struct membuf *membuf;
 	enum future_notifier_type desired_notifier;
+	size_t chunk_size; /* minimum size of a part of a split operation */
+	size_t inline_threshold; /* smaller operations run on the submitter */
+	size_t nt_threshold; /* larger operations bypass the caches */
+	enum data_mover_threads_wait_policy wait_policy;
+	uint64_t spin_count; /* polls of the queues before the worker parks */
+	uint64_t nparked; /* number of workers with the parked flag set */
+	uint64_t running; /* cleared once all the queues are stopped */
 };
 
 struct data_mover_threads_data {
+	/*
+	 * The words written when the operation executes are each on its own
+	 * cache line, the poller spinning on the completion doesn't slow down
+	 * the workers taking the parts and neighbouring operations in a slab
+	 * don't share them either.
+	 */
+	CACHELINE_PADDING(uint64_t, complete);
+
+	/*
+	 * Large operations are split into parts which are executed
+	 * concurrently by multiple worker threads. Each ringbuf entry holds
+	 * a reference to the operation and the worker that drops the last
+	 * reference completes the operation.
+	 */
+	CACHELINE_PADDING(uint64_t, next_part); /* index of the next part */
+	CACHELINE_PADDING(uint64_t, pending); /* references still held */
+
+	/* read-mostly fields, set up before the operation is queued */
+	struct data_mover_threads *dmt;
+	int owned; /* allocated by the mover, not provided by the caller */
 	enum future_notifier_type desired_notifier;
 	struct future_notifier notifier;
-	uint64_t complete;
 	uint64_t started;
+	uint64_t nparts; /* number of parts of the operation */
+	size_t part_size; /* size of a single part */
 
+	/*
+	 * Each part of a batch is one of its operations, which are never
+	 * split. Otherwise this is NULL and op is split into parts.
+	 */
+	const struct vdm_operation *ops;
 	struct vdm_operation op;
 };
 
+/* whole cache lines, so that operations in a slab don't share them */
+#define DATA_MOVER_THREADS_DATA_SIZE\
+	ALIGN_UP(sizeof(struct data_mover_threads_data), CACHELINE_SIZE)
+
 /*
- * Standard implementation of memcpy used if none was specified by the user.
+ * Standard implementation of memcpy used if none was specified by the user,
+ * it bypasses the caches if asked to.
  */
 void *std_memcpy(void *dst, const void *src, size_t n, unsigned flags) {
+	if (flags & VDM_F_NO_CACHE_HINT)
+		return memops_memcpy_nt(dst, src, n);
+
 	return memcpy(dst, src, n);
 }
 
@@ -59,9 +255,13 @@ void data_mover_threads_set_memcpy_fn(struct data_mover_threads *dmt,
 }
 
 /*
- * Standard implementation of memmove used if none was specified by the user.
+ * Standard implementation of memmove used if none was specified by the user,
+ * it bypasses the caches if asked to.
  */
 void *std_memmove(void *dst, const void *src, size_t n, unsigned flags) {
+	if (flags & VDM_F_NO_CACHE_HINT)
+		return memops_memmove_nt(dst, src, n);
+
 	return memmove(dst, src, n);
 }
 
@@ -71,9 +271,13 @@ void data_mover_threads_set_memmove_fn(struct data_mover_threads *dmt,
 }
 
 /*
- * Standard implementation of memset used if none was specified by the user.
+ * Standard implementation of memset used if none was specified by the user,
+ * it bypasses the caches if asked to.
  */
 void *std_memset(void *str, int c, size_t n, unsigned flags) {
+	if (flags & VDM_F_NO_CACHE_HINT)
+		return memops_memset_nt(str, c, n);
+
 	return memset(str, c, n);
 }
 
@@ -82,6 +286,76 @@ void data_mover_threads_set_memset_fn(struct data_mover_threads *dmt,
 	dmt->op_fns.op_memset = op_memset;
 }
 
+/*
+ * data_mover_threads_set_chunk_size -- sets the minimum size of a part
+ * of an operation executed by a single worker thread, large operations are
+ * split into parts executed concurrently by multiple worker threads.
+ * Setting this to 0 disables splitting.
+ */
+void
+data_mover_threads_set_chunk_size(struct data_mover_threads *dmt,
+				size_t chunk_size)
+{
+	if (chunk_size != 0)
+		chunk_size = MAX(chunk_size, DATA_MOVER_THREADS_MIN_CHUNK_SIZE);
+
+	dmt->chunk_size = chunk_size;
+}
+
+/*
+ * data_mover_threads_set_inline_threshold -- sets the size below which
+ * operations are executed synchronously by the thread that starts them,
+ * for small operations that's cheaper than handing them over to a worker.
+ * Setting this to 0 disables inline execution.
+ */
+void
+data_mover_threads_set_inline_threshold(struct data_mover_threads *dmt,
+				size_t inline_threshold)
+{
+	dmt->inline_threshold = inline_threshold;
+}
+
+/*
+ * data_mover_threads_set_priority_quota -- sets the number of operations with
+ * the VDM_F_PRIORITY flag a worker thread executes in a row before it takes
+ * an operation without the flag, if there's any waiting.
+ * Setting this to 0 makes the priority strict.
+ */
+void
+data_mover_threads_set_priority_quota(struct data_mover_threads *dmt,
+				size_t priority_quota)
+{
+	dmt->priority_quota = priority_quota;
+}
+
+/*
+ * data_mover_threads_set_nt_threshold -- sets the size from which memcpy,
+ * memmove and memset operations are executed as if they had
+ * the VDM_F_NO_CACHE_HINT flag, so that a single large operation doesn't
+ * evict the whole working set of the application from the caches.
+ * Setting this to 0 disables it, only the flag is honored then.
+ */
+void
+data_mover_threads_set_nt_threshold(struct data_mover_threads *dmt,
+				size_t nt_threshold)
+{
+	dmt->nt_threshold = nt_threshold;
+}
+
+/*
+ * data_mover_threads_op_flags -- (internal) returns the flags passed to
+ * the memory function executing an operation of size n
+ */
+static unsigned
+data_mover_threads_op_flags(struct data_mover_threads *dmt, uint64_t flags,
+	size_t n)
+{
+	if (dmt->nt_threshold != 0 && n >= dmt->nt_threshold)
+		flags |= VDM_F_NO_CACHE_HINT;
+
+	return (unsigned)flags;
+}
+
 static struct data_mover_threads_op_fns op_fns_default = {
 	.op_memcpy = std_memcpy,
 	.op_memmove = std_memmove,
@@ -89,292 +363,2204 @@ static struct data_mover_threads_op_fns op_fns_default = {
 };
 
 /*
- * data_mover_threads_do_operation -- implementation of the various
- * operations supported by this data mover
+ * data_mover_threads_do_range -- executes size bytes of the operation
+ * starting at offset
  */
 static void
-data_mover_threads_do_operation(struct data_mover_threads_data *data,
-				struct data_mover_threads *dmt)
+data_mover_threads_do_range(struct data_mover_threads *dmt,
+	const struct vdm_operation *op, size_t offset, size_t size)
 {
-	switch (data->op.type) {
+	char *dest;
+	uint64_t flags;
+
+	switch (op->type) {
 		case VDM_OPERATION_MEMCPY: {
-			struct vdm_operation_data_memcpy *mdata
-				= &data->op.data.memcpy;
+			const struct vdm_operation_data_memcpy *mdata
+				= &op->data.memcpy;
+			if (offset >= mdata->n)
+				return;
+			dest = (char *)mdata->dest + offset;
+			size = MIN(size, mdata->n - offset);
+			flags = mdata->flags;
 			memcpy_fn op_memcpy = dmt->op_fns.op_memcpy;
-			op_memcpy(mdata->dest,
-				mdata->src, mdata->n, (unsigned)mdata->flags);
+			op_memcpy(dest, (char *)mdata->src + offset, size,
+				data_mover_threads_op_flags(dmt, flags,
+					mdata->n));
 		} break;
 		case VDM_OPERATION_MEMMOVE: {
-			struct vdm_operation_data_memmove *mdata
-				= &data->op.data.memmove;
+			const struct vdm_operation_data_memmove *mdata
+				= &op->data.memmove;
+			if (offset >= mdata->n)
+				return;
+			dest = (char *)mdata->dest + offset;
+			size = MIN(size, mdata->n - offset);
+			flags = mdata->flags;
 			memmove_fn op_memmove = dmt->op_fns.op_memmove;
-			op_memmove(mdata->dest,
-				mdata->src, mdata->n, (unsigned)mdata->flags);
+			op_memmove(dest, (char *)mdata->src + offset, size,
+				data_mover_threads_op_flags(dmt, flags,
+					mdata->n));
 		} break;
 		case VDM_OPERATION_MEMSET: {
-			struct vdm_operation_data_memset *mdata
-				= &data->op.data.memset;
+			const struct vdm_operation_data_memset *mdata
+				= &op->data.memset;
+			if (offset >= mdata->n)
+				return;
+			dest = (char *)mdata->str + offset;
+			size = MIN(size, mdata->n - offset);
+			flags = mdata->flags;
 			memset_fn op_memset = dmt->op_fns.op_memset;
-			op_memset(mdata->str,
-				mdata->c, mdata->n, (unsigned)mdata->flags);
+			op_memset(dest, mdata->c, size,
+				data_mover_threads_op_flags(dmt, flags,
+					mdata->n));
 		} break;
-		case VDM_OPERATION_FLUSH:
-			printf("flush operation not implemented "
-					"for threads data mover");
-			exit(1);
+		case VDM_OPERATION_FLUSH: {
+			const struct vdm_operation_data_flush *mdata
+				= &op->data.flush;
+			if (offset < mdata->n)
+				flush_range((char *)mdata->dest + offset,
+					MIN(size, mdata->n - offset));
+		} return;
 		default:
 			ASSERT(0); /* unreachable */
-			break;
+			return;
 	}
 
+	/* durable writes have to leave the caches before completion */
+	if (flags & VDM_F_MEM_DURABLE)
+		flush_range(dest, size);
+}
+
+/*
+ * data_mover_threads_do_part -- executes a single part of the operation
+ */
+static void
+data_mover_threads_do_part(struct data_mover_threads_data *data,
+				struct data_mover_threads *dmt, uint64_t part)
+{
+	if (data->ops != NULL)
+		data_mover_threads_do_range(dmt, &data->ops[part], 0, SIZE_MAX);
+	else
+		data_mover_threads_do_range(dmt, &data->op,
+			part * data->part_size, data->part_size);
+}
+
+/*
+ * data_mover_threads_operation_complete -- marks the operation as complete
+ * and notifies the waiting runtime
+ */
+static void
+data_mover_threads_operation_complete(struct data_mover_threads_data *data)
+{
 	if (data->desired_notifier == FUTURE_NOTIFIER_WAKER) {
 		FUTURE_WAKER_WAKE(&data->notifier.waker);
 	}
-	util_atomic_store_explicit64(&data->complete, 1, memory_order_release);
+	util_atomic_store_explicit64(&data->complete_padded.complete, 1,
+		memory_order_release);
 }
 
 /*
- * data_mover_threads_loop -- loop that is executed by every worker
- * thread of the mover
+ * data_mover_threads_do_operation -- implementation of the various
+ * operations supported by this data mover
  */
-static void *
-data_mover_threads_loop(void *arg)
+static void
+data_mover_threads_do_operation(struct data_mover_threads_data *data,
+				struct data_mover_threads *dmt)
 {
-	struct data_mover_threads *dmt_threads = arg;
-	struct ringbuf *buf = dmt_threads->buf;
-	struct data_mover_threads_data *tdata;
+	if (data->nparts == 1) {
+		data_mover_threads_do_part(data, dmt, 0);
+		data_mover_threads_operation_complete(data);
+		return;
+	}
 
-	while (1) {
-		/*
-		 * Worker thread is trying to dequeue from ringbuffer,
-		 * if he fails, he's waiting until something is added to
-		 * the ringbuffer.
-		 */
-		if ((tdata = ringbuf_dequeue(buf)) == NULL)
-			return NULL;
+	/* keep claiming parts until there are none left */
+	uint64_t *next_part = &data->next_part_padded.next_part;
+	uint64_t part;
+	while ((part = util_fetch_and_add64(next_part, 1)) < data->nparts)
+		data_mover_threads_do_part(data, dmt, part);
 
-		data_mover_threads_do_operation(tdata, dmt_threads);
-	}
+	if (util_fetch_and_sub64(&data->pending_padded.pending, 1) == 1)
+		data_mover_threads_operation_complete(data);
 }
 
 /*
- * data_mover_threads_operation_check -- check the status of a thread operation
+ * data_mover_threads_bulk_size -- (internal) returns how many of the count
+ * entries of a queue the worker takes at once, a fair share of them is left for
+ * the other workers, so that parts of split operations are still executed
+ * in parallel
  */
-static enum future_state
-data_mover_threads_operation_check(void *data,
-	const struct vdm_operation *operation)
+static unsigned
+data_mover_threads_bulk_size(struct data_mover_threads *dmt, size_t count)
 {
-	SUPPRESS_UNUSED(operation);
+	uint64_t nactive;
+	util_atomic_load_explicit64(&dmt->nactive, &nactive,
+		memory_order_relaxed);
 
-	struct data_mover_threads_data *tdata = data;
-
-	uint64_t complete;
-	util_atomic_load_explicit64(&tdata->complete,
-		&complete, memory_order_acquire);
-	if (complete)
-		return FUTURE_STATE_COMPLETE;
-
-	uint64_t started;
-	util_atomic_load_explicit64(&tdata->started,
-		&started, memory_order_acquire);
-	if (started)
-		return FUTURE_STATE_RUNNING;
+	uint64_t share = count / MAX(nactive, 1);
 
-	return FUTURE_STATE_IDLE;
+	return (unsigned)MIN(MAX(share, 1), DATA_MOVER_THREADS_BULK_SIZE);
 }
 
 /*
- * data_mover_threads_operation_new -- create a new thread operation that uses
- * wakers
+ * The doorbell is queued in a normal queue only to wake up a worker parked on
+ * it, so that the worker polls the other queues. It's never executed, but it
+ * takes a slot of the queue until it's taken, at most one for each parked
+ * worker, which is why the queues fill up a little earlier than their size
+ * suggests while workers are being woken up.
  */
-static void *
-data_mover_threads_operation_new(struct vdm *vdm,
-	const enum vdm_operation_type type)
+static struct data_mover_threads_data data_mover_threads_doorbell;
+
+/*
+ * data_mover_threads_poll_priority -- (internal) takes up to max entries
+ * from the priority lane, returns the number of entries stored in tdata
+ */
+static size_t
+data_mover_threads_poll_priority(struct data_mover_threads_worker *worker,
+	void **tdata, uint64_t max)
 {
-	SUPPRESS_UNUSED(type);
+	struct data_mover_threads *dmt = worker->dmt;
+	unsigned bulk = data_mover_threads_bulk_size(dmt,
+		ringbuf_count(dmt->priority_queue));
 
-	struct data_mover_threads *dmt_threads =
-		(struct data_mover_threads *)vdm;
+	size_t n = ringbuf_trydequeue_n(dmt->priority_queue, tdata,
+		(unsigned)MIN(bulk, max));
+	worker->priority_streak += n;
 
-	struct data_mover_threads_data *op =
-		membuf_alloc(dmt_threads->membuf,
-		sizeof(struct data_mover_threads_data));
-	if (op == NULL)
-		return NULL;
+	return n;
+}
 
-	op->complete = 0;
-	op->started = 0;
-	op->desired_notifier = dmt_threads->desired_notifier;
+/*
+ * data_mover_threads_poll_overflow -- (internal) takes up to max oldest
+ * entries from the overflow queue, returns the number of entries stored in
+ * tdata
+ */
+static size_t
+data_mover_threads_poll_overflow(struct data_mover_threads *dmt,
+	void **tdata, uint64_t max)
+{
+	if (dmt->overflow == NULL)
+		return 0;
 
-	return op;
+	/* its lock is shared by all the workers, it's taken once per bulk */
+	unsigned bulk = data_mover_threads_bulk_size(dmt,
+		segqueue_count(dmt->overflow));
+
+	return segqueue_pop_n(dmt->overflow, tdata, (size_t)MIN(bulk, max));
 }
 
 /*
- * vdm_threads_operation_delete -- delete a thread operation
+ * data_mover_threads_poll_queues -- (internal) takes up to max next
+ * operations from the own queue of the worker or steals one from the other
+ * queues, returns the number of entries stored in tdata, 0 if there's none
+ * available
  */
-static void
-data_mover_threads_operation_delete(void *data,
-	const struct vdm_operation *operation,
-	struct vdm_operation_output *output)
+static size_t
+data_mover_threads_poll_queues(struct data_mover_threads_worker *worker,
+	void **tdata, uint64_t max)
 {
-	output->result = VDM_SUCCESS;
-	switch (operation->type) {
-		case VDM_OPERATION_MEMCPY:
-			output->type = VDM_OPERATION_MEMCPY;
-			output->output.memcpy.dest =
-				operation->data.memcpy.dest;
-			break;
-		case VDM_OPERATION_MEMMOVE:
-			output->type = VDM_OPERATION_MEMMOVE;
-			output->output.memmove.dest =
-				operation->data.memmove.dest;
-			break;
-		case VDM_OPERATION_MEMSET:
-			output->type = VDM_OPERATION_MEMSET;
-			output->output.memset.str =
-				operation->data.memset.str;
-			break;
-		default:
-			ASSERT(0);
+	struct data_mover_threads *dmt = worker->dmt;
+	struct ringbuf *queue = dmt->queues[worker->queue];
+	unsigned bulk = data_mover_threads_bulk_size(dmt, ringbuf_count(queue));
+	size_t n;
+
+	if ((n = ringbuf_trydequeue_n(queue, tdata,
+			(unsigned)MIN(bulk, max))) != 0)
+		return n;
+
+	if (dmt->nqueues == 1)
+		return data_mover_threads_poll_overflow(dmt, tdata, max);
+
+	/*
+	 * Own queue is empty, try stealing from the other workers,
+	 * starting with the ones on the same numa node.
+	 */
+	struct data_mover_threads_group *group = &dmt->groups[worker->group];
+	size_t own_idx = worker->queue - group->first_queue;
+	for (size_t i = 1; i < group->nqueues; ++i) {
+		size_t victim = group->first_queue +
+			(own_idx + i) % group->nqueues;
+		if ((*tdata = ringbuf_trydequeue(dmt->queues[victim])) != NULL)
+			return 1;
 	}
 
-	membuf_free(data);
+	for (size_t i = 1; i < dmt->nqueues; ++i) {
+		size_t victim = (worker->queue + i) % dmt->nqueues;
+		if (victim >= group->first_queue &&
+				victim < group->first_queue + group->nqueues)
+			continue;
+		if ((*tdata = ringbuf_trydequeue(dmt->queues[victim])) != NULL)
+			return 1;
+	}
+
+	return data_mover_threads_poll_overflow(dmt, tdata, max);
 }
 
 /*
- * data_mover_threads_operation_start -- start a memory operation using threads
+ * data_mover_threads_poll -- (internal) takes the next operations,
+ * the priority lane goes first unless the worker used up its quota while
+ * normal operations are waiting, returns the number of entries stored in
+ * tdata, 0 if there's none available
  */
-static int
-data_mover_threads_operation_start(void *data,
-	const struct vdm_operation *operation, struct future_notifier *n)
+static size_t
+data_mover_threads_poll(struct data_mover_threads_worker *worker,
+	void **tdata)
 {
-	struct data_mover_threads_data *tdata =
-		(struct data_mover_threads_data *)data;
-	memcpy(&tdata->op, operation, sizeof(*operation));
+	struct data_mover_threads *dmt = worker->dmt;
+	uint64_t quota = dmt->priority_quota;
+	uint64_t max = DATA_MOVER_THREADS_BULK_SIZE;
+	size_t n;
 
-	if (n) {
-		n->notifier_used = tdata->desired_notifier;
-		tdata->notifier = *n;
-		if (tdata->desired_notifier == FUTURE_NOTIFIER_POLLER) {
-			n->poller.ptr_to_monitor = &tdata->complete;
-		}
+	if (quota == 0 || worker->priority_streak < quota) {
+		if (quota != 0)
+			max = MIN(max, quota - worker->priority_streak);
+		if ((n = data_mover_threads_poll_priority(worker, tdata,
+				max)) != 0)
+			return n;
+		max = DATA_MOVER_THREADS_BULK_SIZE;
 	} else {
-		tdata->desired_notifier = FUTURE_NOTIFIER_NONE;
+		/* a single normal entry, then back to the priority lane */
+		max = 1;
 	}
 
-	struct data_mover_threads *dmt_threads = membuf_ptr_user_data(tdata);
-
-	if (ringbuf_tryenqueue(dmt_threads->buf, tdata) == 0) {
-		util_atomic_store_explicit64(&tdata->started,
-			FUTURE_STATE_RUNNING, memory_order_release);
+	if ((n = data_mover_threads_poll_queues(worker, tdata, max)) != 0) {
+		worker->priority_streak = 0;
+		return n;
 	}
 
-	return 0;
+	/* there's no normal operation waiting, the quota doesn't matter */
+	worker->priority_streak = 0;
+	return data_mover_threads_poll_priority(worker, tdata,
+		DATA_MOVER_THREADS_BULK_SIZE);
 }
 
-int
-has_property_dmt(void *fut, enum future_property property)
+/*
+ * data_mover_threads_stat_add -- (internal) increments one of the counters
+ * of the worker, which is the only writer of its counters
+ */
+static void
+data_mover_threads_stat_add(uint64_t *counter, uint64_t value)
 {
-	if (property == FUTURE_PROPERTY_ASYNC)
-		return 1;
-	return 0;
+	util_atomic_store_explicit64(counter, *counter + value,
+		memory_order_relaxed);
 }
 
-static struct vdm data_mover_threads_vdm = {
-	.op_new = data_mover_threads_operation_new,
-	.op_delete = data_mover_threads_operation_delete,
-	.op_check = data_mover_threads_operation_check,
-	.op_start = data_mover_threads_operation_start,
-	.capabilities = SUPPORTED_FLAGS,
-	.has_property = has_property_dmt,
-};
-
 /*
- * data_mover_threads_new -- creates a new data mover instance that's uses
- * worker threads for memory operations
+ * data_mover_threads_retire -- (internal) lets an idle worker of an elastic
+ * pool exit, unless the pool would shrink below its minimum size
  */
-struct data_mover_threads *
-data_mover_threads_new(size_t nthreads, size_t ringbuf_size,
-	enum future_notifier_type desired_notifier)
+static int
+data_mover_threads_retire(struct data_mover_threads_worker *worker)
 {
-	struct data_mover_threads *dmt_threads =
-		malloc(sizeof(struct data_mover_threads));
-	if (dmt_threads == NULL)
-		goto data_failed;
-
-	dmt_threads->desired_notifier = desired_notifier;
-	dmt_threads->base = data_mover_threads_vdm;
-	dmt_threads->op_fns = op_fns_default;
-
-	dmt_threads->buf = ringbuf_new((unsigned)ringbuf_size);
-	if (dmt_threads->buf == NULL)
-		goto ringbuf_failed;
-
-	dmt_threads->membuf = membuf_new(dmt_threads);
-	if (dmt_threads->membuf == NULL)
-		goto membuf_failed;
-
-	dmt_threads->nthreads = nthreads;
-	dmt_threads->threads = malloc(sizeof(os_thread_t) *
-		dmt_threads->nthreads);
-	if (dmt_threads->threads == NULL)
-		goto threads_array_failed;
+	struct data_mover_threads *dmt = worker->dmt;
+	int retired = 0;
 
-	size_t i;
-	for (i = 0; i < dmt_threads->nthreads; i++) {
-		os_thread_create(&dmt_threads->threads[i],
-			NULL, data_mover_threads_loop, dmt_threads);
+	util_mutex_lock(&dmt->pool_lock);
+	if (dmt->nactive > dmt->min_nthreads) {
+		worker->state = DATA_MOVER_THREADS_WORKER_RETIRED;
+		util_atomic_store_explicit64(&dmt->nactive, dmt->nactive - 1,
+			memory_order_relaxed);
+		retired = 1;
 	}
+	util_mutex_unlock(&dmt->pool_lock);
 
-	return dmt_threads;
-
-threads_array_failed:
-	membuf_delete(dmt_threads->membuf);
-
-membuf_failed:
-	ringbuf_delete(dmt_threads->buf);
-
-ringbuf_failed:
-	free(dmt_threads);
+	return retired;
+}
 
-data_failed:
-	return NULL;
+/*
+ * data_mover_threads_unpark -- (internal) clears the parked flag of
+ * the worker, unless whoever rang its doorbell already did
+ */
+static void
+data_mover_threads_unpark(struct data_mover_threads_worker *worker)
+{
+	if (util_bool_compare_and_swap64(&worker->parked, 1, 0))
+		util_fetch_and_sub64(&worker->dmt->nparked, 1);
 }
 
 /*
- * data_mover_threads_default -- creates a new data mover instance with
- * default parameters
+ * data_mover_threads_wake -- (internal) rings the doorbell of up to n parked
+ * workers, starting with the worker at index first. A parked worker waits on
+ * its own queue only, the doorbell makes it poll the other queues, the priority
+ * lane and the overflow queue.
  */
-struct data_mover_threads *
-data_mover_threads_default()
+static void
+data_mover_threads_wake(struct data_mover_threads *dmt, size_t first,
+	uint64_t n)
 {
-	return data_mover_threads_new(DATA_MOVER_THREADS_DEFAULT_NTHREADS,
-		DATA_MOVER_THREADS_DEFAULT_RINGBUF_SIZE,
-		FUTURE_NOTIFIER_WAKER);
+	if (dmt->wait_policy == DATA_MOVER_THREADS_WAIT_BUSY_POLL)
+		return;
+
+	/* pairs with the registration in data_mover_threads_next */
+	util_synchronize();
+
+	uint64_t nparked;
+	util_atomic_load_explicit64(&dmt->nparked, &nparked,
+		memory_order_acquire);
+	for (size_t i = 0; nparked != 0 && n != 0 && i < dmt->nthreads; ++i) {
+		struct data_mover_threads_worker *worker =
+			&dmt->workers[(first + i) % dmt->nthreads];
+		if (!util_bool_compare_and_swap64(&worker->parked, 1, 0))
+			continue;
+		util_fetch_and_sub64(&dmt->nparked, 1);
+		nparked--;
+		n--;
+
+		/*
+		 * Each park of a worker takes at most one doorbell, which
+		 * fails only if its queue is full and the worker wakes up
+		 * anyway.
+		 */
+		ringbuf_tryenqueue(dmt->queues[worker->queue],
+			&data_mover_threads_doorbell);
+	}
 }
 
 /*
- * data_mover_threads_get_vdm -- returns the vdm operations for the mover
+ * data_mover_threads_park -- (internal) blocks until something is added to
+ * the own queue of the worker, returns NULL once the queue is stopped or
+ * the worker of an elastic pool retires
  */
-struct vdm *
-data_mover_threads_get_vdm(struct data_mover_threads *dmt)
+static struct data_mover_threads_data *
+data_mover_threads_park(struct data_mover_threads_worker *worker)
 {
-	return &dmt->base;
+	struct data_mover_threads *dmt = worker->dmt;
+	struct ringbuf *queue = dmt->queues[worker->queue];
+
+	if (!dmt->elastic)
+		return ringbuf_dequeue(queue);
+
+	struct data_mover_threads_data *tdata;
+	do {
+		struct timespec abstime;
+		os_clock_gettime(CLOCK_REALTIME, &abstime);
+		uint64_t nsec = (uint64_t)abstime.tv_nsec +
+			dmt->idle_timeout % 1000 * 1000000;
+		abstime.tv_sec += (time_t)(dmt->idle_timeout / 1000 +
+			nsec / 1000000000);
+		abstime.tv_nsec = (long)(nsec % 1000000000);
+
+		tdata = ringbuf_dequeue_timed(queue, &abstime);
+	} while (tdata == NULL && errno == ETIMEDOUT &&
+		!data_mover_threads_retire(worker));
+
+	return tdata;
 }
 
 /*
- * data_mover_threads_delete -- perform necessary cleanup after threads mover.
- * Releases all memory and closes all created threads.
+ * data_mover_threads_next -- (internal) retrieves the next operations to be
+ * executed by the worker, waits according to the wait policy if there are
+ * none available, returns the number of entries stored in tdata, 0 once
+ * the mover is stopped
  */
-void
-data_mover_threads_delete(struct data_mover_threads *dmt)
+static size_t
+data_mover_threads_next(struct data_mover_threads_worker *worker,
+	void **tdata)
 {
-	ringbuf_stop(dmt->buf);
+	struct data_mover_threads *dmt = worker->dmt;
+	size_t n;
+
+	if ((n = data_mover_threads_poll(worker, tdata)) != 0)
+		return n;
+
+	uint64_t running = 1;
+	uint64_t spins = 0;
+	switch (dmt->wait_policy) {
+		case DATA_MOVER_THREADS_WAIT_BUSY_POLL:
+			/* never park, keep polling until the mover stops */
+			while (running) {
+				if ((n = data_mover_threads_poll(worker,
+						tdata)) != 0)
+					break;
+				spins++;
+				WAIT();
+				util_atomic_load_explicit64(&dmt->running,
+					&running, memory_order_acquire);
+			}
+			data_mover_threads_stat_add(&worker->stats.spins,
+				spins);
+			return n;
+		case DATA_MOVER_THREADS_WAIT_SPIN_THEN_PARK:
+			while (running && spins < dmt->spin_count) {
+				if ((n = data_mover_threads_poll(worker,
+						tdata)) != 0)
+					break;
+				spins++;
+				WAIT();
+				util_atomic_load_explicit64(&dmt->running,
+					&running, memory_order_acquire);
+			}
+			data_mover_threads_stat_add(&worker->stats.spins,
+				spins);
+			if (n != 0)
+				return n;
+			break;
+		default:
+			break;
+	}
+
+	for (;;) {
+		/*
+		 * Registered as parked before the last poll, either the poll
+		 * sees an operation submitted meanwhile or its submitter sees
+		 * the worker parked and rings the doorbell of its queue.
+		 */
+		uint64_t since;
+		util_atomic_load_explicit64(&dmt->over_since_ns, &since,
+			memory_order_relaxed);
+		util_atomic_store_explicit64(&worker->parked, 1,
+			memory_order_release);
+		util_fetch_and_add64(&dmt->nparked, 1);
+		if ((n = data_mover_threads_poll(worker, tdata)) != 0) {
+			data_mover_threads_unpark(worker);
+			return n;
+		}
+
+		/*
+		 * The queues were drained, unless the depth went over
+		 * the threshold again after the poll.
+		 */
+		if (since != 0)
+			util_bool_compare_and_swap64(&dmt->over_since_ns, since,
+				0);
+
+		/* there's nothing to do, wait until something is added */
+		data_mover_threads_stat_add(&worker->stats.parks, 1);
+		*tdata = data_mover_threads_park(worker);
+		data_mover_threads_unpark(worker);
+		if (*tdata == NULL) {
+			if (worker->state == DATA_MOVER_THREADS_WORKER_RETIRED)
+				return 0;
+
+			/* the queues are stopped, the overflow one goes last */
+			return data_mover_threads_poll_overflow(dmt, tdata,
+				DATA_MOVER_THREADS_BULK_SIZE);
+		}
+		data_mover_threads_stat_add(&worker->stats.wakeups, 1);
+
+		/* take whatever else was queued along with the first entry */
+		if (*tdata != &data_mover_threads_doorbell)
+			return 1 + data_mover_threads_poll(worker, tdata + 1);
+	}
+}
+
+/*
+ * data_mover_threads_prefetch -- (internal) starts loading the beginning
+ * of the source of an operation, so that it's in the cache once the worker
+ * gets to it
+ */
+static void
+data_mover_threads_prefetch(struct data_mover_threads_data *tdata)
+{
+	/* the part of a split operation isn't known until it's claimed */
+	if (tdata->ops != NULL || tdata->nparts != 1)
+		return;
+
+	switch (tdata->op.type) {
+		case VDM_OPERATION_MEMCPY:
+			PREFETCH(tdata->op.data.memcpy.src);
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			PREFETCH(tdata->op.data.memmove.src);
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * data_mover_threads_loop -- loop that is executed by every worker
+ * thread of the mover
+ */
+static void *
+data_mover_threads_loop(void *arg)
+{
+	struct data_mover_threads_worker *worker = arg;
+	struct data_mover_threads *dmt = worker->dmt;
+	/* one more for the entry taken by a parked worker */
+	void *tdata[DATA_MOVER_THREADS_BULK_SIZE + 1];
+	size_t n;
+
+	/* operations submitted from a worker are placed in its own queue */
+	os_tls_set(dmt->queue_key, (void *)(uintptr_t)(worker->queue + 1));
+
+	while ((n = data_mover_threads_next(worker, tdata)) != 0) {
+		for (size_t i = 0; i < n; ++i)
+			PREFETCH(tdata[i]);
+
+		for (size_t i = 0; i < n; ++i) {
+			if (i + 1 < n)
+				data_mover_threads_prefetch(tdata[i + 1]);
+			if (tdata[i] != &data_mover_threads_doorbell)
+				data_mover_threads_do_operation(tdata[i], dmt);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * data_mover_threads_queue_select -- (internal) returns the queue cursor of
+ * the calling thread, it selects the queue in which the operation should be
+ * placed among the queues of a group
+ */
+static size_t
+data_mover_threads_queue_select(struct data_mover_threads *dmt)
+{
+	if (dmt->nqueues == 1)
+		return 0;
+
+	/* cursor is stored incremented by one, so that 0 means unset */
+	uintptr_t cursor = (uintptr_t)os_tls_get(dmt->queue_key);
+	if (cursor == 0) {
+		cursor = util_fetch_and_add64(&dmt->next_queue, 1) + 1;
+		if (dmt->placement == DATA_MOVER_THREADS_PLACEMENT_LOCAL)
+			os_tls_set(dmt->queue_key, (void *)cursor);
+	}
+
+	if (dmt->placement == DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN)
+		os_tls_set(dmt->queue_key, (void *)(cursor + 1));
+
+	return (size_t)(cursor - 1);
+}
+
+/*
+ * data_mover_threads_node_lookup -- (internal) returns the numa node of
+ * the memory at addr, the result is cached for the whole 2MB range
+ */
+static unsigned
+data_mover_threads_node_lookup(struct data_mover_threads *dmt,
+	const void *addr)
+{
+	uint64_t range = (uint64_t)(uintptr_t)addr >>
+		DATA_MOVER_THREADS_NODE_RANGE_SHIFT;
+	uint64_t *entry = &dmt->node_cache[range %
+		DATA_MOVER_THREADS_NODE_CACHE_SIZE];
+
+	/* each entry holds the range and the node incremented by one */
+	uint64_t cached;
+	util_atomic_load_explicit64(entry, &cached, memory_order_relaxed);
+	if (cached != 0 && (cached >> 16) == range)
+		return (unsigned)(cached & 0xFFFF) - 1;
+
+	int node = topology_mem_node(addr);
+	/* pages which are not present yet are not cached */
+	if (node < 0 || node >= 0xFFFF)
+		return DATA_MOVER_THREADS_NODE_UNKNOWN;
+
+	cached = (range << 16) | (uint64_t)(node + 1);
+	util_atomic_store_explicit64(entry, cached, memory_order_relaxed);
+
+	return (unsigned)node;
+}
+
+/*
+ * data_mover_threads_group_select -- (internal) returns the group of workers
+ * local to the destination memory of the operation or NULL if there's none
+ */
+static struct data_mover_threads_group *
+data_mover_threads_group_select(struct data_mover_threads *dmt,
+	const struct vdm_operation *operation)
+{
+	if (dmt->ngroups == 1)
+		return NULL;
+
+	const void *dest;
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			dest = operation->data.memcpy.dest;
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			dest = operation->data.memmove.dest;
+			break;
+		case VDM_OPERATION_MEMSET:
+			dest = operation->data.memset.str;
+			break;
+		default:
+			return NULL;
+	}
+
+	unsigned node = data_mover_threads_node_lookup(dmt, dest);
+	for (size_t g = 0; g < dmt->ngroups; ++g) {
+		if (dmt->groups[g].node == node)
+			return &dmt->groups[g];
+	}
+
+	return NULL;
+}
+
+/*
+ * data_mover_threads_wake_peer -- (internal) wakes up a parked worker to steal
+ * from queue q, if the operation placed there waits behind another one, e.g.
+ * when a single submitter keeps filling its local queue
+ */
+static void
+data_mover_threads_wake_peer(struct data_mover_threads *dmt, size_t q)
+{
+	/* an empty queue wakes up its own worker */
+	if (dmt->nqueues != 1 && ringbuf_count(dmt->queues[q]) > 1)
+		data_mover_threads_wake(dmt, q + 1, 1);
+}
+
+/*
+ * data_mover_threads_submit -- (internal) places the operation in one of
+ * the queues, preferably in a queue of the workers local to its destination
+ * memory, fails if all of the queues are full
+ */
+static int
+data_mover_threads_submit(struct data_mover_threads *dmt,
+	struct data_mover_threads_group *group,
+	struct data_mover_threads_data *tdata)
+{
+	size_t cursor = data_mover_threads_queue_select(dmt);
+
+	if (group != NULL) {
+		for (size_t i = 0; i < group->nqueues; ++i) {
+			size_t q = group->first_queue +
+				(cursor + i) % group->nqueues;
+			if (ringbuf_tryenqueue(dmt->queues[q], tdata) == 0) {
+				data_mover_threads_wake_peer(dmt, q);
+				return 0;
+			}
+		}
+	}
+
+	/* fall back to any queue */
+	for (size_t i = 0; i < dmt->nqueues; ++i) {
+		size_t q = (cursor + i) % dmt->nqueues;
+		if (ringbuf_tryenqueue(dmt->queues[q], tdata) == 0) {
+			data_mover_threads_wake_peer(dmt, q);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * data_mover_threads_submit_shared -- (internal) places up to n entries of
+ * the operation in a queue shared by all workers, consecutive slots for many
+ * of them are reserved at once, returns the number of entries placed
+ */
+static uint64_t
+data_mover_threads_submit_shared(struct ringbuf *queue,
+	struct data_mover_threads_data *tdata, uint64_t n)
+{
+	void *entries[DATA_MOVER_THREADS_BULK_SIZE];
+	for (size_t i = 0; i < DATA_MOVER_THREADS_BULK_SIZE; ++i)
+		entries[i] = tdata;
+
+	uint64_t nqueued = 0;
+	while (nqueued < n) {
+		unsigned queued = ringbuf_tryenqueue_n(queue, entries,
+			(unsigned)MIN(n - nqueued,
+				DATA_MOVER_THREADS_BULK_SIZE));
+		if (queued == 0)
+			break;
+		nqueued += queued;
+	}
+
+	return nqueued;
+}
+
+/*
+ * data_mover_threads_submit_overflow -- (internal) places up to n entries of
+ * the operation in the overflow queue, its lock is taken once for each bulk
+ * of them, returns the number of entries placed
+ */
+static uint64_t
+data_mover_threads_submit_overflow(struct data_mover_threads *dmt,
+	struct data_mover_threads_data *tdata, uint64_t n)
+{
+	void *entries[DATA_MOVER_THREADS_BULK_SIZE];
+	for (size_t i = 0; i < DATA_MOVER_THREADS_BULK_SIZE; ++i)
+		entries[i] = tdata;
+
+	uint64_t nqueued = 0;
+	while (nqueued < n) {
+		size_t bulk = (size_t)MIN(n - nqueued,
+			DATA_MOVER_THREADS_BULK_SIZE);
+		size_t queued = segqueue_push_n(dmt->overflow, entries, bulk);
+		nqueued += queued;
+		if (queued < bulk)
+			break;
+	}
+
+	return nqueued;
+}
+
+/*
+ * data_mover_threads_submit_priority -- (internal) places up to n entries of
+ * the operation in the priority lane and rings the doorbell of the parked
+ * workers, returns the number of entries placed
+ */
+static uint64_t
+data_mover_threads_submit_priority(struct data_mover_threads *dmt,
+	struct data_mover_threads_data *tdata, uint64_t n)
+{
+	uint64_t nqueued = data_mover_threads_submit_shared(
+		dmt->priority_queue, tdata, n);
+	if (nqueued != 0)
+		data_mover_threads_wake(dmt,
+			data_mover_threads_queue_select(dmt), nqueued);
+
+	return nqueued;
+}
+
+/*
+ * data_mover_threads_operation_priority -- (internal) checks if all
+ * the operations executed through tdata have the VDM_F_PRIORITY flag
+ */
+static int
+data_mover_threads_operation_priority(struct data_mover_threads_data *tdata)
+{
+	const struct vdm_operation *ops = tdata->ops ? tdata->ops : &tdata->op;
+	size_t nops = tdata->ops ? tdata->nparts : 1;
+
+	for (size_t i = 0; i < nops; ++i) {
+		uint64_t flags;
+		switch (ops[i].type) {
+			case VDM_OPERATION_MEMCPY:
+				flags = ops[i].data.memcpy.flags;
+				break;
+			case VDM_OPERATION_MEMMOVE:
+				flags = ops[i].data.memmove.flags;
+				break;
+			case VDM_OPERATION_MEMSET:
+				flags = ops[i].data.memset.flags;
+				break;
+			case VDM_OPERATION_FLUSH:
+				flags = ops[i].data.flush.flags;
+				break;
+			default:
+				flags = 0;
+				break;
+		}
+		if (!(flags & VDM_F_PRIORITY))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * data_mover_threads_worker_start -- (internal) starts the thread of
+ * the worker, returns -1 if it couldn't be started and the result of pinning
+ * it to its cpus otherwise
+ */
+static int
+data_mover_threads_worker_start(struct data_mover_threads_worker *worker)
+{
+	/* the slot of a retired worker is reused */
+	if (worker->state == DATA_MOVER_THREADS_WORKER_RETIRED) {
+		os_thread_join(&worker->thread, NULL);
+		worker->state = DATA_MOVER_THREADS_WORKER_NONE;
+	}
+
+	if (os_thread_create(&worker->thread, NULL,
+			data_mover_threads_loop, worker) != 0)
+		return -1;
+	worker->state = DATA_MOVER_THREADS_WORKER_RUNNING;
+
+	if (worker->pinned)
+		return os_thread_setaffinity_np(&worker->thread,
+			sizeof(os_cpu_set_t), &worker->cpus);
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_now_ns -- (internal) returns the monotonic time in
+ * nanoseconds
+ */
+static uint64_t
+data_mover_threads_now_ns(void)
+{
+	struct timespec now;
+	os_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * data_mover_threads_over_threshold -- (internal) checks if the depth of
+ * the queues has stayed at the grow threshold for the grow delay
+ */
+static int
+data_mover_threads_over_threshold(struct data_mover_threads *dmt,
+	size_t waiting)
+{
+	uint64_t since;
+	util_atomic_load_explicit64(&dmt->over_since_ns, &since,
+		memory_order_relaxed);
+
+	if (waiting < dmt->grow_threshold) {
+		if (since != 0)
+			util_atomic_store_explicit64(&dmt->over_since_ns, 0,
+				memory_order_relaxed);
+		return 0;
+	}
+
+	/* a single burst doesn't last long enough to add a worker */
+	uint64_t now = data_mover_threads_now_ns();
+	if (since == 0) {
+		if (util_bool_compare_and_swap64(&dmt->over_since_ns, 0, now))
+			since = now;
+		else
+			util_atomic_load_explicit64(&dmt->over_since_ns,
+				&since, memory_order_relaxed);
+	}
+
+	return since != 0 && now >= since &&
+		now - since >= dmt->grow_delay_ns;
+}
+
+/*
+ * data_mover_threads_grow -- (internal) starts another worker of an elastic
+ * pool if the operations stay piled up in the queues
+ */
+static void
+data_mover_threads_grow(struct data_mover_threads *dmt)
+{
+	if (!dmt->elastic)
+		return;
+
+	uint64_t nactive;
+	util_atomic_load_explicit64(&dmt->nactive, &nactive,
+		memory_order_relaxed);
+	size_t waiting = ringbuf_count(dmt->queues[0]) +
+		ringbuf_count(dmt->priority_queue);
+	if (dmt->overflow != NULL)
+		waiting += segqueue_count(dmt->overflow);
+	if (nactive == dmt->nthreads ||
+			!data_mover_threads_over_threshold(dmt, waiting))
+		return;
+
+	/* someone else is already changing the pool */
+	if (os_mutex_trylock(&dmt->pool_lock) != 0)
+		return;
+
+	for (size_t i = 0; dmt->running && dmt->nactive < dmt->nthreads &&
+			i < dmt->nthreads; ++i) {
+		struct data_mover_threads_worker *worker = &dmt->workers[i];
+		if (worker->state == DATA_MOVER_THREADS_WORKER_RUNNING)
+			continue;
+
+		/* an unpinned worker still does its job */
+		data_mover_threads_worker_start(worker);
+		if (worker->state == DATA_MOVER_THREADS_WORKER_RUNNING)
+			util_atomic_store_explicit64(&dmt->nactive,
+				dmt->nactive + 1, memory_order_relaxed);
+		/* the next worker waits for the delay again */
+		util_atomic_store_explicit64(&dmt->over_since_ns, 0,
+			memory_order_relaxed);
+		break;
+	}
+
+	util_mutex_unlock(&dmt->pool_lock);
+}
+
+/*
+ * data_mover_threads_operation_check -- check the status of a thread operation
+ */
+static enum future_state
+data_mover_threads_operation_check(void *data,
+	const struct vdm_operation *operation)
+{
+	SUPPRESS_UNUSED(operation);
+
+	struct data_mover_threads_data *tdata = data;
+
+	uint64_t complete;
+	util_atomic_load_explicit64(&tdata->complete_padded.complete,
+		&complete, memory_order_acquire);
+	if (complete)
+		return FUTURE_STATE_COMPLETE;
+
+	uint64_t started;
+	util_atomic_load_explicit64(&tdata->started,
+		&started, memory_order_acquire);
+	if (started)
+		return FUTURE_STATE_RUNNING;
+
+	return FUTURE_STATE_IDLE;
+}
+
+/*
+ * data_mover_threads_operation_init -- initializes the state of a new thread
+ * operation in the memory provided by the caller
+ */
+static void
+data_mover_threads_operation_init(struct vdm *vdm,
+	const enum vdm_operation_type type, void *state)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_threads *dmt_threads =
+		(struct data_mover_threads *)vdm;
+	struct data_mover_threads_data *op = state;
+
+	op->dmt = dmt_threads;
+	op->owned = 0;
+	op->complete_padded.complete = 0;
+	op->started = 0;
+	op->desired_notifier = dmt_threads->desired_notifier;
+	op->ops = NULL;
+}
+
+/*
+ * data_mover_threads_operation_new -- create a new thread operation that uses
+ * wakers
+ */
+static void *
+data_mover_threads_operation_new(struct vdm *vdm,
+	const enum vdm_operation_type type)
+{
+	struct data_mover_threads *dmt_threads =
+		(struct data_mover_threads *)vdm;
+
+	struct data_mover_threads_data *op =
+		membuf_alloc(dmt_threads->membuf,
+		DATA_MOVER_THREADS_DATA_SIZE);
+	if (op == NULL)
+		return NULL;
+
+	data_mover_threads_operation_init(vdm, type, op);
+	op->owned = 1;
+
+	return op;
+}
+
+/*
+ * data_mover_threads_operation_output -- fills the output of a finished
+ * operation
+ */
+static void
+data_mover_threads_operation_output(const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	output->result = VDM_SUCCESS;
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			output->type = VDM_OPERATION_MEMCPY;
+			output->output.memcpy.dest =
+				operation->data.memcpy.dest;
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			output->type = VDM_OPERATION_MEMMOVE;
+			output->output.memmove.dest =
+				operation->data.memmove.dest;
+			break;
+		case VDM_OPERATION_MEMSET:
+			output->type = VDM_OPERATION_MEMSET;
+			output->output.memset.str =
+				operation->data.memset.str;
+			break;
+		case VDM_OPERATION_FLUSH:
+			output->type = VDM_OPERATION_FLUSH;
+			output->output.flush.unused = 0;
+			break;
+		default:
+			ASSERT(0);
+	}
+}
+
+/*
+ * vdm_threads_operation_delete -- delete a thread operation
+ */
+static void
+data_mover_threads_operation_delete(void *data,
+	const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	data_mover_threads_operation_output(operation, output);
+
+	struct data_mover_threads_data *tdata = data;
+	if (tdata->owned)
+		membuf_free(data);
+}
+
+/*
+ * data_mover_threads_operation_size -- returns the number of bytes
+ * the operation writes
+ */
+static size_t
+data_mover_threads_operation_size(const struct vdm_operation *operation)
+{
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			return operation->data.memcpy.n;
+		case VDM_OPERATION_MEMMOVE:
+			return operation->data.memmove.n;
+		case VDM_OPERATION_MEMSET:
+			return operation->data.memset.n;
+		case VDM_OPERATION_FLUSH:
+			return operation->data.flush.n;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * data_mover_threads_operation_split -- returns the number of parts
+ * the operation should be split into and calculates the size of each part
+ */
+static uint64_t
+data_mover_threads_operation_split(struct data_mover_threads *dmt,
+	const struct vdm_operation *operation, size_t *part_size)
+{
+	size_t n = data_mover_threads_operation_size(operation);
+	if (operation->type == VDM_OPERATION_MEMMOVE) {
+		/* overlapping moves have to be done sequentially */
+		const struct vdm_operation_data_memmove *mdata =
+			&operation->data.memmove;
+		uintptr_t dest = (uintptr_t)mdata->dest;
+		uintptr_t src = (uintptr_t)mdata->src;
+		if (dest < src + mdata->n && src < dest + mdata->n)
+			n = 0;
+	}
+
+	uint64_t nparts = dmt->chunk_size == 0 ? 1 : n / dmt->chunk_size;
+	nparts = MIN(nparts, dmt->nthreads);
+
+	if (nparts <= 1) {
+		*part_size = SIZE_MAX;
+		return 1;
+	}
+
+	/* keep the boundaries between parts cache line aligned */
+	*part_size = ALIGN_UP((n + nparts - 1) / nparts,
+		DATA_MOVER_THREADS_MIN_CHUNK_SIZE);
+
+	return nparts;
+}
+
+/*
+ * data_mover_threads_notifier -- (internal) sets up the notifier of
+ * the operation
+ */
+static void
+data_mover_threads_notifier(struct data_mover_threads_data *tdata,
+	struct future_notifier *n)
+{
+	if (n) {
+		n->notifier_used = tdata->desired_notifier;
+		tdata->notifier = *n;
+		if (tdata->desired_notifier == FUTURE_NOTIFIER_POLLER) {
+			n->poller.ptr_to_monitor =
+				&tdata->complete_padded.complete;
+		}
+	} else {
+		tdata->desired_notifier = FUTURE_NOTIFIER_NONE;
+	}
+}
+
+/*
+ * data_mover_threads_queue -- (internal) places nentries references to
+ * the parts of the operation in the queues, fails if none of them fit
+ */
+static int
+data_mover_threads_queue(struct data_mover_threads *dmt,
+	struct data_mover_threads_data *tdata,
+	const struct vdm_operation *operation, uint64_t nentries)
+{
+	tdata->next_part_padded.next_part = 0;
+	/* one reference for each entry and one for the submitter */
+	tdata->pending_padded.pending = nentries + 1;
+
+	struct data_mover_threads_group *group =
+		data_mover_threads_group_select(dmt, operation);
+
+	uint64_t nqueued = 0;
+	int priority = data_mover_threads_operation_priority(tdata);
+	int overflow = !priority && dmt->overflow != NULL &&
+		segqueue_count(dmt->overflow) != 0;
+	if (priority) {
+		nqueued = data_mover_threads_submit_priority(dmt, tdata,
+			nentries);
+	} else if (overflow) {
+		/* operations waiting in the overflow queue go first */
+	} else if (dmt->nqueues == 1) {
+		nqueued = data_mover_threads_submit_shared(dmt->queues[0],
+			tdata, nentries);
+	} else {
+		for (; nqueued < nentries; ++nqueued) {
+			if (data_mover_threads_submit(dmt, group, tdata) != 0)
+				break;
+		}
+	}
+
+	if (!priority && dmt->overflow != NULL && nqueued < nentries) {
+		uint64_t npushed = data_mover_threads_submit_overflow(dmt,
+			tdata, nentries - nqueued);
+		nqueued += npushed;
+
+		/* parked workers wait on their queues, not on this one */
+		if (npushed != 0)
+			data_mover_threads_wake(dmt, 0, npushed);
+	}
+
+	/*
+	 * The ringbuf is full and the overflow queue is disabled or out of
+	 * its budget, the operation will be started on next poll.
+	 */
+	if (nqueued == 0)
+		return -1;
+
+	util_atomic_store_explicit64(&tdata->started,
+		FUTURE_STATE_RUNNING, memory_order_release);
+
+	data_mover_threads_grow(dmt);
+
+	if (tdata->nparts == 1)
+		return 0;
+
+	/*
+	 * Drop the references of entries that didn't fit into the ringbuf,
+	 * their parts will be picked up by the workers that did get an entry.
+	 */
+	uint64_t unused = nentries - nqueued + 1;
+	if (util_fetch_and_sub64(&tdata->pending_padded.pending, unused) ==
+			unused)
+		data_mover_threads_operation_complete(tdata);
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_operation_start -- start a memory operation using threads
+ */
+static int
+data_mover_threads_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_threads_data *tdata =
+		(struct data_mover_threads_data *)data;
+	memcpy(&tdata->op, operation, sizeof(*operation));
+	data_mover_threads_notifier(tdata, n);
+
+	struct data_mover_threads *dmt_threads = tdata->dmt;
+
+	/*
+	 * Small operations are done right away, the future completes when
+	 * it's checked right after this function returns.
+	 */
+	if (data_mover_threads_operation_size(&tdata->op) <
+			dmt_threads->inline_threshold) {
+		tdata->nparts = 1;
+		tdata->part_size = SIZE_MAX;
+		data_mover_threads_do_part(tdata, dmt_threads, 0);
+		util_atomic_store_explicit64(&tdata->started,
+			FUTURE_STATE_RUNNING, memory_order_release);
+		util_atomic_store_explicit64(
+			&tdata->complete_padded.complete, 1,
+			memory_order_release);
+		return 0;
+	}
+
+	tdata->nparts = data_mover_threads_operation_split(dmt_threads,
+		&tdata->op, &tdata->part_size);
+
+	/*
+	 * The operation stays idle if it didn't fit, it's retried on poll.
+	 * Until then, nothing notifies the caller.
+	 */
+	if (data_mover_threads_queue(dmt_threads, tdata, &tdata->op,
+			tdata->nparts) != 0 && n != NULL)
+		n->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_operation_monitor -- returns the completion word of
+ * the operation or the batch if its future uses the poller notifier
+ */
+static uint64_t *
+data_mover_threads_operation_monitor(void *data)
+{
+	struct data_mover_threads_data *tdata = data;
+
+	if (tdata->desired_notifier != FUTURE_NOTIFIER_POLLER)
+		return NULL;
+
+	/* the word of an operation which isn't queued yet doesn't change */
+	uint64_t started;
+	util_atomic_load_explicit64(&tdata->started, &started,
+		memory_order_acquire);
+
+	return started ? &tdata->complete_padded.complete : NULL;
+}
+
+/*
+ * data_mover_threads_batch_new -- creates a new batch of operations
+ */
+static void *
+data_mover_threads_batch_new(struct vdm *vdm, size_t noperations)
+{
+	SUPPRESS_UNUSED(noperations);
+
+	return data_mover_threads_operation_new(vdm, VDM_OPERATION_MEMCPY);
+}
+
+/*
+ * data_mover_threads_batch_start -- starts a batch of operations, the queues
+ * get a single entry for each worker that can take part in it rather than
+ * an entry for each operation
+ */
+static int
+data_mover_threads_batch_start(void *data,
+	const struct vdm_operation *operations, size_t noperations,
+	struct future_notifier *n)
+{
+	struct data_mover_threads_data *tdata =
+		(struct data_mover_threads_data *)data;
+	data_mover_threads_notifier(tdata, n);
+
+	if (noperations == 0) {
+		util_atomic_store_explicit64(
+			&tdata->complete_padded.complete, 1,
+			memory_order_release);
+		return 0;
+	}
+
+	struct data_mover_threads *dmt_threads = tdata->dmt;
+	tdata->ops = operations;
+	tdata->nparts = noperations;
+	tdata->part_size = SIZE_MAX;
+
+	/* as with a single operation, nothing notifies the caller yet */
+	if (data_mover_threads_queue(dmt_threads, tdata, &operations[0],
+			MIN(noperations, dmt_threads->nthreads)) != 0 &&
+			n != NULL)
+		n->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_batch_check -- checks the status of a batch
+ */
+static enum future_state
+data_mover_threads_batch_check(void *data,
+	const struct vdm_operation *operations, size_t noperations)
+{
+	SUPPRESS_UNUSED(noperations);
+
+	return data_mover_threads_operation_check(data, operations);
+}
+
+/*
+ * data_mover_threads_batch_delete -- deletes a finished batch and fills
+ * the outputs of all of its operations
+ */
+static void
+data_mover_threads_batch_delete(void *data,
+	const struct vdm_operation *operations, size_t noperations,
+	struct vdm_operation_output *outputs)
+{
+	for (size_t i = 0; i < noperations; ++i)
+		data_mover_threads_operation_output(&operations[i],
+			&outputs[i]);
+
+	membuf_free(data);
+}
+
+int
+has_property_dmt(void *fut, enum future_property property)
+{
+	if (property == FUTURE_PROPERTY_ASYNC)
+		return 1;
+	return 0;
+}
+
+static struct vdm data_mover_threads_vdm = {
+	.op_new = data_mover_threads_operation_new,
+	.op_delete = data_mover_threads_operation_delete,
+	.op_check = data_mover_threads_operation_check,
+	.op_start = data_mover_threads_operation_start,
+	.capabilities = SUPPORTED_FLAGS,
+	.has_property = has_property_dmt,
+	.op_batch_new = data_mover_threads_batch_new,
+	.op_batch_delete = data_mover_threads_batch_delete,
+	.op_batch_start = data_mover_threads_batch_start,
+	.op_batch_check = data_mover_threads_batch_check,
+	.op_state_size = DATA_MOVER_THREADS_DATA_SIZE,
+	.op_init = data_mover_threads_operation_init,
+	.op_monitor = data_mover_threads_operation_monitor,
+};
+
+/*
+ * data_mover_threads_config_new -- creates a new threads data mover
+ * configuration with default values
+ */
+struct data_mover_threads_config *
+data_mover_threads_config_new(void)
+{
+	struct data_mover_threads_config *cfg =
+		malloc(sizeof(struct data_mover_threads_config));
+	if (cfg == NULL)
+		return NULL;
+
+	*cfg = config_default;
+
+	return cfg;
+}
+
+/*
+ * data_mover_threads_config_delete -- deletes a threads data mover
+ * configuration
+ */
+void
+data_mover_threads_config_delete(struct data_mover_threads_config *cfg)
+{
+	free(cfg->cpus);
+	free(cfg);
+}
+
+/*
+ * data_mover_threads_config_set_nthreads -- sets a fixed number of worker
+ * threads
+ */
+void
+data_mover_threads_config_set_nthreads(struct data_mover_threads_config *cfg,
+	size_t nthreads)
+{
+	cfg->nthreads = nthreads;
+	cfg->max_nthreads = nthreads;
+}
+
+/*
+ * data_mover_threads_config_set_nthreads_range -- sets the minimum and
+ * the maximum number of worker threads of an elastic pool, 0 as the maximum
+ * means the number of available cpus
+ */
+void
+data_mover_threads_config_set_nthreads_range(
+	struct data_mover_threads_config *cfg, size_t min_nthreads,
+	size_t max_nthreads)
+{
+	cfg->nthreads = min_nthreads;
+	cfg->max_nthreads = max_nthreads;
+}
+
+/*
+ * data_mover_threads_config_set_grow_threshold -- sets the number of queued
+ * operations at which an elastic pool starts another worker thread
+ */
+void
+data_mover_threads_config_set_grow_threshold(
+	struct data_mover_threads_config *cfg, size_t grow_threshold)
+{
+	cfg->grow_threshold = grow_threshold;
+}
+
+/*
+ * data_mover_threads_config_set_grow_delay -- sets the time in milliseconds
+ * for which the queued operations have to stay at the grow threshold before
+ * an elastic pool starts another worker thread
+ */
+void
+data_mover_threads_config_set_grow_delay(
+	struct data_mover_threads_config *cfg, uint64_t grow_delay)
+{
+	cfg->grow_delay = grow_delay;
+}
+
+/*
+ * data_mover_threads_config_set_idle_timeout -- sets the time in milliseconds
+ * after which an idle worker thread of an elastic pool exits
+ */
+void
+data_mover_threads_config_set_idle_timeout(
+	struct data_mover_threads_config *cfg, uint64_t idle_timeout)
+{
+	cfg->idle_timeout = idle_timeout;
+}
+
+/*
+ * data_mover_threads_config_set_overflow_size -- sets the memory budget in
+ * bytes of the queue which takes the operations that don't fit into the full
+ * operation queues, 0 disables it
+ */
+void
+data_mover_threads_config_set_overflow_size(
+	struct data_mover_threads_config *cfg, size_t overflow_size)
+{
+	cfg->overflow_size = overflow_size;
+}
+
+/*
+ * data_mover_threads_config_set_ringbuf_size -- sets the size of each
+ * operation queue
+ */
+void
+data_mover_threads_config_set_ringbuf_size(
+	struct data_mover_threads_config *cfg, size_t ringbuf_size)
+{
+	cfg->ringbuf_size = ringbuf_size;
+}
+
+/*
+ * data_mover_threads_config_set_notifier -- sets the notifier type used by
+ * the mover operations
+ */
+void
+data_mover_threads_config_set_notifier(struct data_mover_threads_config *cfg,
+	enum future_notifier_type desired_notifier)
+{
+	cfg->desired_notifier = desired_notifier;
+}
+
+/*
+ * data_mover_threads_config_set_scheduling -- sets the way in which
+ * operations are distributed among worker threads
+ */
+void
+data_mover_threads_config_set_scheduling(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_scheduling scheduling)
+{
+	cfg->scheduling = scheduling;
+}
+
+/*
+ * data_mover_threads_config_set_placement -- sets the way in which
+ * per-worker queues are chosen for new operations
+ */
+void
+data_mover_threads_config_set_placement(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_placement placement)
+{
+	cfg->placement = placement;
+}
+
+/*
+ * data_mover_threads_config_set_affinity -- sets the policy of pinning worker
+ * threads to cpus
+ */
+void
+data_mover_threads_config_set_affinity(struct data_mover_threads_config *cfg,
+	enum data_mover_threads_affinity affinity)
+{
+	cfg->affinity = affinity;
+}
+
+/*
+ * data_mover_threads_config_set_cpus -- restricts the worker threads to
+ * the given set of cpus, an empty set means all cpus available to the process
+ */
+int
+data_mover_threads_config_set_cpus(struct data_mover_threads_config *cfg,
+	const size_t *cpus, size_t ncpus)
+{
+	size_t *copy = NULL;
+	if (ncpus != 0) {
+		copy = malloc(sizeof(size_t) * ncpus);
+		if (copy == NULL)
+			return -1;
+		memcpy(copy, cpus, sizeof(size_t) * ncpus);
+	}
+
+	free(cfg->cpus);
+	cfg->cpus = copy;
+	cfg->ncpus = ncpus;
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_config_set_numa_aware -- enables numa aware worker
+ * groups, operations are executed by workers on the node of their destination
+ */
+void
+data_mover_threads_config_set_numa_aware(
+	struct data_mover_threads_config *cfg, int numa_aware)
+{
+	cfg->numa_aware = numa_aware;
+}
+
+/*
+ * data_mover_threads_config_set_wait_policy -- sets the way in which idle
+ * worker threads wait for new operations
+ */
+void
+data_mover_threads_config_set_wait_policy(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_wait_policy wait_policy)
+{
+	cfg->wait_policy = wait_policy;
+}
+
+/*
+ * data_mover_threads_config_set_spin_count -- sets the number of polls of
+ * the queues before an idle worker thread parks
+ */
+void
+data_mover_threads_config_set_spin_count(
+	struct data_mover_threads_config *cfg, uint64_t spin_count)
+{
+	cfg->spin_count = spin_count;
+}
+
+/*
+ * data_mover_threads_config_set_pages -- sets the memory backing the buffers
+ * of operation data of submitting threads and whether they are pre-faulted
+ * when a thread registers or submits its first operation
+ */
+void
+data_mover_threads_config_set_pages(struct data_mover_threads_config *cfg,
+	enum data_mover_threads_pages pages, int prefault)
+{
+	cfg->pages = pages;
+	cfg->prefault = prefault;
+}
+
+/*
+ * data_mover_threads_config_set_max_buffers -- sets the number of 2MB buffers
+ * up to which the space for operation data of a submitting thread grows
+ */
+void
+data_mover_threads_config_set_max_buffers(
+	struct data_mover_threads_config *cfg, size_t max_buffers)
+{
+	cfg->max_buffers = max_buffers;
+}
+
+/*
+ * data_mover_threads_cpu_cmp -- (internal) compares two cpus by the given
+ * keys, the first key is the most significant one
+ */
+static int
+data_mover_threads_cpu_cmp(const size_t *a, const size_t *b, size_t nkeys)
+{
+	for (size_t i = 0; i < nkeys; ++i) {
+		if (a[i] != b[i])
+			return a[i] < b[i] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_cpu_compact -- (internal) orders cpus so that
+ * the siblings of a core and the cores of a package are next to each other
+ */
+static int
+data_mover_threads_cpu_compact(const void *lhs, const void *rhs)
+{
+	const struct topology_cpu *l = lhs;
+	const struct topology_cpu *r = rhs;
+	size_t a[] = {l->package, l->core_rank, l->sibling, l->id};
+	size_t b[] = {r->package, r->core_rank, r->sibling, r->id};
+
+	return data_mover_threads_cpu_cmp(a, b, 4);
+}
+
+/*
+ * data_mover_threads_cpu_scatter -- (internal) orders cpus so that
+ * the consecutive ones are in different packages, wherever possible
+ */
+static int
+data_mover_threads_cpu_scatter(const void *lhs, const void *rhs)
+{
+	const struct topology_cpu *l = lhs;
+	const struct topology_cpu *r = rhs;
+	size_t a[] = {l->sibling, l->core_rank, l->package, l->id};
+	size_t b[] = {r->sibling, r->core_rank, r->package, r->id};
+
+	return data_mover_threads_cpu_cmp(a, b, 4);
+}
+
+/*
+ * data_mover_threads_cpu_cores -- (internal) orders cpus so that the first
+ * cpus of all physical cores come before any of their SMT siblings
+ */
+static int
+data_mover_threads_cpu_cores(const void *lhs, const void *rhs)
+{
+	const struct topology_cpu *l = lhs;
+	const struct topology_cpu *r = rhs;
+	size_t a[] = {l->sibling, l->package, l->core_rank, l->id};
+	size_t b[] = {r->sibling, r->package, r->core_rank, r->id};
+
+	return data_mover_threads_cpu_cmp(a, b, 4);
+}
+
+/*
+ * data_mover_threads_cpu_allowed -- (internal) checks if the cpu is in the set
+ * of cpus from the configuration
+ */
+static int
+data_mover_threads_cpu_allowed(const struct data_mover_threads_config *cfg,
+	size_t cpu)
+{
+	if (cfg->ncpus == 0)
+		return 1;
+
+	for (size_t i = 0; i < cfg->ncpus; ++i) {
+		if (cfg->cpus[i] == cpu)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_cpus_avoid_smt -- (internal) picks a single cpu from
+ * each physical core, skipping the core of the calling thread if possible
+ */
+static size_t
+data_mover_threads_cpus_avoid_smt(const struct data_mover_threads_config *cfg,
+	struct topology *topo, struct topology_cpu *cpus)
+{
+	size_t ncpus = 0;
+	int self = topology_current_cpu();
+	struct topology_cpu *self_cpu =
+		self < 0 ? NULL : topology_find(topo, (size_t)self);
+
+	for (int skip_self = 1; skip_self >= 0 && ncpus == 0; --skip_self) {
+		for (size_t i = 0; i < topo->ncpus; ++i) {
+			struct topology_cpu *cpu = &topo->cpus[i];
+			if (!data_mover_threads_cpu_allowed(cfg, cpu->id))
+				continue;
+			if (skip_self && self_cpu != NULL &&
+					cpu->core == self_cpu->core)
+				continue;
+
+			size_t j;
+			for (j = 0; j < ncpus; ++j) {
+				if (cpus[j].core == cpu->core)
+					break;
+			}
+			if (j == ncpus)
+				cpus[ncpus++] = *cpu;
+		}
+	}
+
+	return ncpus;
+}
+
+/*
+ * data_mover_threads_cpus -- (internal) fills the array with the cpus
+ * available to the workers in the order of the affinity policy, returns
+ * the number of cpus
+ */
+static size_t
+data_mover_threads_cpus(const struct data_mover_threads_config *cfg,
+	struct topology *topo, struct topology_cpu *cpus)
+{
+	size_t ncpus = 0;
+	if (cfg->affinity == DATA_MOVER_THREADS_AFFINITY_AVOID_SMT) {
+		ncpus = data_mover_threads_cpus_avoid_smt(cfg, topo, cpus);
+	} else {
+		for (size_t i = 0; i < topo->ncpus; ++i) {
+			if (data_mover_threads_cpu_allowed(cfg,
+					topo->cpus[i].id))
+				cpus[ncpus++] = topo->cpus[i];
+		}
+	}
+
+	switch (cfg->affinity) {
+		case DATA_MOVER_THREADS_AFFINITY_COMPACT:
+		case DATA_MOVER_THREADS_AFFINITY_AVOID_SMT:
+			qsort(cpus, ncpus, sizeof(*cpus),
+				data_mover_threads_cpu_compact);
+			break;
+		case DATA_MOVER_THREADS_AFFINITY_SCATTER:
+			qsort(cpus, ncpus, sizeof(*cpus),
+				data_mover_threads_cpu_scatter);
+			break;
+		case DATA_MOVER_THREADS_AFFINITY_PHYSICAL_CORES:
+			qsort(cpus, ncpus, sizeof(*cpus),
+				data_mover_threads_cpu_cores);
+			break;
+		default:
+			break;
+	}
+
+	return ncpus;
+}
+
+/*
+ * data_mover_threads_groups -- (internal) divides the workers and their
+ * queues into groups, one for each numa node of the available cpus
+ * if the mover is numa aware
+ */
+static int
+data_mover_threads_groups(struct data_mover_threads *dmt,
+	const struct data_mover_threads_config *cfg,
+	const struct topology_cpu *cpus, size_t ncpus)
+{
+	dmt->groups = malloc(sizeof(struct data_mover_threads_group) *
+		MAX(ncpus, 1));
+	if (dmt->groups == NULL)
+		return -1;
+
+	/* collect the distinct nodes of the cpus in ascending order */
+	size_t nnodes = 0;
+	for (size_t c = 0; cfg->numa_aware && c < ncpus; ++c) {
+		size_t pos = 0;
+		while (pos < nnodes && dmt->groups[pos].node < cpus[c].node)
+			pos++;
+		if (pos < nnodes && dmt->groups[pos].node == cpus[c].node)
+			continue;
+
+		memmove(&dmt->groups[pos + 1], &dmt->groups[pos],
+			sizeof(*dmt->groups) * (nnodes - pos));
+		dmt->groups[pos].node = cpus[c].node;
+		nnodes++;
+	}
+
+	if (nnodes == 0) {
+		dmt->groups[0].node = DATA_MOVER_THREADS_NODE_UNKNOWN;
+		nnodes = 1;
+	}
+
+	/* every group needs at least one worker */
+	dmt->ngroups = MIN(nnodes, dmt->nthreads);
+	dmt->nqueues = cfg->scheduling == DATA_MOVER_THREADS_SCHEDULING_SHARED ?
+		dmt->ngroups : dmt->nthreads;
+
+	for (size_t g = 0; g < dmt->ngroups; ++g) {
+		struct data_mover_threads_group *group = &dmt->groups[g];
+		group->first_worker = g * dmt->nthreads / dmt->ngroups;
+		group->nworkers = (g + 1) * dmt->nthreads / dmt->ngroups -
+			group->first_worker;
+
+		if (dmt->nqueues == dmt->ngroups) {
+			group->first_queue = g;
+			group->nqueues = 1;
+		} else {
+			group->first_queue = group->first_worker;
+			group->nqueues = group->nworkers;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_affinity -- (internal) computes the set of cpus each
+ * worker thread is allowed to run on, workers are not pinned if there are
+ * no cpus
+ */
+static void
+data_mover_threads_affinity(struct data_mover_threads *dmt,
+	const struct data_mover_threads_config *cfg,
+	const struct topology_cpu *cpus, size_t ncpus)
+{
+	for (size_t i = 0; i < dmt->nthreads; ++i) {
+		struct data_mover_threads_worker *worker = &dmt->workers[i];
+		struct data_mover_threads_group *group =
+			&dmt->groups[worker->group];
+
+		worker->pinned = ncpus != 0;
+		/* os_cpu_zero clears only the part used by the os */
+		memset(&worker->cpus, 0, sizeof(worker->cpus));
+		os_cpu_zero(&worker->cpus);
+
+		/* only the cpus on the node of the group are used */
+		size_t nlocal = 0;
+		for (size_t c = 0; c < ncpus; ++c) {
+			if (group->node == DATA_MOVER_THREADS_NODE_UNKNOWN ||
+					cpus[c].node == group->node)
+				nlocal++;
+		}
+		if (nlocal == 0)
+			continue;
+
+		/*
+		 * Without a policy the worker may run on any of the cpus,
+		 * otherwise it's pinned to a single one. There may be more
+		 * workers than cpus, wrap around in that case.
+		 */
+		size_t rank = (i - group->first_worker) % nlocal;
+		for (size_t c = 0; c < ncpus; ++c) {
+			if (group->node != DATA_MOVER_THREADS_NODE_UNKNOWN &&
+					cpus[c].node != group->node)
+				continue;
+
+			if (cfg->affinity == DATA_MOVER_THREADS_AFFINITY_NONE) {
+				os_cpu_set(cpus[c].id, &worker->cpus);
+			} else if (rank-- == 0) {
+				os_cpu_set(cpus[c].id, &worker->cpus);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * data_mover_threads_stop -- (internal) stops the queues and waits for
+ * the worker threads to finish
+ */
+static void
+data_mover_threads_stop(struct data_mover_threads *dmt)
+{
+	/*
+	 * Workers find the queues stopped once they're drained, then they
+	 * drain the overflow queue before they exit.
+	 */
+	ringbuf_stop(dmt->priority_queue);
+
+	for (size_t q = 0; q < dmt->nqueues; ++q)
+		ringbuf_stop(dmt->queues[q]);
+	/* polling workers exit once all the queues are drained */
+	util_mutex_lock(&dmt->pool_lock);
+	util_atomic_store_explicit64(&dmt->running, 0, memory_order_release);
+	util_mutex_unlock(&dmt->pool_lock);
+
+	/* no worker is started or retired past this point */
 	for (size_t i = 0; i < dmt->nthreads; i++) {
-		os_thread_join(&dmt->threads[i], NULL);
+		if (dmt->workers[i].state != DATA_MOVER_THREADS_WORKER_NONE)
+			os_thread_join(&dmt->workers[i].thread, NULL);
+	}
+}
+
+/*
+ * data_mover_threads_membuf_pages -- (internal) returns the membuf backing
+ * matching the configured one
+ */
+static enum membuf_pages
+data_mover_threads_membuf_pages(enum data_mover_threads_pages pages)
+{
+	switch (pages) {
+		case DATA_MOVER_THREADS_PAGES_TRANSPARENT_HUGE:
+			return MEMBUF_PAGES_TRANSPARENT_HUGE;
+		case DATA_MOVER_THREADS_PAGES_HUGETLB:
+			return MEMBUF_PAGES_HUGETLB;
+		default:
+			return MEMBUF_PAGES_DEFAULT;
+	}
+}
+
+/*
+ * data_mover_threads_new_ext -- creates a new data mover instance that uses
+ * worker threads for memory operations, configured by the provided config
+ */
+struct data_mover_threads *
+data_mover_threads_new_ext(const struct data_mover_threads_config *cfg)
+{
+	if (cfg->nthreads == 0 || (cfg->max_nthreads != 0 &&
+			cfg->max_nthreads < cfg->nthreads))
+		return NULL;
+
+	switch (cfg->scheduling) {
+		case DATA_MOVER_THREADS_SCHEDULING_SHARED:
+		case DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING:
+			break;
+		default:
+			return NULL;
+	}
+
+	switch (cfg->affinity) {
+		case DATA_MOVER_THREADS_AFFINITY_NONE:
+		case DATA_MOVER_THREADS_AFFINITY_COMPACT:
+		case DATA_MOVER_THREADS_AFFINITY_SCATTER:
+		case DATA_MOVER_THREADS_AFFINITY_PHYSICAL_CORES:
+		case DATA_MOVER_THREADS_AFFINITY_AVOID_SMT:
+			break;
+		default:
+			return NULL;
+	}
+
+	switch (cfg->wait_policy) {
+		case DATA_MOVER_THREADS_WAIT_BLOCK:
+		case DATA_MOVER_THREADS_WAIT_SPIN_THEN_PARK:
+		case DATA_MOVER_THREADS_WAIT_BUSY_POLL:
+			break;
+		default:
+			return NULL;
+	}
+
+	struct data_mover_threads *dmt_threads =
+		malloc(sizeof(struct data_mover_threads));
+	if (dmt_threads == NULL)
+		goto data_failed;
+
+	dmt_threads->desired_notifier = cfg->desired_notifier;
+	dmt_threads->base = data_mover_threads_vdm;
+	dmt_threads->op_fns = op_fns_default;
+	dmt_threads->chunk_size = DATA_MOVER_THREADS_DEFAULT_CHUNK_SIZE;
+	dmt_threads->inline_threshold = 0;
+	dmt_threads->nt_threshold = memops_nt_threshold();
+	dmt_threads->priority_quota = DATA_MOVER_THREADS_DEFAULT_PRIORITY_QUOTA;
+	dmt_threads->placement = cfg->placement;
+	dmt_threads->next_queue = 0;
+	dmt_threads->min_nthreads = cfg->nthreads;
+	dmt_threads->nactive = 0;
+	dmt_threads->grow_threshold = MAX(cfg->grow_threshold, 1);
+	dmt_threads->grow_delay_ns = cfg->grow_delay * 1000000;
+	dmt_threads->over_since_ns = 0;
+	dmt_threads->idle_timeout = cfg->idle_timeout;
+	dmt_threads->wait_policy = cfg->wait_policy;
+	dmt_threads->spin_count = cfg->spin_count;
+	dmt_threads->nparked = 0;
+	dmt_threads->running = 1;
+	memset(dmt_threads->node_cache, 0, sizeof(dmt_threads->node_cache));
+
+	/*
+	 * The topology is needed to pin the workers to cpus and to size
+	 * the pool by the number of cpus.
+	 */
+	struct topology *topo = NULL;
+	struct topology_cpu *cpus = NULL;
+	size_t ncpus = 0;
+	int pin = cfg->affinity != DATA_MOVER_THREADS_AFFINITY_NONE ||
+		cfg->ncpus != 0 || cfg->numa_aware;
+	if (pin || cfg->max_nthreads == 0) {
+		topo = topology_new();
+		if (topo == NULL)
+			goto topology_failed;
+
+		cpus = malloc(sizeof(struct topology_cpu) * topo->ncpus);
+		if (cpus == NULL)
+			goto cpus_failed;
+
+		ncpus = data_mover_threads_cpus(cfg, topo, cpus);
+		if (ncpus == 0)
+			goto groups_failed;
+	}
+
+	dmt_threads->nthreads = cfg->max_nthreads != 0 ? cfg->max_nthreads :
+		MAX(cfg->nthreads, ncpus);
+	if (!pin)
+		ncpus = 0;
+
+	if (data_mover_threads_groups(dmt_threads, cfg, cpus, ncpus) != 0)
+		goto groups_failed;
+
+	/*
+	 * Only workers sharing a single queue can come and go freely,
+	 * the others own a queue or serve a numa node. Busy polling workers
+	 * are never idle.
+	 */
+	dmt_threads->elastic = dmt_threads->nthreads > cfg->nthreads &&
+		dmt_threads->nqueues == 1 &&
+		cfg->wait_policy != DATA_MOVER_THREADS_WAIT_BUSY_POLL;
+	if (!dmt_threads->elastic)
+		dmt_threads->min_nthreads = dmt_threads->nthreads;
+
+	dmt_threads->queues = malloc(sizeof(struct ringbuf *) *
+		dmt_threads->nqueues);
+	if (dmt_threads->queues == NULL)
+		goto queues_array_failed;
+
+	size_t q;
+	for (q = 0; q < dmt_threads->nqueues; ++q) {
+		dmt_threads->queues[q] =
+			ringbuf_new((unsigned)cfg->ringbuf_size);
+		if (dmt_threads->queues[q] == NULL)
+			goto ringbuf_failed;
+	}
+
+	dmt_threads->priority_queue = ringbuf_new((unsigned)cfg->ringbuf_size);
+	if (dmt_threads->priority_queue == NULL)
+		goto ringbuf_failed;
+
+	/* the overflow queue grows by segments as large as a ringbuf */
+	dmt_threads->overflow = NULL;
+	if (cfg->overflow_size != 0) {
+		size_t segment_size = cfg->ringbuf_size * sizeof(void *);
+		dmt_threads->overflow = segqueue_new(cfg->ringbuf_size,
+			MAX(cfg->overflow_size / segment_size, 1));
+		if (dmt_threads->overflow == NULL)
+			goto priority_failed;
+	}
+
+	if (os_tls_key_create(&dmt_threads->queue_key, NULL) != 0)
+		goto overflow_failed;
+
+	/* data of all operations is of the same size, freed in any order */
+	dmt_threads->membuf = membuf_new_ext(dmt_threads, MEMBUF_MODE_SLAB);
+	if (dmt_threads->membuf == NULL)
+		goto membuf_failed;
+	membuf_set_pages(dmt_threads->membuf,
+		data_mover_threads_membuf_pages(cfg->pages), cfg->prefault);
+	membuf_set_max_threadbufs(dmt_threads->membuf, cfg->max_buffers);
+
+	dmt_threads->workers = malloc(sizeof(struct data_mover_threads_worker)
+		* dmt_threads->nthreads);
+	if (dmt_threads->workers == NULL)
+		goto threads_array_failed;
+
+	for (size_t g = 0; g < dmt_threads->ngroups; ++g) {
+		struct data_mover_threads_group *group =
+			&dmt_threads->groups[g];
+		for (size_t w = 0; w < group->nworkers; ++w) {
+			struct data_mover_threads_worker *worker =
+				&dmt_threads->workers[group->first_worker + w];
+			worker->dmt = dmt_threads;
+			worker->state = DATA_MOVER_THREADS_WORKER_NONE;
+			worker->group = g;
+			worker->priority_streak = 0;
+			worker->parked = 0;
+			memset(&worker->stats, 0, sizeof(worker->stats));
+			worker->queue = group->first_queue +
+				w % group->nqueues;
+		}
+	}
+
+	data_mover_threads_affinity(dmt_threads, cfg, cpus, ncpus);
+
+	util_mutex_init(&dmt_threads->pool_lock);
+
+	/* the workers above the minimum are started on demand */
+	for (size_t i = 0; i < dmt_threads->min_nthreads; i++) {
+		if (data_mover_threads_worker_start(
+				&dmt_threads->workers[i]) != 0) {
+			data_mover_threads_stop(dmt_threads);
+			goto threads_failed;
+		}
+		dmt_threads->nactive++;
 	}
-	free(dmt->threads);
+
+	free(cpus);
+	if (topo != NULL)
+		topology_delete(topo);
+
+	return dmt_threads;
+
+threads_failed:
+	util_mutex_destroy(&dmt_threads->pool_lock);
+	free(dmt_threads->workers);
+
+threads_array_failed:
+	membuf_delete(dmt_threads->membuf);
+
+membuf_failed:
+	os_tls_key_delete(dmt_threads->queue_key);
+
+overflow_failed:
+	if (dmt_threads->overflow != NULL)
+		segqueue_delete(dmt_threads->overflow);
+
+priority_failed:
+	ringbuf_delete(dmt_threads->priority_queue);
+
+ringbuf_failed:
+	while (q-- > 0)
+		ringbuf_delete(dmt_threads->queues[q]);
+	free(dmt_threads->queues);
+
+queues_array_failed:
+	free(dmt_threads->groups);
+
+groups_failed:
+	free(cpus);
+
+cpus_failed:
+	if (topo != NULL)
+		topology_delete(topo);
+
+topology_failed:
+	free(dmt_threads);
+
+data_failed:
+	return NULL;
+}
+
+/*
+ * data_mover_threads_new -- creates a new data mover instance that's uses
+ * worker threads for memory operations
+ */
+struct data_mover_threads *
+data_mover_threads_new(size_t nthreads, size_t ringbuf_size,
+	enum future_notifier_type desired_notifier)
+{
+	struct data_mover_threads_config cfg = config_default;
+	cfg.nthreads = nthreads;
+	cfg.max_nthreads = nthreads;
+	cfg.ringbuf_size = ringbuf_size;
+	cfg.desired_notifier = desired_notifier;
+
+	return data_mover_threads_new_ext(&cfg);
+}
+
+/*
+ * data_mover_threads_default -- creates a new data mover instance with
+ * default parameters
+ */
+struct data_mover_threads *
+data_mover_threads_default()
+{
+	return data_mover_threads_new_ext(&config_default);
+}
+
+/*
+ * data_mover_threads_get_vdm -- returns the vdm operations for the mover
+ */
+struct vdm *
+data_mover_threads_get_vdm(struct data_mover_threads *dmt)
+{
+	return &dmt->base;
+}
+
+/*
+ * data_mover_threads_register_thread -- sets up the buffer of operation data
+ * of the calling thread, so that it's not done on its first operation
+ */
+int
+data_mover_threads_register_thread(struct data_mover_threads *dmt)
+{
+	return membuf_register_thread(dmt->membuf);
+}
+
+/*
+ * data_mover_threads_get_nthreads -- returns the number of worker threads
+ * that are currently running
+ */
+size_t
+data_mover_threads_get_nthreads(struct data_mover_threads *dmt)
+{
+	uint64_t nactive;
+	util_atomic_load_explicit64(&dmt->nactive, &nactive,
+		memory_order_relaxed);
+
+	return (size_t)nactive;
+}
+
+/*
+ * data_mover_threads_get_worker_stats -- reads the wait statistics of one of
+ * the worker threads, fails if there's no such worker
+ */
+int
+data_mover_threads_get_worker_stats(struct data_mover_threads *dmt,
+	size_t worker, struct data_mover_threads_worker_stats *stats)
+{
+	if (worker >= dmt->nthreads)
+		return -1;
+
+	struct data_mover_threads_worker_stats *wstats =
+		&dmt->workers[worker].stats;
+	util_atomic_load_explicit64(&wstats->spins, &stats->spins,
+		memory_order_relaxed);
+	util_atomic_load_explicit64(&wstats->parks, &stats->parks,
+		memory_order_relaxed);
+	util_atomic_load_explicit64(&wstats->wakeups, &stats->wakeups,
+		memory_order_relaxed);
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_delete -- perform necessary cleanup after threads mover.
+ * Releases all memory and closes all created threads.
+ */
+void
+data_mover_threads_delete(struct data_mover_threads *dmt)
+{
+	data_mover_threads_stop(dmt);
+	util_mutex_destroy(&dmt->pool_lock);
+	free(dmt->workers);
 	membuf_delete(dmt->membuf);
-	ringbuf_delete(dmt->buf);
+	os_tls_key_delete(dmt->queue_key);
+	if (dmt->overflow != NULL)
+		segqueue_delete(dmt->overflow);
+	ringbuf_delete(dmt->priority_queue);
+	for (size_t q = 0; q < dmt->nqueues; ++q)
+		ringbuf_delete(dmt->queues[q]);
+	free(dmt->queues);
+	free(dmt->groups);
 	free(dmt);
 }
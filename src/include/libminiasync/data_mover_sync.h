@@ -18,6 +18,9 @@ struct vdm *data_mover_sync_get_vdm(struct data_mover_sync *dms);
 
 void data_mover_sync_delete(struct data_mover_sync *dms);
 
+void data_mover_sync_set_nt_threshold(struct data_mover_sync *dms,
+	size_t nt_threshold);
+
 #ifdef __cplusplus
 }
 #endif
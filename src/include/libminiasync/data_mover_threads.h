@@ -17,9 +17,128 @@ typedef void *(*memmove_fn)(void *dst, const void *src,
 typedef void *(*memset_fn)(void *str, int c, size_t n,
 				unsigned flags);
 
+/*
+ * Scheduling modes of the threads data mover:
+ * - SHARED: all workers take operations from a single shared queue,
+ * - WORK_STEALING: each worker has its own queue and steals operations from
+ *	the queues of other workers once its own queue is empty.
+ */
+enum data_mover_threads_scheduling {
+	DATA_MOVER_THREADS_SCHEDULING_SHARED,
+	DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING,
+};
+
+/*
+ * Placement of new operations in per-worker queues:
+ * - ROUND_ROBIN: each operation goes to the next queue,
+ * - LOCAL: all operations from a submitting thread go to the same queue.
+ */
+enum data_mover_threads_placement {
+	DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN,
+	DATA_MOVER_THREADS_PLACEMENT_LOCAL,
+};
+
+/*
+ * Pinning of worker threads to cpus:
+ * - NONE: workers may run on any of the allowed cpus,
+ * - COMPACT: workers are packed onto neighbouring cpus, SMT siblings of
+ *	a core and cores of a package are filled first,
+ * - SCATTER: workers are spread evenly across packages and cores,
+ * - PHYSICAL_CORES: one worker per physical core, SMT siblings are used
+ *	only once every core has a worker,
+ * - AVOID_SMT: one worker per physical core, SMT siblings and the core
+ *	of the thread creating the mover are left unused.
+ * If there are more workers than cpus, the cpus are reused in the same order.
+ */
+enum data_mover_threads_affinity {
+	DATA_MOVER_THREADS_AFFINITY_NONE,
+	DATA_MOVER_THREADS_AFFINITY_COMPACT,
+	DATA_MOVER_THREADS_AFFINITY_SCATTER,
+	DATA_MOVER_THREADS_AFFINITY_PHYSICAL_CORES,
+	DATA_MOVER_THREADS_AFFINITY_AVOID_SMT,
+};
+
+/*
+ * Ways in which idle worker threads wait for new operations:
+ * - BLOCK: the worker blocks on its queue right away,
+ * - SPIN_THEN_PARK: the worker polls the queues a number of times before
+ *	it blocks, which avoids the cost of waking it up under steady load,
+ * - BUSY_POLL: the worker never blocks, meant for dedicated, isolated cores.
+ */
+enum data_mover_threads_wait_policy {
+	DATA_MOVER_THREADS_WAIT_BLOCK,
+	DATA_MOVER_THREADS_WAIT_SPIN_THEN_PARK,
+	DATA_MOVER_THREADS_WAIT_BUSY_POLL,
+};
+
+/*
+ * Memory backing the per-thread buffers of operation data:
+ * - DEFAULT: regular heap memory,
+ * - TRANSPARENT_HUGE: memory advised to be backed by transparent huge pages,
+ * - HUGETLB: reserved huge pages, transparent ones once they run out.
+ */
+enum data_mover_threads_pages {
+	DATA_MOVER_THREADS_PAGES_DEFAULT,
+	DATA_MOVER_THREADS_PAGES_TRANSPARENT_HUGE,
+	DATA_MOVER_THREADS_PAGES_HUGETLB,
+};
+
+struct data_mover_threads_worker_stats {
+	uint64_t spins; /* polls of the queues that found no operation */
+	uint64_t parks; /* times the worker blocked waiting for an operation */
+	uint64_t wakeups; /* times a blocked worker received an operation */
+};
+
+struct data_mover_threads_config;
+struct data_mover_threads_config *data_mover_threads_config_new(void);
+void data_mover_threads_config_delete(struct data_mover_threads_config *cfg);
+void data_mover_threads_config_set_nthreads(
+	struct data_mover_threads_config *cfg, size_t nthreads);
+void data_mover_threads_config_set_nthreads_range(
+	struct data_mover_threads_config *cfg, size_t min_nthreads,
+	size_t max_nthreads);
+void data_mover_threads_config_set_grow_threshold(
+	struct data_mover_threads_config *cfg, size_t grow_threshold);
+void data_mover_threads_config_set_grow_delay(
+	struct data_mover_threads_config *cfg, uint64_t grow_delay);
+void data_mover_threads_config_set_idle_timeout(
+	struct data_mover_threads_config *cfg, uint64_t idle_timeout);
+void data_mover_threads_config_set_ringbuf_size(
+	struct data_mover_threads_config *cfg, size_t ringbuf_size);
+void data_mover_threads_config_set_overflow_size(
+	struct data_mover_threads_config *cfg, size_t overflow_size);
+void data_mover_threads_config_set_notifier(
+	struct data_mover_threads_config *cfg,
+	enum future_notifier_type desired_notifier);
+void data_mover_threads_config_set_scheduling(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_scheduling scheduling);
+void data_mover_threads_config_set_placement(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_placement placement);
+void data_mover_threads_config_set_affinity(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_affinity affinity);
+int data_mover_threads_config_set_cpus(struct data_mover_threads_config *cfg,
+	const size_t *cpus, size_t ncpus);
+void data_mover_threads_config_set_numa_aware(
+	struct data_mover_threads_config *cfg, int numa_aware);
+void data_mover_threads_config_set_wait_policy(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_wait_policy wait_policy);
+void data_mover_threads_config_set_spin_count(
+	struct data_mover_threads_config *cfg, uint64_t spin_count);
+void data_mover_threads_config_set_pages(
+	struct data_mover_threads_config *cfg,
+	enum data_mover_threads_pages pages, int prefault);
+void data_mover_threads_config_set_max_buffers(
+	struct data_mover_threads_config *cfg, size_t max_buffers);
+
 struct data_mover_threads;
 struct data_mover_threads *data_mover_threads_new(size_t nthreads,
 	size_t ringbuf_size, enum future_notifier_type desired_notifier);
+struct data_mover_threads *data_mover_threads_new_ext(
+	const struct data_mover_threads_config *cfg);
 struct data_mover_threads *data_mover_threads_default();
 struct vdm *data_mover_threads_get_vdm(struct data_mover_threads *dmt);
 void data_mover_threads_delete(struct data_mover_threads *dmt);
@@ -29,6 +148,18 @@ void data_mover_threads_set_memmove_fn(struct data_mover_threads *dmt,
 	memmove_fn op_memmove);
 void data_mover_threads_set_memset_fn(struct data_mover_threads *dmt,
 	memset_fn op_memset);
+void data_mover_threads_set_chunk_size(struct data_mover_threads *dmt,
+	size_t chunk_size);
+void data_mover_threads_set_inline_threshold(struct data_mover_threads *dmt,
+	size_t inline_threshold);
+void data_mover_threads_set_nt_threshold(struct data_mover_threads *dmt,
+	size_t nt_threshold);
+void data_mover_threads_set_priority_quota(struct data_mover_threads *dmt,
+	size_t priority_quota);
+int data_mover_threads_register_thread(struct data_mover_threads *dmt);
+size_t data_mover_threads_get_nthreads(struct data_mover_threads *dmt);
+int data_mover_threads_get_worker_stats(struct data_mover_threads *dmt,
+	size_t worker, struct data_mover_threads_worker_stats *stats);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2021, Intel Corporation */
+/* Copyright 2021-2022, Intel Corporation */
 
 /*
  * runtime.h - public definitions for a simple implementation of an asynchronous
@@ -12,7 +12,11 @@
  *
  * This implementation also provides a simple waker for futures that support it.
  * This means that the runtime will context switch if no futures can
- * make progress. There's no support for multi-threaded task scheduling.
+ * make progress.
+ *
+ * A runtime can also own a pool of executor threads, which poll the futures
+ * handed over to them with runtime_spawn. Each executor has its own run queue
+ * and steals futures from the other ones once its queue is empty.
  */
 
 #ifndef RUNTIME_H
@@ -25,10 +29,55 @@ extern "C" {
 #endif
 
 struct runtime;
+struct runtime_config;
+struct runtime_task;
+
+/*
+ * Ways in which a thread waiting for futures behaves once they can't make
+ * progress:
+ * - BLOCK: the thread goes to sleep right after each pass over the futures,
+ * - HYBRID: the thread polls the futures a number of times before it goes
+ *	to sleep,
+ * - BUSY_POLL: the thread never sleeps, meant for dedicated, isolated cores,
+ * - ADAPTIVE: the thread polls the futures for as long as it usually takes
+ *	one of them to complete, if that's short, and goes to sleep otherwise.
+ */
+enum runtime_wait_policy {
+	RUNTIME_WAIT_BLOCK,
+	RUNTIME_WAIT_HYBRID,
+	RUNTIME_WAIT_BUSY_POLL,
+	RUNTIME_WAIT_ADAPTIVE,
+};
+
+struct runtime_join_data {
+	struct runtime_task *task;
+};
+
+struct runtime_join_output {
+	struct future *fut; /* the spawned future */
+};
+
+FUTURE(runtime_join_future, struct runtime_join_data,
+	struct runtime_join_output);
+
+struct runtime_config *runtime_config_new(void);
+void runtime_config_delete(struct runtime_config *cfg);
+void runtime_config_set_nthreads(struct runtime_config *cfg, size_t nthreads);
+void runtime_config_set_wait_policy(struct runtime_config *cfg,
+	enum runtime_wait_policy wait_policy);
+void runtime_config_set_spin_count(struct runtime_config *cfg,
+	uint64_t spin_count);
+void runtime_config_set_sleep_time(struct runtime_config *cfg,
+	uint64_t sleep_time_ns);
 
 struct runtime *runtime_new(void);
+struct runtime *runtime_new_ext(const struct runtime_config *cfg);
 void runtime_delete(struct runtime *runtime);
 
+struct runtime_task *runtime_spawn(struct runtime *runtime,
+	struct future *fut);
+struct runtime_join_future runtime_join(struct runtime_task *task);
+
 void runtime_wait_multiple(struct runtime *runtime, struct future *futs[],
 			size_t nfuts);
 
@@ -132,6 +132,20 @@ typedef void (*vdm_operation_delete)(void *data,
 	const struct vdm_operation *operation,
 	struct vdm_operation_output *output);
 
+typedef void (*vdm_operation_init)(struct vdm *vdm,
+	const enum vdm_operation_type type, void *state);
+typedef uint64_t *(*vdm_operation_monitor)(void *data);
+
+typedef void *(*vdm_batch_new)(struct vdm *vdm, size_t noperations);
+typedef int (*vdm_batch_start)(void *data,
+	const struct vdm_operation *operations, size_t noperations,
+	struct future_notifier *n);
+typedef enum future_state (*vdm_batch_check)(void *data,
+	const struct vdm_operation *operations, size_t noperations);
+typedef void (*vdm_batch_delete)(void *data,
+	const struct vdm_operation *operations, size_t noperations,
+	struct vdm_operation_output *outputs);
+
 struct vdm {
 	vdm_operation_new op_new;
 	vdm_operation_delete op_delete;
@@ -139,11 +153,57 @@ struct vdm {
 	vdm_operation_check op_check;
 	unsigned capabilities;
 	future_has_property_fn has_property;
+
+	/*
+	 * Optional, movers which don't implement batches execute
+	 * the operations of a batch one by one.
+	 */
+	vdm_batch_new op_batch_new;
+	vdm_batch_delete op_batch_delete;
+	vdm_batch_start op_batch_start;
+	vdm_batch_check op_batch_check;
+
+	/*
+	 * Optional, movers which can keep the state of an operation in
+	 * memory provided by the caller declare its size and initialize it
+	 * with op_init instead of allocating it with op_new. Movers which
+	 * must own that memory leave the size 0.
+	 */
+	size_t op_state_size;
+	vdm_operation_init op_init;
+
+	/*
+	 * Optional, returns the word which changes once the operation or
+	 * the batch, whose state is given, completes or NULL if the poller
+	 * isn't used for it. The word is reported to the caller on each
+	 * poll of a pending future, it's valid only until the next one.
+	 */
+	vdm_operation_monitor op_monitor;
 };
 
+/* memory of the state of an operation provided by the caller is aligned */
+#define VDM_OPERATION_STATE_ALIGNMENT 64
+
 struct vdm *vdm_synchronous_new(void);
 void vdm_synchronous_delete(struct vdm *vdm);
 
+/*
+ * vdm_notify_poller -- (internal) reports the word monitored by the mover
+ * for the pending operation or batch, if there's any
+ */
+static inline void
+vdm_notify_poller(struct vdm *vdm, void *data, struct future_notifier *n)
+{
+	if (n == NULL || vdm->op_monitor == NULL)
+		return;
+
+	uint64_t *word = vdm->op_monitor(data);
+	if (word != NULL) {
+		n->notifier_used = FUTURE_NOTIFIER_POLLER;
+		n->poller.ptr_to_monitor = word;
+	}
+}
+
 /*
  * vdm_operation_impl -- the poll implementation for a generic vdm operation
  * The operation lifecycle is as follows:
@@ -172,6 +232,8 @@ vdm_operation_impl(struct future_context *context, struct future_notifier *n)
 				future_context_get_output(context);
 		vdm->op_delete(fdata->data, &fdata->operation, output);
 		/* variable data is no longer valid! */
+	} else {
+		vdm_notify_poller(vdm, fdata->data, n);
 	}
 
 	return state;
@@ -179,7 +241,9 @@ vdm_operation_impl(struct future_context *context, struct future_notifier *n)
 
 #define VDM_F_MEM_DURABLE		(1U << 0)
 #define VDM_F_NO_CACHE_HINT		(1U << 1)
-#define VDM_F_VALID_FLAGS	(VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT)
+#define VDM_F_PRIORITY			(1U << 2)
+#define VDM_F_VALID_FLAGS	(VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT | \
+	VDM_F_PRIORITY)
 
 /*
  * vdm_is_supported -- returns if the given flag or feature is supported
@@ -187,7 +251,7 @@ vdm_operation_impl(struct future_context *context, struct future_notifier *n)
 static inline int
 vdm_is_supported(struct vdm *vdm, unsigned capability)
 {
-	return (vdm->capabilities && capability) == capability;
+	return (vdm->capabilities & capability) == capability;
 }
 
 /*
@@ -203,16 +267,34 @@ vdm_set_has_property_fn(struct vdm_operation_future *future,
 }
 
 /*
- * vdm_generic_operation -- creates a new vdm future for a given generic
- * operation
+ * vdm_operation_state_size -- returns the size of the memory for the state
+ * of an operation that the caller can provide, 0 if the mover allocates it
+ */
+static inline size_t
+vdm_operation_state_size(struct vdm *vdm)
+{
+	return vdm->op_init != NULL ? vdm->op_state_size : 0;
+}
+
+/*
+ * vdm_generic_operation_state -- creates a new vdm future for a given generic
+ * operation, its state is kept in the memory provided by the caller, if there
+ * is any and the mover supports it, or allocated by the mover otherwise
  */
 static inline void
-vdm_generic_operation(struct vdm *vdm, struct vdm_operation_future *future)
+vdm_generic_operation_state(struct vdm *vdm,
+	struct vdm_operation_future *future, void *state)
 {
 	future->data.vdm = vdm;
-	if ((future->data.data =
-			vdm->op_new(vdm, future->data.operation.type))
-			== NULL) {
+	if (state != NULL && vdm_operation_state_size(vdm) != 0) {
+		vdm->op_init(vdm, future->data.operation.type, state);
+		future->data.data = state;
+	} else {
+		future->data.data =
+			vdm->op_new(vdm, future->data.operation.type);
+	}
+
+	if (future->data.data == NULL) {
 		future->output.result = VDM_ERROR_OUT_OF_MEMORY;
 		FUTURE_INIT_COMPLETE(future);
 	} else {
@@ -227,11 +309,22 @@ vdm_generic_operation(struct vdm *vdm, struct vdm_operation_future *future)
 }
 
 /*
- * vdm_memcpy -- instantiates a new memcpy vdm operation and returns a new
- * future to represent that operation
+ * vdm_generic_operation -- creates a new vdm future for a given generic
+ * operation
+ */
+static inline void
+vdm_generic_operation(struct vdm *vdm, struct vdm_operation_future *future)
+{
+	vdm_generic_operation_state(vdm, future, NULL);
+}
+
+/*
+ * vdm_memcpy_state -- instantiates a new memcpy vdm operation which keeps its
+ * state in the given memory and returns a new future to represent it
  */
 static inline struct vdm_operation_future
-vdm_memcpy(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+vdm_memcpy_state(struct vdm *vdm, void *dest, void *src, size_t n,
+	uint64_t flags, void *state)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_MEMCPY;
@@ -244,16 +337,27 @@ vdm_memcpy(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
 	future.output.result = VDM_SUCCESS;
 	future.output.output.memcpy.dest = NULL;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_state(vdm, &future, state);
 	return future;
 }
 
 /*
- * vdm_memmove -- instantiates a new memmove vdm operation and returns a new
+ * vdm_memcpy -- instantiates a new memcpy vdm operation and returns a new
  * future to represent that operation
  */
 static inline struct vdm_operation_future
-vdm_memmove(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+vdm_memcpy(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+{
+	return vdm_memcpy_state(vdm, dest, src, n, flags, NULL);
+}
+
+/*
+ * vdm_memmove_state -- instantiates a new memmove vdm operation which keeps
+ * its state in the given memory and returns a new future to represent it
+ */
+static inline struct vdm_operation_future
+vdm_memmove_state(struct vdm *vdm, void *dest, void *src, size_t n,
+	uint64_t flags, void *state)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_MEMMOVE;
@@ -266,16 +370,27 @@ vdm_memmove(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
 	future.output.result = VDM_SUCCESS;
 	future.output.output.memmove.dest = NULL;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_state(vdm, &future, state);
 	return future;
 }
 
 /*
- * vdm_memset -- instantiates a new memset vdm operation and returns a new
+ * vdm_memmove -- instantiates a new memmove vdm operation and returns a new
  * future to represent that operation
  */
 static inline struct vdm_operation_future
-vdm_memset(struct vdm *vdm, void *str, int c, size_t n, uint64_t flags)
+vdm_memmove(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+{
+	return vdm_memmove_state(vdm, dest, src, n, flags, NULL);
+}
+
+/*
+ * vdm_memset_state -- instantiates a new memset vdm operation which keeps its
+ * state in the given memory and returns a new future to represent it
+ */
+static inline struct vdm_operation_future
+vdm_memset_state(struct vdm *vdm, void *str, int c, size_t n,
+	uint64_t flags, void *state)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_MEMSET;
@@ -288,16 +403,27 @@ vdm_memset(struct vdm *vdm, void *str, int c, size_t n, uint64_t flags)
 	future.output.result = VDM_SUCCESS;
 	future.output.output.memset.str = NULL;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_state(vdm, &future, state);
 	return future;
 }
 
 /*
- * vdm_flush -- instantiates a new flush vdm operation and returns a new
+ * vdm_memset -- instantiates a new memset vdm operation and returns a new
  * future to represent that operation
  */
 static inline struct vdm_operation_future
-vdm_flush(struct vdm *vdm, void *dest, size_t n, uint64_t flags)
+vdm_memset(struct vdm *vdm, void *str, int c, size_t n, uint64_t flags)
+{
+	return vdm_memset_state(vdm, str, c, n, flags, NULL);
+}
+
+/*
+ * vdm_flush_state -- instantiates a new flush vdm operation which keeps its
+ * state in the given memory and returns a new future to represent it
+ */
+static inline struct vdm_operation_future
+vdm_flush_state(struct vdm *vdm, void *dest, size_t n, uint64_t flags,
+	void *state)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_FLUSH;
@@ -308,7 +434,180 @@ vdm_flush(struct vdm *vdm, void *dest, size_t n, uint64_t flags)
 	future.output.type = VDM_OPERATION_FLUSH;
 	future.output.result = VDM_SUCCESS;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_state(vdm, &future, state);
+	return future;
+}
+
+/*
+ * vdm_flush -- instantiates a new flush vdm operation and returns a new
+ * future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_flush(struct vdm *vdm, void *dest, size_t n, uint64_t flags)
+{
+	return vdm_flush_state(vdm, dest, n, flags, NULL);
+}
+
+struct vdm_batch_data {
+	struct vdm *vdm;
+	void *data; /* batch of the mover, NULL if it doesn't support them */
+	const struct vdm_operation *operations;
+	struct vdm_operation_output *outputs;
+	size_t noperations;
+	size_t next; /* operation in progress if the mover has no batches */
+	void *op_data;
+	int op_started;
+};
+
+struct vdm_batch_output {
+	/* VDM_SUCCESS or the result of the first operation that failed */
+	enum vdm_operation_result result;
+};
+
+FUTURE(vdm_batch_future, struct vdm_batch_data, struct vdm_batch_output);
+
+/*
+ * vdm_batch_result -- (internal) returns the result of the first operation
+ * of the batch that failed
+ */
+static inline enum vdm_operation_result
+vdm_batch_result(const struct vdm_operation_output *outputs,
+	size_t noperations)
+{
+	for (size_t i = 0; i < noperations; ++i) {
+		if (outputs[i].result != VDM_SUCCESS)
+			return outputs[i].result;
+	}
+
+	return VDM_SUCCESS;
+}
+
+/*
+ * vdm_batch_step -- (internal) executes the operations of a batch one by one
+ * on a mover which doesn't support batches
+ */
+static inline enum future_state
+vdm_batch_step(struct vdm_batch_data *fdata, struct future_notifier *n)
+{
+	struct vdm *vdm = fdata->vdm;
+
+	while (fdata->next < fdata->noperations) {
+		const struct vdm_operation *op =
+			&fdata->operations[fdata->next];
+		struct vdm_operation_output *output =
+			&fdata->outputs[fdata->next];
+
+		if (fdata->op_data == NULL) {
+			fdata->op_data = vdm->op_new(vdm, op->type);
+			if (fdata->op_data == NULL) {
+				output->type = op->type;
+				output->result = VDM_ERROR_OUT_OF_MEMORY;
+				fdata->next++;
+				continue;
+			}
+			fdata->op_started = 0;
+		}
+
+		/* the mover is busy, retry on next poll */
+		if (!fdata->op_started &&
+				vdm->op_start(fdata->op_data, op, n) != 0)
+			return FUTURE_STATE_RUNNING;
+
+		enum future_state state = vdm->op_check(fdata->op_data, op);
+		/* the mover could've left the operation idle, e.g. if full */
+		if (state == FUTURE_STATE_IDLE && !fdata->op_started)
+			return FUTURE_STATE_RUNNING;
+		fdata->op_started = 1;
+
+		if (state != FUTURE_STATE_COMPLETE) {
+			vdm_notify_poller(vdm, fdata->op_data, n);
+			return FUTURE_STATE_RUNNING;
+		}
+
+		vdm->op_delete(fdata->op_data, op, output);
+		fdata->op_data = NULL;
+		fdata->next++;
+	}
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * vdm_batch_impl -- the poll implementation for a batch of vdm operations
+ */
+static inline enum future_state
+vdm_batch_impl(struct future_context *context, struct future_notifier *n)
+{
+	struct vdm_batch_data *fdata =
+		(struct vdm_batch_data *)future_context_get_data(context);
+	struct vdm_batch_output *output =
+		(struct vdm_batch_output *)future_context_get_output(context);
+	struct vdm *vdm = fdata->vdm;
+	enum future_state state;
+
+	if (fdata->data == NULL) {
+		state = vdm_batch_step(fdata, n);
+	} else {
+		if (context->state == FUTURE_STATE_IDLE) {
+			if (vdm->op_batch_start(fdata->data, fdata->operations,
+					fdata->noperations, n) != 0)
+				return FUTURE_STATE_IDLE;
+		}
+
+		state = vdm->op_batch_check(fdata->data, fdata->operations,
+			fdata->noperations);
+		if (state == FUTURE_STATE_COMPLETE) {
+			vdm->op_batch_delete(fdata->data, fdata->operations,
+				fdata->noperations, fdata->outputs);
+			/* variable data is no longer valid! */
+		} else {
+			vdm_notify_poller(vdm, fdata->data, n);
+		}
+	}
+
+	if (state == FUTURE_STATE_COMPLETE)
+		output->result = vdm_batch_result(fdata->outputs,
+			fdata->noperations);
+
+	return state;
+}
+
+/*
+ * vdm_batch -- instantiates a new future which executes all of the operations
+ * and completes once all of them are finished. The result of each operation
+ * is stored in the outputs array. Both arrays have to stay valid until
+ * the future is complete.
+ */
+static inline struct vdm_batch_future
+vdm_batch(struct vdm *vdm, const struct vdm_operation *operations,
+	struct vdm_operation_output *outputs, size_t noperations)
+{
+	struct vdm_batch_future future;
+	future.data.vdm = vdm;
+	future.data.data = NULL;
+	future.data.operations = operations;
+	future.data.outputs = outputs;
+	future.data.noperations = noperations;
+	future.data.next = 0;
+	future.data.op_data = NULL;
+	future.data.op_started = 0;
+	future.output.result = VDM_SUCCESS;
+
+	if (vdm->op_batch_new != NULL && (future.data.data =
+			vdm->op_batch_new(vdm, noperations)) == NULL) {
+		for (size_t i = 0; i < noperations; ++i) {
+			outputs[i].type = operations[i].type;
+			outputs[i].result = VDM_ERROR_OUT_OF_MEMORY;
+		}
+		future.output.result = VDM_ERROR_OUT_OF_MEMORY;
+		FUTURE_INIT_COMPLETE(&future);
+	} else {
+		FUTURE_INIT(&future, vdm_batch_impl);
+	}
+
+	if (vdm->has_property != NULL)
+		future.base.has_property = vdm->has_property;
+
 	return future;
 }
 
@@ -4,133 +4,1154 @@
 #include <stdlib.h>
 
 #include "libminiasync/runtime.h"
+#include "core/monitor.h"
 #include "core/os_thread.h"
 #include "core/os.h"
+#include "core/ringbuf.h"
+#include "core/sys_util.h"
 #include "core/util.h"
 
-struct runtime_waker_data {
-	os_cond_t *cond;
-	os_mutex_t *lock;
+/* runtime_wait_multiple doesn't allocate memory for up to this many futures */
+#define RUNTIME_STACK_FUTURES 32
+
+/* length of the run queue of each executor thread */
+#define RUNTIME_QUEUE_LENGTH 1024
+
+/*
+ * A spawned task which can't wake itself up is polled again after this
+ * delay, doubled on each such poll up to the sleep time of the runtime.
+ */
+#define RUNTIME_BACKOFF_MIN_NS 1000ULL
+
+/* rounds of checking the monitored words before the waiting thread parks */
+#define RUNTIME_WATCH_SPINS 4096
+
+/* tsc cycles of a single umwait, the os can cut it shorter */
+#define RUNTIME_UMWAIT_CYCLES 100000ULL
+
+/*
+ * The adaptive policy polls only if futures usually complete within this
+ * time, waiting any longer costs more than going to sleep and waking up.
+ */
+#define RUNTIME_ADAPTIVE_MAX_SPIN_NS 200000ULL
+
+/* weight of a new sample in the average time of waiting for a completion */
+#define RUNTIME_ADAPTIVE_SHIFT 3
+
+/*
+ * The state of a thread waiting for futures, the waker passed to the futures
+ * bumps the epoch and wakes the thread up only if it's parked on the epoch.
+ */
+struct runtime_waiter {
+	struct future_notifier notifier;
+	uint32_t epoch;
+	uint32_t nparked;
+	uint32_t pass_epoch; /* the epoch seen before the current pass */
+	int timed; /* a pending future might not wake the thread up */
+	size_t nmonitored; /* pending futures with a word to monitor */
 };
 
+/*
+ * runtime_waker_wake -- the waker of the futures the runtime waits for
+ */
 static void
 runtime_waker_wake(void *fdata)
 {
-	struct runtime_waker_data *data = fdata;
-	os_mutex_lock(data->lock);
-	os_cond_signal(data->cond);
-	os_mutex_unlock(data->lock);
+	struct runtime_waiter *waiter = fdata;
+	util_fetch_and_add32(&waiter->epoch, 1);
+
+	/*
+	 * Pairs with the fence in runtime_sleep, either the waiter sees
+	 * the new epoch or its parking is seen here.
+	 */
+	util_synchronize();
+	uint32_t nparked;
+	util_atomic_load_explicit32(&waiter->nparked, &nparked,
+		memory_order_acquire);
+	if (nparked != 0)
+		util_futex_wake_one(&waiter->epoch);
 }
 
+struct runtime_config {
+	size_t nthreads; /* number of executor threads */
+	enum runtime_wait_policy wait_policy;
+	uint64_t spin_count; /* passes over the futures before sleeping */
+	uint64_t sleep_time_ns; /* if a pending future can't wake it up */
+};
+
+static const struct runtime_config runtime_config_default = {
+	.nthreads = 0,
+	.wait_policy = RUNTIME_WAIT_HYBRID,
+	.spin_count = 1000,
+	.sleep_time_ns = 1000000,
+};
+
+/*
+ * A spawned task is in one of the run queues only while it's queued,
+ * a task waiting for its waker is in none of them.
+ */
+enum runtime_task_state {
+	RUNTIME_TASK_QUEUED,
+	RUNTIME_TASK_POLLING,
+	RUNTIME_TASK_IDLE, /* pending, waits for its waker */
+	RUNTIME_TASK_NOTIFIED, /* woken up while it was being polled */
+};
+
+struct runtime_task {
+	struct future *fut;
+	struct runtime *runtime;
+	size_t executor; /* index of the queue the task goes back to */
+	uint64_t state; /* one of RUNTIME_TASK_* */
+
+	/* used only by the executor which deferred the task */
+	struct runtime_task *next_deferred;
+	uint64_t deadline_ns; /* when the deferred task is queued again */
+	uint64_t backoff_ns; /* the last delay of the task */
+
+	os_mutex_t lock; /* protects the fields below */
+	int complete;
+	struct future_waker joiner; /* waker of the join future, if any */
+};
+
+/*
+ * Queued only to wake up an executor parked on its run queue, once
+ * the runtime stops or a task waits in the queue of a busy one.
+ * It's never polled.
+ */
+static struct runtime_task runtime_wakeup_task;
+
+struct runtime_executor {
+	struct runtime *runtime;
+	size_t idx;
+	struct ringbuf *queue; /* the run queue, other executors steal from */
+	struct runtime_task *deferred; /* tasks which can't wake themselves */
+	uint64_t parked; /* cleared by whoever takes it off the parked ones */
+	os_thread_t thread;
+};
+
 struct runtime {
-	os_cond_t cond;
-	os_mutex_t lock;
+	enum runtime_wait_policy wait_policy;
+	uint64_t spin_count;
+	uint64_t sleep_time_ns; /* if a pending future can't wake it up */
+	uint64_t completion_ns; /* average time of waiting for a completion */
 
-	uint64_t spins_before_sleep;
-	struct timespec cond_wait_time;
+	struct runtime_executor *executors;
+	size_t nexecutors;
+	uint64_t next_executor; /* the one the next spawned task goes to */
+	uint64_t ntasks; /* number of spawned tasks which didn't complete */
+	uint64_t max_tasks; /* so that the run queues never overflow */
+	uint64_t nparked; /* executors parked on their empty run queues */
+	uint64_t stopping; /* no task is polled or queued once it's set */
 };
 
+/*
+ * runtime_deadline -- sets the absolute time (CLOCK_REALTIME) nsec
+ * nanoseconds from now
+ */
+static void
+runtime_deadline(struct timespec *abstime, uint64_t nsec)
+{
+	os_clock_gettime(CLOCK_REALTIME, abstime);
+	nsec += (uint64_t)abstime->tv_nsec;
+	abstime->tv_sec += (time_t)(nsec / 1000000000ULL);
+	abstime->tv_nsec = (long)(nsec % 1000000000ULL);
+}
+
+/*
+ * runtime_now_ns -- returns the monotonic time in nanoseconds
+ */
+static uint64_t
+runtime_now_ns(void)
+{
+	struct timespec now;
+	os_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * runtime_config_new -- creates a runtime configuration with the default
+ * values
+ */
+struct runtime_config *
+runtime_config_new(void)
+{
+	struct runtime_config *cfg = malloc(sizeof(struct runtime_config));
+	if (cfg == NULL)
+		return NULL;
+
+	*cfg = runtime_config_default;
+
+	return cfg;
+}
+
+/*
+ * runtime_config_delete -- deletes a runtime configuration
+ */
+void
+runtime_config_delete(struct runtime_config *cfg)
+{
+	free(cfg);
+}
+
+/*
+ * runtime_config_set_nthreads -- sets the number of executor threads which
+ * run the spawned futures, 0 means that the runtime has none
+ */
+void
+runtime_config_set_nthreads(struct runtime_config *cfg, size_t nthreads)
+{
+	cfg->nthreads = nthreads;
+}
+
+/*
+ * runtime_config_set_wait_policy -- sets the way in which a thread waiting
+ * for futures behaves once they can't make progress
+ */
+void
+runtime_config_set_wait_policy(struct runtime_config *cfg,
+	enum runtime_wait_policy wait_policy)
+{
+	cfg->wait_policy = wait_policy;
+}
+
+/*
+ * runtime_config_set_spin_count -- sets the number of passes over the futures
+ * before a waiting thread goes to sleep with the hybrid policy
+ */
+void
+runtime_config_set_spin_count(struct runtime_config *cfg, uint64_t spin_count)
+{
+	cfg->spin_count = spin_count;
+}
+
+/*
+ * runtime_config_set_sleep_time -- sets the time after which a sleeping
+ * thread polls the futures which can't wake it up
+ */
+void
+runtime_config_set_sleep_time(struct runtime_config *cfg,
+	uint64_t sleep_time_ns)
+{
+	cfg->sleep_time_ns = sleep_time_ns;
+}
+
+/*
+ * runtime_executors_wake -- wakes up one parked executor, other than
+ * the one with the given index, to steal the tasks queued behind another one
+ */
+static void
+runtime_executors_wake(struct runtime *runtime, size_t idx)
+{
+	/*
+	 * Pairs with the increment of nparked in runtime_executor_park,
+	 * either the executor finds the task or it's seen parked here.
+	 */
+	util_synchronize();
+	uint64_t nparked;
+	util_atomic_load_explicit64(&runtime->nparked, &nparked,
+		memory_order_acquire);
+	if (nparked == 0)
+		return;
+
+	for (size_t i = 1; i < runtime->nexecutors; ++i) {
+		struct runtime_executor *executor =
+			&runtime->executors[(idx + i) % runtime->nexecutors];
+		if (!util_bool_compare_and_swap64(&executor->parked, 1, 0))
+			continue;
+
+		util_fetch_and_sub64(&runtime->nparked, 1);
+		ringbuf_tryenqueue(executor->queue, &runtime_wakeup_task);
+		return;
+	}
+}
+
+/*
+ * runtime_task_schedule -- puts the task into the run queue of its executor,
+ * or of any other one if that queue is full
+ */
+static void
+runtime_task_schedule(struct runtime_task *task)
+{
+	struct runtime *runtime = task->runtime;
+
+	/*
+	 * There are never more tasks than the queues can hold together,
+	 * so there's a free slot somewhere.
+	 */
+	for (;;) {
+		/* the queues might be stopped already */
+		uint64_t stopping;
+		util_atomic_load_explicit64(&runtime->stopping, &stopping,
+			memory_order_acquire);
+		if (stopping)
+			return;
+
+		for (size_t i = 0; i < runtime->nexecutors; ++i) {
+			size_t idx = (task->executor + i) % runtime->nexecutors;
+			struct ringbuf *queue = runtime->executors[idx].queue;
+			if (ringbuf_tryenqueue(queue, task) != 0)
+				continue;
+
+			/* its executor takes the first task by itself */
+			if (ringbuf_count(queue) > 1)
+				runtime_executors_wake(runtime, idx);
+			return;
+		}
+		WAIT();
+	}
+}
+
+/*
+ * runtime_task_wake -- the waker of a spawned future, puts the task back
+ * into a run queue if it's waiting for the waker
+ */
+static void
+runtime_task_wake(void *data)
+{
+	struct runtime_task *task = data;
+	uint64_t state;
+
+	for (;;) {
+		util_atomic_load_explicit64(&task->state, &state,
+			memory_order_acquire);
+		if (state == RUNTIME_TASK_IDLE) {
+			if (util_bool_compare_and_swap64(&task->state,
+					RUNTIME_TASK_IDLE,
+					RUNTIME_TASK_QUEUED)) {
+				runtime_task_schedule(task);
+				return;
+			}
+		} else if (state == RUNTIME_TASK_POLLING) {
+			if (util_bool_compare_and_swap64(&task->state,
+					RUNTIME_TASK_POLLING,
+					RUNTIME_TASK_NOTIFIED))
+				return;
+		} else {
+			/* already queued or notified */
+			return;
+		}
+	}
+}
+
+/*
+ * runtime_task_complete -- marks the task as complete and wakes up its join
+ * future, which can free the task right after
+ */
+static void
+runtime_task_complete(struct runtime_task *task)
+{
+	util_fetch_and_sub64(&task->runtime->ntasks, 1);
+
+	/*
+	 * The waker is called with the lock held, the join future can't
+	 * complete and its waker can't go away before it returns.
+	 */
+	util_mutex_lock(&task->lock);
+	task->complete = 1;
+	if (task->joiner.wake != NULL)
+		FUTURE_WAKER_WAKE(&task->joiner);
+	util_mutex_unlock(&task->lock);
+}
+
+/*
+ * runtime_task_defer -- keeps a pending task which can't wake itself up
+ * aside for a while, polling it again right away would only spin
+ */
+static void
+runtime_task_defer(struct runtime_executor *executor, struct runtime_task *task)
+{
+	uint64_t backoff = task->backoff_ns == 0 ?
+		RUNTIME_BACKOFF_MIN_NS : task->backoff_ns * 2;
+	task->backoff_ns = MIN(backoff, executor->runtime->sleep_time_ns);
+	task->deadline_ns = runtime_now_ns() + task->backoff_ns;
+
+	task->next_deferred = executor->deferred;
+	executor->deferred = task;
+}
+
+/*
+ * runtime_task_run -- polls the task once, a task which is still pending
+ * goes back to the run queue of the executor, unless it waits for its waker
+ * or can't wake itself up and has to be deferred
+ */
+static void
+runtime_task_run(struct runtime_executor *executor, struct runtime_task *task)
+{
+	struct future_notifier notifier;
+	notifier.waker = (struct future_waker){task, runtime_task_wake};
+	notifier.poller.ptr_to_monitor = NULL;
+	notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+
+	util_atomic_store_explicit64(&task->state, RUNTIME_TASK_POLLING,
+		memory_order_release);
+
+	if (future_poll(task->fut, &notifier) == FUTURE_STATE_COMPLETE) {
+		runtime_task_complete(task);
+		return;
+	}
+
+	/* the waker puts the task back, unless it was called already */
+	if (notifier.notifier_used == FUTURE_NOTIFIER_WAKER) {
+		task->backoff_ns = 0;
+		if (util_bool_compare_and_swap64(&task->state,
+				RUNTIME_TASK_POLLING, RUNTIME_TASK_IDLE))
+			return;
+	}
+
+	util_atomic_store_explicit64(&task->state, RUNTIME_TASK_QUEUED,
+		memory_order_release);
+	task->executor = executor->idx;
+
+	/* notified while it was being polled or never to be held back */
+	if (notifier.notifier_used == FUTURE_NOTIFIER_WAKER ||
+			task->runtime->wait_policy == RUNTIME_WAIT_BUSY_POLL)
+		runtime_task_schedule(task);
+	else
+		runtime_task_defer(executor, task);
+}
+
+/*
+ * runtime_executor_resume -- queues the deferred tasks of the executor whose
+ * delay ran out, returns the time in nanoseconds until the next one's does
+ */
+static uint64_t
+runtime_executor_resume(struct runtime_executor *executor)
+{
+	uint64_t now = runtime_now_ns();
+	uint64_t next = UINT64_MAX;
+
+	struct runtime_task **prev = &executor->deferred;
+	struct runtime_task *task;
+	while ((task = *prev) != NULL) {
+		if (task->deadline_ns <= now) {
+			*prev = task->next_deferred;
+			runtime_task_schedule(task);
+		} else {
+			next = MIN(next, task->deadline_ns - now);
+			prev = &task->next_deferred;
+		}
+	}
+
+	return next;
+}
+
+/*
+ * runtime_executor_poll -- takes the next task from the own queue of
+ * the executor or steals one from the other queues
+ */
+static struct runtime_task *
+runtime_executor_poll(struct runtime_executor *executor)
+{
+	struct runtime *runtime = executor->runtime;
+	struct runtime_task *task;
+
+	if ((task = ringbuf_trydequeue(executor->queue)) != NULL)
+		return task;
+
+	for (size_t i = 1; i < runtime->nexecutors; ++i) {
+		size_t victim = (executor->idx + i) % runtime->nexecutors;
+		task = ringbuf_trydequeue(runtime->executors[victim].queue);
+		if (task != NULL)
+			return task;
+	}
+
+	return NULL;
+}
+
+/*
+ * runtime_executor_unpark -- takes the executor off the parked ones,
+ * unless a waker did it already
+ */
+static void
+runtime_executor_unpark(struct runtime_executor *executor)
+{
+	if (util_bool_compare_and_swap64(&executor->parked, 1, 0))
+		util_fetch_and_sub64(&executor->runtime->nparked, 1);
+}
+
+/*
+ * runtime_executor_park -- waits for a task to be queued in the own queue
+ * of the executor, for at most wait_ns nanoseconds unless it's UINT64_MAX,
+ * returns NULL if the time ran out
+ */
+static struct runtime_task *
+runtime_executor_park(struct runtime_executor *executor, uint64_t wait_ns)
+{
+	struct runtime_task *task;
+
+	util_atomic_store_explicit64(&executor->parked, 1,
+		memory_order_release);
+	util_fetch_and_add64(&executor->runtime->nparked, 1);
+
+	/* a task queued before it was seen parked isn't left behind */
+	if ((task = runtime_executor_poll(executor)) == NULL) {
+		if (wait_ns == UINT64_MAX) {
+			task = ringbuf_dequeue(executor->queue);
+		} else {
+			struct timespec abstime;
+			runtime_deadline(&abstime, wait_ns);
+			task = ringbuf_dequeue_timed(executor->queue,
+				&abstime);
+		}
+	}
+
+	runtime_executor_unpark(executor);
+
+	return task;
+}
+
+/*
+ * runtime_executor_next -- takes the next task from the own queue of
+ * the executor or steals one from the other queues, if there's none it
+ * parks until a task is queued in the own queue or, if wait_ns isn't
+ * UINT64_MAX, the time runs out, in which case it returns NULL
+ */
+static struct runtime_task *
+runtime_executor_next(struct runtime_executor *executor, uint64_t wait_ns)
+{
+	struct runtime_task *task = runtime_executor_poll(executor);
+	if (task != NULL)
+		return task;
+
+	return runtime_executor_park(executor, wait_ns);
+}
+
+/*
+ * runtime_executor_thread -- runs the tasks until the runtime is deleted
+ */
+static void *
+runtime_executor_thread(void *arg)
+{
+	struct runtime_executor *executor = arg;
+	struct runtime *runtime = executor->runtime;
+	struct runtime_task *task;
+	uint64_t stopping;
+
+	for (;;) {
+		util_atomic_load_explicit64(&runtime->stopping, &stopping,
+			memory_order_acquire);
+		if (stopping)
+			break;
+
+		/* only the deferred tasks need a deadline */
+		uint64_t wait_ns = UINT64_MAX;
+		if (executor->deferred != NULL)
+			wait_ns = runtime_executor_resume(executor);
+
+		task = runtime_executor_next(executor, wait_ns);
+		if (task != NULL && task != &runtime_wakeup_task)
+			runtime_task_run(executor, task);
+	}
+
+	return NULL;
+}
+
+/*
+ * runtime_executors_stop -- stops and deletes the first n executors,
+ * the tasks which are still queued or deferred are never polled again
+ */
+static void
+runtime_executors_stop(struct runtime *runtime, size_t n)
+{
+	util_atomic_store_explicit64(&runtime->stopping, 1,
+		memory_order_release);
+
+	/* executors parked on their queues have to notice it */
+	for (size_t i = 0; i < n; ++i)
+		ringbuf_tryenqueue(runtime->executors[i].queue,
+			&runtime_wakeup_task);
+
+	for (size_t i = 0; i < n; ++i)
+		os_thread_join(&runtime->executors[i].thread, NULL);
+
+	/* nothing takes or queues the tasks anymore */
+	for (size_t i = 0; i < n; ++i) {
+		struct ringbuf *queue = runtime->executors[i].queue;
+		while (ringbuf_trydequeue(queue) != NULL)
+			;
+		ringbuf_stop(queue);
+		ringbuf_delete(queue);
+	}
+}
+
+/*
+ * runtime_new_ext -- creates a new runtime with the given configuration
+ */
 struct runtime *
-runtime_new(void)
+runtime_new_ext(const struct runtime_config *cfg)
 {
+	switch (cfg->wait_policy) {
+		case RUNTIME_WAIT_BLOCK:
+		case RUNTIME_WAIT_HYBRID:
+		case RUNTIME_WAIT_BUSY_POLL:
+		case RUNTIME_WAIT_ADAPTIVE:
+			break;
+		default:
+			return NULL;
+	}
+
 	struct runtime *runtime = malloc(sizeof(struct runtime));
 	if (runtime == NULL)
 		return NULL;
 
-	os_cond_init(&runtime->cond);
-	os_mutex_init(&runtime->lock);
-	runtime->spins_before_sleep = 1000;
-	runtime->cond_wait_time = (struct timespec){0, 1000000};
+	runtime->wait_policy = cfg->wait_policy;
+	runtime->spin_count = cfg->spin_count;
+	runtime->sleep_time_ns = cfg->sleep_time_ns;
+	/* until there are any samples, polling for as long as it can pays */
+	runtime->completion_ns = RUNTIME_ADAPTIVE_MAX_SPIN_NS / 2;
+
+	runtime->executors = NULL;
+	runtime->nexecutors = 0;
+	runtime->next_executor = 0;
+	runtime->ntasks = 0;
+	runtime->nparked = 0;
+	runtime->stopping = 0;
+	runtime->max_tasks = (uint64_t)cfg->nthreads * RUNTIME_QUEUE_LENGTH;
+	if (cfg->nthreads == 0)
+		return runtime;
+
+	runtime->executors =
+		calloc(cfg->nthreads, sizeof(struct runtime_executor));
+	if (runtime->executors == NULL)
+		goto err_free_runtime;
+
+	/* all the queues must exist before any executor starts stealing */
+	size_t i;
+	for (i = 0; i < cfg->nthreads; ++i) {
+		struct runtime_executor *executor = &runtime->executors[i];
+		executor->runtime = runtime;
+		executor->idx = i;
+		executor->queue = ringbuf_new(RUNTIME_QUEUE_LENGTH);
+		if (executor->queue == NULL)
+			goto err_delete_queues;
+	}
+	runtime->nexecutors = cfg->nthreads;
+
+	for (i = 0; i < cfg->nthreads; ++i) {
+		if (os_thread_create(&runtime->executors[i].thread, NULL,
+				runtime_executor_thread,
+				&runtime->executors[i]) != 0)
+			goto err_stop_executors;
+	}
 
 	return runtime;
+
+err_stop_executors:
+	/* the started executors could be stealing from any of the queues */
+	runtime_executors_stop(runtime, i);
+	for (size_t j = i; j < cfg->nthreads; ++j)
+		ringbuf_delete(runtime->executors[j].queue);
+	goto err_free_executors;
+err_delete_queues:
+	while (i-- > 0)
+		ringbuf_delete(runtime->executors[i].queue);
+err_free_executors:
+	free(runtime->executors);
+err_free_runtime:
+	free(runtime);
+	return NULL;
+}
+
+struct runtime *
+runtime_new(void)
+{
+	return runtime_new_ext(&runtime_config_default);
 }
 
 void
 runtime_delete(struct runtime *runtime)
 {
+	runtime_executors_stop(runtime, runtime->nexecutors);
+	free(runtime->executors);
 	free(runtime);
 }
 
+/*
+ * runtime_spawn -- hands the future over to the executor threads, returns
+ * the handle to join it with or NULL on failure
+ */
+struct runtime_task *
+runtime_spawn(struct runtime *runtime, struct future *fut)
+{
+	if (runtime->nexecutors == 0)
+		return NULL;
+
+	if (util_fetch_and_add64(&runtime->ntasks, 1) >= runtime->max_tasks)
+		goto err_ntasks;
+
+	struct runtime_task *task = malloc(sizeof(struct runtime_task));
+	if (task == NULL)
+		goto err_ntasks;
+
+	task->fut = fut;
+	task->runtime = runtime;
+	task->executor = util_fetch_and_add64(&runtime->next_executor, 1) %
+		runtime->nexecutors;
+	task->state = RUNTIME_TASK_QUEUED;
+	task->next_deferred = NULL;
+	task->backoff_ns = 0;
+	util_mutex_init(&task->lock);
+	task->complete = 0;
+	task->joiner = (struct future_waker){NULL, NULL};
+
+	runtime_task_schedule(task);
+
+	return task;
+
+err_ntasks:
+	util_fetch_and_sub64(&runtime->ntasks, 1);
+	return NULL;
+}
+
+/*
+ * runtime_join_task -- the task of the join future, completes once
+ * the spawned future did, then frees the task
+ */
+static enum future_state
+runtime_join_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct runtime_join_data *data = future_context_get_data(context);
+	struct runtime_join_output *output = future_context_get_output(context);
+	struct runtime_task *task = data->task;
+
+	util_mutex_lock(&task->lock);
+	if (task->complete) {
+		util_mutex_unlock(&task->lock);
+		output->fut = task->fut;
+		util_mutex_destroy(&task->lock);
+		free(task);
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (notifier != NULL) {
+		task->joiner = notifier->waker;
+		notifier->notifier_used = FUTURE_NOTIFIER_WAKER;
+	} else {
+		task->joiner = (struct future_waker){NULL, NULL};
+	}
+	util_mutex_unlock(&task->lock);
+
+	return FUTURE_STATE_RUNNING;
+}
+
+/*
+ * runtime_join -- creates a future which completes once the spawned future
+ * does
+ */
+struct runtime_join_future
+runtime_join(struct runtime_task *task)
+{
+	struct runtime_join_future fut = {.output.fut = NULL};
+	fut.data.task = task;
+	FUTURE_INIT(&fut, runtime_join_task);
+
+	return fut;
+}
+
+/*
+ * runtime_sleep -- parks the waiting thread until the epoch changes from
+ * the one seen before the last pass over the futures, with a deadline only
+ * if any of them can't wake the thread up
+ */
 static void
-runtime_sleep(struct runtime *runtime)
+runtime_sleep(struct runtime *runtime, struct runtime_waiter *waiter)
 {
-	os_mutex_lock(&runtime->lock);
-	struct timespec ts;
-	os_clock_gettime(CLOCK_REALTIME, &ts);
-	static const size_t nsec_in_sec = 1000000000ULL;
-	ts.tv_nsec += runtime->cond_wait_time.tv_nsec;
-	uint64_t secs = (uint64_t)ts.tv_nsec / nsec_in_sec;
-	ts.tv_nsec -= (long)(secs * nsec_in_sec);
-	ts.tv_sec += (long)(runtime->cond_wait_time.tv_sec + (long)secs);
+	struct timespec deadline;
+	struct timespec *abstime = NULL;
+	if (waiter->timed) {
+		runtime_deadline(&deadline, runtime->sleep_time_ns);
+		abstime = &deadline;
+	}
 
-	os_cond_timedwait(&runtime->cond, &runtime->lock, &ts);
-	os_mutex_unlock(&runtime->lock);
+	util_fetch_and_add32(&waiter->nparked, 1);
+	/* the epoch is checked by the futex only after parking is visible */
+	util_synchronize();
+	util_futex_wait(&waiter->epoch, waiter->pass_epoch, abstime);
+	util_fetch_and_sub32(&waiter->nparked, 1);
 }
 
-int
-future_compare_async(const void *first_fut, const void *second_fut)
+/*
+ * A pending future and the epoch of the poll in which it took the waker,
+ * a waker which was taken before the last wake-up might have been used
+ * up already. The word to monitor reported by the last poll, if any, and
+ * the value it held right after that poll.
+ */
+struct runtime_entry {
+	struct future *fut;
+	int waker;
+	uint32_t waker_epoch;
+	uint64_t *monitor;
+	uint64_t monitor_value;
+};
+
+/*
+ * runtime_poll -- polls the future once and returns its state
+ */
+static enum future_state
+runtime_poll(struct runtime_entry *entry, struct runtime_waiter *waiter)
 {
-	enum future_property property = FUTURE_PROPERTY_ASYNC;
-	struct future *fut1 = *(struct future **)first_fut;
-	struct future *fut2 = *(struct future **)second_fut;
+	struct future_notifier *notifier = &waiter->notifier;
+	notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+	notifier->poller.ptr_to_monitor = NULL;
+
+	/* the word is valid only until the next poll, which can free it */
+	entry->monitor = NULL;
+
+	enum future_state state = future_poll(entry->fut, notifier);
+
+	switch (notifier->notifier_used) {
+		case FUTURE_NOTIFIER_POLLER:
+		/*
+		 * The word changes once the future can make progress,
+		 * a change right before it's read here is noticed only
+		 * once the thread's deadline passes.
+		 */
+		if (state == FUTURE_STATE_COMPLETE)
+			break;
+		entry->monitor = notifier->poller.ptr_to_monitor;
+		if (entry->monitor != NULL) {
+			util_atomic_load_explicit64(entry->monitor,
+				&entry->monitor_value, memory_order_acquire);
+			waiter->nmonitored++;
+		}
+		break;
+		case FUTURE_NOTIFIER_WAKER:
+		/* the future wakes the thread up once it can make progress */
+		entry->waker = 1;
+		entry->waker_epoch = waiter->pass_epoch;
+		break;
+		case FUTURE_NOTIFIER_NONE:
+		/* nothing to do for none */
+		break;
+	};
+
+	if (state != FUTURE_STATE_COMPLETE && (!entry->waker ||
+			entry->waker_epoch != waiter->pass_epoch))
+		waiter->timed = 1;
 
-	if (future_has_property(fut1, property) ==
-			future_has_property(fut2, property))
-				return 0;
-	if (future_has_property(fut1, property) >
-			future_has_property(fut2, property))
-				return -1;
-	return 1;
+	return state;
+}
+
+/*
+ * The futures which are still pending, asynchronous ones are at the front
+ * of the array and synchronous ones at its back, in the reverse order.
+ */
+struct runtime_pending {
+	struct runtime_entry *entries;
+	size_t nasync;
+	size_t nsync;
+};
+
+/*
+ * runtime_pending_add -- appends the future to the pending ones of its kind,
+ * which can change while a future runs, e.g. between entries of a chain
+ */
+static void
+runtime_pending_add(struct runtime_pending *pending, size_t nfuts,
+	const struct runtime_entry *entry)
+{
+	if (future_has_property(entry->fut, FUTURE_PROPERTY_ASYNC))
+		pending->entries[pending->nasync++] = *entry;
+	else
+		pending->entries[nfuts - ++pending->nsync] = *entry;
+}
+
+/*
+ * runtime_poll_pending -- polls each of the pending futures once,
+ * asynchronous ones first, and appends the ones which didn't complete
+ * to the next pending ones, keeping their order
+ */
+static void
+runtime_poll_pending(struct runtime_pending *cur, struct runtime_pending *next,
+	size_t nfuts, struct runtime_waiter *waiter)
+{
+	next->nasync = 0;
+	next->nsync = 0;
+
+	for (size_t i = 0; i < cur->nasync; ++i) {
+		struct runtime_entry *entry = &cur->entries[i];
+		if (runtime_poll(entry, waiter) != FUTURE_STATE_COMPLETE)
+			runtime_pending_add(next, nfuts, entry);
+	}
+	for (size_t i = 1; i <= cur->nsync; ++i) {
+		struct runtime_entry *entry = &cur->entries[nfuts - i];
+		if (runtime_poll(entry, waiter) != FUTURE_STATE_COMPLETE)
+			runtime_pending_add(next, nfuts, entry);
+	}
+}
+
+/*
+ * runtime_entry_changed -- checks if the word monitored for the pending
+ * future changed since its poll
+ */
+static int
+runtime_entry_changed(const struct runtime_entry *entry)
+{
+	uint64_t value;
+	util_atomic_load_explicit64(entry->monitor, &value,
+		memory_order_acquire);
+
+	return value != entry->monitor_value;
+}
+
+/*
+ * runtime_pending_changed -- checks if any of the words monitored for
+ * the pending futures changed or if any future woke the thread up since
+ * the last pass
+ */
+static int
+runtime_pending_changed(const struct runtime_pending *pending, size_t nfuts,
+	struct runtime_waiter *waiter)
+{
+	uint32_t epoch;
+	util_atomic_load_explicit32(&waiter->epoch, &epoch,
+		memory_order_acquire);
+	if (epoch != waiter->pass_epoch)
+		return 1;
+
+	for (size_t i = 0; i < pending->nasync; ++i) {
+		const struct runtime_entry *entry = &pending->entries[i];
+		if (entry->monitor != NULL && runtime_entry_changed(entry))
+			return 1;
+	}
+	for (size_t i = 1; i <= pending->nsync; ++i) {
+		const struct runtime_entry *entry =
+			&pending->entries[nfuts - i];
+		if (entry->monitor != NULL && runtime_entry_changed(entry))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * runtime_watch -- waits for a write to any of the words monitored for
+ * the pending futures, returns 1 once it's time to poll them again or 0
+ * if the thread should park instead
+ */
+static int
+runtime_watch(struct runtime *runtime, struct runtime_waiter *waiter,
+	const struct runtime_pending *pending, size_t nfuts)
+{
+	/*
+	 * If the only pending future waits for its word, the cpu can stop
+	 * until the word is written, there's no waker to wait for.
+	 */
+	if (pending->nasync + pending->nsync == 1 && waiter->nmonitored == 1 &&
+			monitor_wait_supported()) {
+		const struct runtime_entry *entry = pending->nasync != 0 ?
+			&pending->entries[0] : &pending->entries[nfuts - 1];
+		uint64_t deadline = runtime_now_ns() + runtime->sleep_time_ns;
+
+		while (!runtime_entry_changed(entry) &&
+				runtime_now_ns() < deadline)
+			monitor_wait(entry->monitor, entry->monitor_value,
+				RUNTIME_UMWAIT_CYCLES);
+
+		return 1;
+	}
+
+	/* otherwise keep checking all of them, but not for long */
+	for (unsigned i = 0; i < RUNTIME_WATCH_SPINS; ++i) {
+		if (runtime_pending_changed(pending, nfuts, waiter))
+			return 1;
+		WAIT();
+	}
+
+	return 0;
+}
+
+/*
+ * runtime_completed -- adds the time the waiting thread spent since
+ * the previous completion, or since it started to wait, to the average one
+ */
+static void
+runtime_completed(struct runtime *runtime, uint64_t elapsed_ns)
+{
+	/* concurrent waiters can lose each other's samples, it's only a hint */
+	uint64_t avg;
+	util_atomic_load_explicit64(&runtime->completion_ns, &avg,
+		memory_order_relaxed);
+	avg = avg - (avg >> RUNTIME_ADAPTIVE_SHIFT) +
+		(elapsed_ns >> RUNTIME_ADAPTIVE_SHIFT);
+	util_atomic_store_explicit64(&runtime->completion_ns, avg,
+		memory_order_relaxed);
+}
+
+/*
+ * runtime_spin_budget -- returns for how long after the last completion
+ * a thread waiting with the adaptive policy polls the futures, it's twice
+ * the average time of waiting for a completion if that's short enough
+ */
+static uint64_t
+runtime_spin_budget(struct runtime *runtime)
+{
+	uint64_t avg;
+	util_atomic_load_explicit64(&runtime->completion_ns, &avg,
+		memory_order_relaxed);
+	if (avg > RUNTIME_ADAPTIVE_MAX_SPIN_NS)
+		return 0;
+
+	return MIN(avg * 2, RUNTIME_ADAPTIVE_MAX_SPIN_NS);
+}
+
+/*
+ * runtime_keep_polling -- checks if the waiting thread makes another pass
+ * over the futures rather than going to sleep
+ */
+static int
+runtime_keep_polling(struct runtime *runtime, uint64_t npasses,
+	uint64_t progress_ns)
+{
+	switch (runtime->wait_policy) {
+		case RUNTIME_WAIT_BUSY_POLL:
+			return 1;
+		case RUNTIME_WAIT_HYBRID:
+			return npasses < runtime->spin_count;
+		case RUNTIME_WAIT_ADAPTIVE:
+			return runtime_now_ns() - progress_ns <
+				runtime_spin_budget(runtime);
+		default:
+			return 0;
+	}
+}
+
+/*
+ * runtime_may_watch -- checks if the thread which is about to sleep may
+ * watch the words monitored for the futures for a while first
+ */
+static int
+runtime_may_watch(struct runtime *runtime)
+{
+	switch (runtime->wait_policy) {
+		case RUNTIME_WAIT_HYBRID:
+			return 1;
+		case RUNTIME_WAIT_ADAPTIVE:
+			return runtime_spin_budget(runtime) != 0;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * runtime_poll_all -- polls all futures of the array which didn't complete
+ * yet in their order, returns the number of the ones which are still
+ * pending
+ */
+static size_t
+runtime_poll_all(struct future *futs[], size_t nfuts,
+	struct runtime_waiter *waiter)
+{
+	size_t npending = 0;
+
+	for (size_t f = 0; f < nfuts; ++f) {
+		struct runtime_entry entry = {futs[f], 0, 0, NULL, 0};
+		if (entry.fut->context.state != FUTURE_STATE_COMPLETE &&
+				runtime_poll(&entry, waiter) !=
+				FUTURE_STATE_COMPLETE)
+			npending++;
+	}
+
+	return npending;
 }
 
 void
 runtime_wait_multiple(struct runtime *runtime, struct future *futs[],
 						size_t nfuts)
 {
-	struct runtime_waker_data waker_data;
-	waker_data.cond = &runtime->cond;
-	waker_data.lock = &runtime->lock;
+	struct runtime_waiter waiter;
+	waiter.notifier.waker =
+		(struct future_waker){&waiter, runtime_waker_wake};
+	waiter.notifier.poller.ptr_to_monitor = NULL;
+	waiter.notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+	waiter.epoch = 0;
+	waiter.nparked = 0;
+	waiter.nmonitored = 0;
 
-	struct future_notifier notifier;
-	notifier.waker = (struct future_waker){&waker_data, runtime_waker_wake};
-	notifier.poller.ptr_to_monitor = NULL;
-	size_t ndone = 0;
+	/*
+	 * Each pass polls only the futures which are still pending, the ones
+	 * that complete drop out of the lists. If there's no memory for
+	 * the lists, all futures are polled in the order of the array instead,
+	 * without giving asynchronous ones the priority.
+	 */
+	struct runtime_entry stack_entries[RUNTIME_STACK_FUTURES * 2];
+	struct runtime_entry *lists = stack_entries;
+	if (nfuts > RUNTIME_STACK_FUTURES)
+		lists = malloc(sizeof(struct runtime_entry) * nfuts * 2);
+
+	struct runtime_pending pending[2];
+	unsigned cur = 0;
+	size_t npending = nfuts;
+
+	if (lists != NULL) {
+		pending[0] = (struct runtime_pending){lists, 0, 0};
+		pending[1] = (struct runtime_pending){lists + nfuts, 0, 0};
+		for (size_t f = 0; f < nfuts; ++f) {
+			struct runtime_entry entry = {futs[f], 0, 0, NULL, 0};
+			if (entry.fut->context.state != FUTURE_STATE_COMPLETE)
+				runtime_pending_add(&pending[cur], nfuts,
+					&entry);
+		}
+		npending = pending[cur].nasync + pending[cur].nsync;
+	}
+
+	/* the time of the last completion, for the adaptive policy */
+	int adaptive = runtime->wait_policy == RUNTIME_WAIT_ADAPTIVE;
+	uint64_t progress_ns = adaptive ? runtime_now_ns() : 0;
 
 	for (;;) {
-		for (uint64_t i = 0; i < runtime->spins_before_sleep; ++i) {
-			qsort(futs, nfuts, sizeof(struct future *),
-					future_compare_async);
-			for (uint64_t f = 0; f < nfuts; ++f) {
-				struct future *fut = futs[f];
-				if (fut->context.state == FUTURE_STATE_COMPLETE)
-					continue;
-
-				if (future_poll(fut, &notifier) ==
-				    FUTURE_STATE_COMPLETE) {
-					ndone++;
-				}
-				switch (notifier.notifier_used) {
-					case FUTURE_NOTIFIER_POLLER:
-					/*
-					 * TODO: if this is the only future
-					 * being polled, use umwait/umonitor
-					 * for power-optimized polling.
-					 */
-					break;
-					case FUTURE_NOTIFIER_WAKER:
-					case FUTURE_NOTIFIER_NONE:
-					/* nothing to do for wakers or none */
-					break;
-				};
+		/* there's always at least one pass before going to sleep */
+		uint64_t npasses = 0;
+		do {
+			/* a wake-up during the pass keeps it from parking */
+			util_atomic_load_explicit32(&waiter.epoch,
+				&waiter.pass_epoch, memory_order_acquire);
+			waiter.timed = 0;
+			waiter.nmonitored = 0;
+
+			size_t prev_npending = npending;
+			if (lists != NULL) {
+				runtime_poll_pending(&pending[cur],
+					&pending[cur ^ 1], nfuts, &waiter);
+				cur ^= 1;
+				npending = pending[cur].nasync +
+					pending[cur].nsync;
+			} else {
+				npending = runtime_poll_all(futs, nfuts,
+					&waiter);
 			}
 
-			if (ndone == nfuts)
-				return;
+			if (adaptive && npending < prev_npending) {
+				uint64_t now = runtime_now_ns();
+				runtime_completed(runtime, now - progress_ns);
+				progress_ns = now;
+			}
 
+			if (npending == 0)
+				goto out;
+
+			npasses++;
 			WAIT();
-		}
-		runtime_sleep(runtime);
+		} while (runtime_keep_polling(runtime, npasses, progress_ns));
+
+		/*
+		 * Futures which wait for their words to change can't wake
+		 * the thread up, it watches the words for a while first,
+		 * unless it shouldn't poll at all. Without the lists there's
+		 * nothing to watch.
+		 */
+		if (lists == NULL || waiter.nmonitored == 0 ||
+				!runtime_may_watch(runtime) ||
+				!runtime_watch(runtime, &waiter, &pending[cur],
+				nfuts))
+			runtime_sleep(runtime, &waiter);
 	}
+
+out:
+	if (lists != stack_entries)
+		free(lists);
 }
 
 void
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_RINGBUF_SIZE 128
+#define TEST_CHUNK_SIZE (1 << 12)
+
+/*
+ * test_chunked_memcpy -- test memcpy operations of various sizes, some of
+ * which are split into multiple parts
+ */
+static void
+test_chunked_memcpy(struct runtime *r, struct vdm *vdm)
+{
+	size_t sizes[] = {1, TEST_CHUNK_SIZE, 2 * TEST_CHUNK_SIZE + 1,
+		(TEST_NTHREADS + 1) * TEST_CHUNK_SIZE - 7, 1 << 20};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		size_t n = sizes[i];
+		char *src = malloc(n);
+		UT_ASSERTne(src, NULL);
+		char *dst = malloc(n);
+		UT_ASSERTne(dst, NULL);
+
+		for (size_t j = 0; j < n; ++j)
+			src[j] = (char)(j % 251);
+		memset(dst, 0, n);
+
+		struct vdm_operation_future fut =
+			vdm_memcpy(vdm, dst, src, n, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memcpy.dest, dst);
+		UT_ASSERTeq(memcmp(src, dst, n), 0);
+
+		free(src);
+		free(dst);
+	}
+}
+
+/*
+ * test_chunked_memset -- test a memset operation split into multiple parts
+ */
+static void
+test_chunked_memset(struct runtime *r, struct vdm *vdm)
+{
+	size_t n = 1 << 20;
+	char *buf = malloc(n + 1);
+	UT_ASSERTne(buf, NULL);
+	buf[n] = 'x';
+
+	struct vdm_operation_future fut = vdm_memset(vdm, buf, 'a', n, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	for (size_t j = 0; j < n; ++j)
+		UT_ASSERTeq(buf[j], 'a');
+	UT_ASSERTeq(buf[n], 'x');
+
+	free(buf);
+}
+
+/*
+ * test_chunked_memmove -- test overlapping and disjoint memmove operations,
+ * only the latter can be split
+ */
+static void
+test_chunked_memmove(struct runtime *r, struct vdm *vdm)
+{
+	size_t n = 1 << 20;
+	size_t shift = TEST_CHUNK_SIZE / 2;
+	char *buf = malloc(n + shift);
+	UT_ASSERTne(buf, NULL);
+	char *expected = malloc(n + shift);
+	UT_ASSERTne(expected, NULL);
+
+	for (size_t j = 0; j < n + shift; ++j)
+		buf[j] = (char)(j % 251);
+	memcpy(expected, buf, n + shift);
+	memmove(expected + shift, expected, n);
+
+	/* overlapping move */
+	struct vdm_operation_future fut =
+		vdm_memmove(vdm, buf + shift, buf, n, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(buf, expected, n + shift), 0);
+
+	/* disjoint move */
+	char *dst = malloc(n);
+	UT_ASSERTne(dst, NULL);
+	fut = vdm_memmove(vdm, dst, buf, n, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst, buf, n), 0);
+
+	free(dst);
+	free(expected);
+	free(buf);
+}
+
+/*
+ * test_chunked_multiple -- test many concurrent split operations, so that
+ * not all of the parts fit in the ringbuf at once
+ */
+static void
+test_chunked_multiple(struct runtime *r, struct vdm *vdm)
+{
+	size_t nfuts = TEST_RINGBUF_SIZE;
+	size_t n = TEST_NTHREADS * TEST_CHUNK_SIZE;
+
+	char *src = malloc(n);
+	UT_ASSERTne(src, NULL);
+	for (size_t j = 0; j < n; ++j)
+		src[j] = (char)(j % 13);
+
+	char *dst = malloc(n * nfuts);
+	UT_ASSERTne(dst, NULL);
+
+	struct vdm_operation_future *futs =
+		malloc(sizeof(struct vdm_operation_future) * nfuts);
+	UT_ASSERTne(futs, NULL);
+	struct future **runnable = malloc(sizeof(struct future *) * nfuts);
+	UT_ASSERTne(runnable, NULL);
+
+	for (size_t i = 0; i < nfuts; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst + i * n, src, n, 0);
+		runnable[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	runtime_wait_multiple(r, runnable, nfuts);
+
+	for (size_t i = 0; i < nfuts; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst + i * n, src, n), 0);
+	}
+
+	free(runnable);
+	free(futs);
+	free(dst);
+	free(src);
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_set_chunk_size(dmt, TEST_CHUNK_SIZE);
+
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	test_chunked_memcpy(r, vdm);
+	test_chunked_memset(r, vdm);
+	test_chunked_memmove(r, vdm);
+	test_chunked_multiple(r, vdm);
+
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+
+	return 0;
+}
@@ -0,0 +1,13 @@
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright 2022, Intel Corporation
+
+# test case for operations split into parts with the thread data mover
+
+include(${SRC_DIR}/cmake/test_helpers.cmake)
+
+setup()
+
+execute(0 ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/chunked_threads)
+execute_assert_pass(${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/chunked_threads)
+
+cleanup()
@@ -10,6 +10,7 @@
 #include <string.h>
 
 #define TEST_MAX_COUNT 20
+#define TEST_NFUTS 100 /* more than the runtime keeps on its stack */
 #define FAKE_MAP_ARG ((void *)((uintptr_t)(0xFEEDCAFE)))
 
 static uint64_t results[12];
@@ -273,12 +274,81 @@ test_change_flag_future()
 	runtime_delete(r);
 }
 
+struct countdown_data {
+	int counter;
+};
+
+struct countdown_output {
+	int result;
+};
+
+FUTURE(countdown_fut, struct countdown_data, struct countdown_output);
+
+enum future_state
+countdown_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countdown_data *data = future_context_get_data(context);
+	if (--data->counter > 0)
+		return FUTURE_STATE_RUNNING;
+
+	struct countdown_output *output = future_context_get_output(context);
+	output->result = 1;
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * test_complete_futures -- tests if runtime returns when some or all of
+ * the futures it waits for are already complete
+ */
+void
+test_complete_futures()
+{
+	struct runtime *r = runtime_new();
+	struct countdown_fut *futs = malloc(sizeof(*futs) * TEST_NFUTS);
+	UT_ASSERTne(futs, NULL);
+	struct future **futures = malloc(sizeof(struct future *) * TEST_NFUTS);
+	UT_ASSERTne(futures, NULL);
+
+	for (int i = 0; i < TEST_NFUTS; ++i) {
+		if (i % 3 == 0) {
+			FUTURE_INIT_COMPLETE(&futs[i]);
+			futs[i].output.result = 1;
+		} else {
+			FUTURE_INIT(&futs[i], countdown_task);
+			futs[i].data.counter = i;
+			futs[i].output.result = 0;
+			if (i % 3 == 1)
+				futs[i].base.has_property =
+					future_async_property;
+		}
+		futures[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	runtime_wait(r, futures[0]);
+	runtime_wait_multiple(r, futures, TEST_NFUTS);
+
+	for (int i = 0; i < TEST_NFUTS; ++i) {
+		UT_ASSERTeq(FUTURE_STATE(&futs[i]), FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, 1);
+	}
+
+	/* all of them are complete now */
+	runtime_wait_multiple(r, futures, TEST_NFUTS);
+	runtime_wait_multiple(r, futures, 1);
+
+	free(futures);
+	free(futs);
+	runtime_delete(r);
+}
+
 int
 main(void)
 {
 	test_basic_futures();
 	test_chained_future();
 	test_change_flag_future();
+	test_complete_futures();
 
 	return 0;
 }
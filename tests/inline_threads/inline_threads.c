@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 2
+#define TEST_RINGBUF_SIZE 32
+#define TEST_THRESHOLD 256
+
+/*
+ * test_inline -- operations smaller than the threshold must complete on
+ * the first poll, all of them must produce correct results
+ */
+static void
+test_inline(struct runtime *r, struct vdm *vdm, size_t threshold)
+{
+	size_t sizes[] = {0, 1, TEST_THRESHOLD - 1, TEST_THRESHOLD, 1 << 16};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		size_t n = sizes[i];
+		char *src = malloc(n + 1);
+		UT_ASSERTne(src, NULL);
+		char *dst = malloc(n + 1);
+		UT_ASSERTne(dst, NULL);
+
+		for (size_t j = 0; j < n; ++j)
+			src[j] = (char)(j % 251);
+		memset(dst, 0, n + 1);
+
+		struct vdm_operation_future fut =
+			vdm_memcpy(vdm, dst, src, n, 0);
+		enum future_state state =
+			future_poll(FUTURE_AS_RUNNABLE(&fut), NULL);
+		if (n < threshold)
+			UT_ASSERTeq(state, FUTURE_STATE_COMPLETE);
+		if (state != FUTURE_STATE_COMPLETE)
+			runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memcpy.dest, dst);
+		UT_ASSERTeq(memcmp(src, dst, n), 0);
+
+		/* overlapping move within the destination */
+		fut = vdm_memmove(vdm, dst + 1, dst, n, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		if (n > 0)
+			UT_ASSERTeq(memcmp(src, dst + 1, n), 0);
+
+		fut = vdm_memset(vdm, dst, 'x', n, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		for (size_t j = 0; j < n; ++j)
+			UT_ASSERTeq(dst[j], 'x');
+
+		free(src);
+		free(dst);
+	}
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_set_inline_threshold(dmt, TEST_THRESHOLD);
+
+	test_inline(r, data_mover_threads_get_vdm(dmt), TEST_THRESHOLD);
+
+	/* with the threshold disabled, all operations go to the workers */
+	data_mover_threads_set_inline_threshold(dmt, 0);
+	test_inline(r, data_mover_threads_get_vdm(dmt), 0);
+
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+
+	return 0;
+}
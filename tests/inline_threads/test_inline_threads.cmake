@@ -0,0 +1,13 @@
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright 2022, Intel Corporation
+
+# test case for inline execution of small operations in the thread data mover
+
+include(${SRC_DIR}/cmake/test_helpers.cmake)
+
+setup()
+
+execute(0 ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/inline_threads)
+execute_assert_pass(${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/inline_threads)
+
+cleanup()
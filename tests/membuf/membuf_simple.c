@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "core/membuf.h"
 #include "os_thread.h"
 #include "test_helpers.h"
@@ -11,6 +12,13 @@
 
 #define TEST_ENTRY_PADDING (1 << 11)
 #define MAX_TEST_ENTRIES (100000)
+#define TEST_MAX_THREADBUFS 3
+#define TEST_THREADBUF_SHIFT 21 /* threadbufs are aligned to 2MB */
+
+#define TEST_CACHELINE 64
+#define TEST_NOBJECTS 1000
+
+#define TEST_THREADBUF(ptr) ((uintptr_t)(ptr) >> TEST_THREADBUF_SHIFT)
 
 struct test_entry {
 	char padding[TEST_ENTRY_PADDING];
@@ -24,9 +32,9 @@ membuf_alloc_thread(void *arg)
 }
 
 void
-membuf_test_mt_reuse()
+membuf_test_mt_reuse(enum membuf_mode mode)
 {
-	struct membuf *mbuf = membuf_new(NULL);
+	struct membuf *mbuf = membuf_new_ext(NULL, mode);
 	UT_ASSERTne(mbuf, NULL);
 
 	os_thread_t th1;
@@ -44,9 +52,9 @@ membuf_test_mt_reuse()
 }
 
 void
-membuf_test_st_reuse()
+membuf_test_st_reuse(enum membuf_mode mode)
 {
-	struct membuf *mbuf = membuf_new(TEST_USER_DATA);
+	struct membuf *mbuf = membuf_new_ext(TEST_USER_DATA, mode);
 	UT_ASSERTne(mbuf, NULL);
 
 	struct test_entry **entries =
@@ -104,11 +112,292 @@ membuf_test_st_reuse()
 	free(entries);
 }
 
+/*
+ * membuf_test_fill -- allocates entries until the buffer is full, returns
+ * their number
+ */
+static int
+membuf_test_fill(struct membuf *mbuf, struct test_entry **entries)
+{
+	int i;
+	for (i = 0; i < MAX_TEST_ENTRIES; ++i) {
+		entries[i] = membuf_alloc(mbuf, sizeof(struct test_entry));
+		if (entries[i] == NULL)
+			break;
+	}
+
+	/* if this triggers, increase MAX_TEST_ENTRIES */
+	UT_ASSERTne(i, MAX_TEST_ENTRIES);
+
+	return i;
+}
+
+/*
+ * membuf_test_pinned -- a single entry that is never freed blocks the reuse
+ * of the whole buffer in the ring mode only
+ */
+void
+membuf_test_pinned(enum membuf_mode mode)
+{
+	struct membuf *mbuf = membuf_new_ext(TEST_USER_DATA, mode);
+	UT_ASSERTne(mbuf, NULL);
+
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	int entries_max = membuf_test_fill(mbuf, entries);
+	for (int i = 1; i < entries_max; ++i)
+		membuf_free(entries[i]);
+
+	int allocated = membuf_test_fill(mbuf, entries + 1);
+	if (mode == MEMBUF_MODE_RING)
+		UT_ASSERTeq(allocated, 0);
+	else
+		UT_ASSERTeq(allocated, entries_max - 1);
+
+	for (int i = 1; i <= allocated; ++i)
+		UT_ASSERTeq(membuf_ptr_user_data(entries[i]), TEST_USER_DATA);
+
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+/*
+ * membuf_test_merge -- adjacent entries freed out of order are merged into
+ * one that fits a larger allocation, the rest of a larger entry is reused
+ */
+void
+membuf_test_merge()
+{
+	struct membuf *mbuf = membuf_new_ext(TEST_USER_DATA,
+		MEMBUF_MODE_FREE_LISTS);
+	UT_ASSERTne(mbuf, NULL);
+
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	int entries_max = membuf_test_fill(mbuf, entries);
+	UT_ASSERTin(entries_max, 4, MAX_TEST_ENTRIES);
+
+	/* use up the space too small for another entry */
+	while (membuf_alloc(mbuf, 1) != NULL)
+		;
+
+	/* the first and the last entries stay allocated */
+	membuf_free(entries[2]);
+	membuf_free(entries[1]);
+	void *merged = membuf_alloc(mbuf, sizeof(struct test_entry) * 2);
+	UT_ASSERTeq(merged, entries[1]);
+	UT_ASSERTeq(membuf_alloc(mbuf, 1), NULL);
+
+	membuf_free(merged);
+	UT_ASSERTeq(membuf_alloc(mbuf, 1), entries[1]);
+	UT_ASSERTne(membuf_alloc(mbuf, 1), NULL);
+
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+/*
+ * membuf_test_pages -- buffers backed by any pages hold as many entries as
+ * the regular ones, all of them usable, registering a thread creates its
+ * buffer only once
+ */
+void
+membuf_test_pages(enum membuf_pages pages)
+{
+	struct membuf *mbuf = membuf_new_ext(TEST_USER_DATA,
+		MEMBUF_MODE_FREE_LISTS);
+	UT_ASSERTne(mbuf, NULL);
+	struct membuf *regular = membuf_new_ext(TEST_USER_DATA,
+		MEMBUF_MODE_FREE_LISTS);
+	UT_ASSERTne(regular, NULL);
+	membuf_set_pages(mbuf, pages, 1);
+
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	UT_ASSERTeq(membuf_register_thread(mbuf), 0);
+	UT_ASSERTeq(membuf_register_thread(mbuf), 0);
+	int entries_max = membuf_test_fill(mbuf, entries);
+	for (int i = 0; i < entries_max; ++i) {
+		UT_ASSERTeq(membuf_ptr_user_data(entries[i]), TEST_USER_DATA);
+		memset(entries[i], i, sizeof(struct test_entry));
+	}
+	for (int i = 0; i < entries_max; ++i)
+		membuf_free(entries[i]);
+
+	UT_ASSERTeq(membuf_test_fill(regular, entries), entries_max);
+	UT_ASSERTeq(membuf_test_fill(mbuf, entries), entries_max);
+
+	/* the buffer of another thread is backed the same way */
+	os_thread_t th;
+	os_thread_create(&th, NULL, membuf_alloc_thread, mbuf);
+	void *ptr;
+	os_thread_join(&th, &ptr);
+	UT_ASSERTne(ptr, NULL);
+	UT_ASSERTeq(membuf_ptr_user_data(ptr), TEST_USER_DATA);
+
+	membuf_delete(regular);
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+/*
+ * membuf_test_chain -- a full buffer of a thread is followed by further ones
+ * up to the limit, an empty one is given back for reuse by other threads
+ */
+void
+membuf_test_chain(enum membuf_mode mode)
+{
+	struct membuf *mbuf = membuf_new_ext(TEST_USER_DATA, mode);
+	UT_ASSERTne(mbuf, NULL);
+	struct membuf *single = membuf_new_ext(TEST_USER_DATA, mode);
+	UT_ASSERTne(single, NULL);
+	membuf_set_max_threadbufs(mbuf, TEST_MAX_THREADBUFS);
+
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	int n = membuf_test_fill(single, entries);
+	int entries_max = membuf_test_fill(mbuf, entries);
+	UT_ASSERTeq(entries_max, n * TEST_MAX_THREADBUFS);
+	for (int i = 0; i < entries_max; ++i)
+		UT_ASSERTeq(membuf_ptr_user_data(entries[i]), TEST_USER_DATA);
+
+	/* entries of each threadbuf were allocated one after another */
+	uintptr_t second = TEST_THREADBUF(entries[n]);
+	UT_ASSERTne(TEST_THREADBUF(entries[0]), second);
+	UT_ASSERTeq(TEST_THREADBUF(entries[2 * n - 1]), second);
+
+	/* empty the first two, the last one stays full */
+	for (int i = 0; i < 2 * n; ++i)
+		membuf_free(entries[i]);
+
+	/* the first one is used again, the second one is given back */
+	void *ptr = membuf_alloc(mbuf, sizeof(struct test_entry));
+	UT_ASSERTeq(TEST_THREADBUF(ptr), TEST_THREADBUF(entries[0]));
+
+	os_thread_t th;
+	os_thread_create(&th, NULL, membuf_alloc_thread, mbuf);
+	void *other;
+	os_thread_join(&th, &other);
+	UT_ASSERTeq(TEST_THREADBUF(other), second);
+
+	membuf_delete(single);
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+struct free_ctx {
+	struct test_entry **entries;
+	int n;
+};
+
+void *
+membuf_free_thread(void *arg)
+{
+	struct free_ctx *ctx = arg;
+	for (int i = 0; i < ctx->n; ++i)
+		membuf_free(ctx->entries[i]);
+
+	return NULL;
+}
+
+/*
+ * membuf_test_remote_free -- objects freed concurrently by other threads are
+ * reused by the owner of the buffer, objects of different sizes coexist
+ */
+void
+membuf_test_remote_free(enum membuf_mode mode)
+{
+	struct membuf *mbuf = membuf_new_ext(TEST_USER_DATA, mode);
+	UT_ASSERTne(mbuf, NULL);
+
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	void *small = membuf_alloc(mbuf, 1);
+	UT_ASSERTne(small, NULL);
+	UT_ASSERTeq(membuf_ptr_user_data(small), TEST_USER_DATA);
+
+	int entries_max = membuf_test_fill(mbuf, entries);
+
+	/* two threads free the halves of the entries at the same time */
+	os_thread_t th[2];
+	struct free_ctx ctx[2] = {
+		{entries, entries_max / 2},
+		{entries + entries_max / 2, entries_max - entries_max / 2},
+	};
+	for (int t = 0; t < 2; ++t)
+		os_thread_create(&th[t], NULL, membuf_free_thread, &ctx[t]);
+	for (int t = 0; t < 2; ++t)
+		os_thread_join(&th[t], NULL);
+
+	UT_ASSERTeq(membuf_test_fill(mbuf, entries), entries_max);
+	for (int i = 0; i < entries_max; ++i)
+		UT_ASSERTeq(membuf_ptr_user_data(entries[i]), TEST_USER_DATA);
+
+	/* a slab reuses the freed object right away */
+	membuf_free(small);
+	if (mode == MEMBUF_MODE_SLAB)
+		UT_ASSERTeq(membuf_alloc(mbuf, 1), small);
+
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+/*
+ * membuf_test_slab_alignment -- slab objects of sizes which are multiples of
+ * the cache line never straddle one, whatever was allocated before them
+ */
+void
+membuf_test_slab_alignment(void)
+{
+	struct membuf *mbuf = membuf_new_ext(NULL, MEMBUF_MODE_SLAB);
+	UT_ASSERTne(mbuf, NULL);
+
+	for (int i = 0; i < TEST_NOBJECTS; ++i) {
+		UT_ASSERTne(membuf_alloc(mbuf, 24), NULL);
+		void *obj = membuf_alloc(mbuf, TEST_CACHELINE * 3);
+		UT_ASSERTne(obj, NULL);
+		uintptr_t misalignment = (uintptr_t)obj & (TEST_CACHELINE - 1);
+		UT_ASSERTeq(misalignment, 0);
+	}
+
+	membuf_delete(mbuf);
+}
+
 int
 main(int argc, char *argv[])
 {
-	membuf_test_st_reuse();
-	membuf_test_mt_reuse();
+	membuf_test_st_reuse(MEMBUF_MODE_RING);
+	membuf_test_mt_reuse(MEMBUF_MODE_RING);
+	membuf_test_st_reuse(MEMBUF_MODE_FREE_LISTS);
+	membuf_test_mt_reuse(MEMBUF_MODE_FREE_LISTS);
+	membuf_test_pinned(MEMBUF_MODE_RING);
+	membuf_test_pinned(MEMBUF_MODE_FREE_LISTS);
+	membuf_test_merge();
+	membuf_test_st_reuse(MEMBUF_MODE_SLAB);
+	membuf_test_mt_reuse(MEMBUF_MODE_SLAB);
+	membuf_test_pinned(MEMBUF_MODE_SLAB);
+	membuf_test_remote_free(MEMBUF_MODE_FREE_LISTS);
+	membuf_test_remote_free(MEMBUF_MODE_SLAB);
+	membuf_test_slab_alignment();
+
+	membuf_test_chain(MEMBUF_MODE_RING);
+	membuf_test_chain(MEMBUF_MODE_FREE_LISTS);
+	membuf_test_chain(MEMBUF_MODE_SLAB);
+
+	/* huge pages might be unavailable, the next best ones are used then */
+	membuf_test_pages(MEMBUF_PAGES_DEFAULT);
+	membuf_test_pages(MEMBUF_PAGES_TRANSPARENT_HUGE);
+	membuf_test_pages(MEMBUF_PAGES_HUGETLB);
 
 	return 0;
 }
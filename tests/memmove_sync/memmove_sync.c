@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "libminiasync.h"
+#include "core/flush.h"
+#include "core/memops.h"
 #include "test_helpers.h"
 
 /*
@@ -171,8 +173,8 @@ int test_supported_flags() {
 		return 1;
 	}
 	struct vdm *sync_mover = data_mover_sync_get_vdm(dms);
-	int ret = test_flag(sync_mover, VDM_F_MEM_DURABLE, 0);
-	ret += test_flag(sync_mover, VDM_F_NO_CACHE_HINT, 0);
+	int ret = test_flag(sync_mover, VDM_F_MEM_DURABLE, FLUSH_DURABLE);
+	ret += test_flag(sync_mover, VDM_F_NO_CACHE_HINT, MEMOPS_NT);
 	data_mover_sync_delete(dms);
 	return ret;
 }
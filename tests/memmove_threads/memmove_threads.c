@@ -5,6 +5,8 @@
 #include <string.h>
 #include <time.h>
 #include "libminiasync.h"
+#include "core/flush.h"
+#include "core/memops.h"
 #include "core/os.h"
 #include "test_helpers.h"
 
@@ -152,7 +154,8 @@ int test_supported_flags() {
 		return 1;
 	}
 	struct vdm *thread_mover = data_mover_threads_get_vdm(dmt);
-	int ret = test_flag(thread_mover, VDM_F_MEM_DURABLE, 0);
+	int ret = test_flag(thread_mover, VDM_F_MEM_DURABLE, FLUSH_DURABLE);
+	ret += test_flag(thread_mover, VDM_F_NO_CACHE_HINT, MEMOPS_NT);
 	data_mover_threads_delete(dmt);
 
 	return ret;
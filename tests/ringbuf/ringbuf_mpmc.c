@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "core/os.h"
+#include "core/ringbuf.h"
+#include "core/util.h"
+#include "os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_RINGBUF_SIZE 8
+#define TEST_NTHREADS 4
+#define TEST_NVALUES 20000
+#define TEST_BULK 5 /* doesn't divide the length, so bulks wrap around */
+
+/* values enqueued are 1..n, so that none of them is NULL */
+#define VALUE(i) ((void *)(uintptr_t)((i) + 1))
+
+enum test_mode {
+	TEST_MODE_BLOCKING,
+	TEST_MODE_TRY, /* try first, then block */
+	TEST_MODE_BULK, /* many values at once */
+};
+
+struct test_ctx {
+	struct ringbuf *rbuf;
+	uint64_t sum; /* of the values dequeued by a consumer */
+	uint64_t count;
+	enum test_mode mode;
+};
+
+/*
+ * ringbuf_test_basic -- a full buffer rejects values, an empty one returns
+ * none, values come out in the order they went in
+ */
+static void
+ringbuf_test_basic(void)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_RINGBUF_SIZE);
+	UT_ASSERTne(rbuf, NULL);
+	UT_ASSERTeq(ringbuf_new(TEST_RINGBUF_SIZE + 1), NULL);
+	UT_ASSERTeq(ringbuf_length(rbuf), TEST_RINGBUF_SIZE);
+
+	/* go around the buffer a few times */
+	for (uintptr_t lap = 0; lap < 3; ++lap) {
+		UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+		for (uintptr_t i = 0; i < TEST_RINGBUF_SIZE; ++i)
+			UT_ASSERTeq(ringbuf_tryenqueue(rbuf, VALUE(i)), 0);
+		UT_ASSERTeq(ringbuf_tryenqueue(rbuf, VALUE(0)), -1);
+		UT_ASSERTeq(ringbuf_count(rbuf), TEST_RINGBUF_SIZE);
+
+		for (uintptr_t i = 0; i < TEST_RINGBUF_SIZE; ++i)
+			UT_ASSERTeq(ringbuf_dequeue(rbuf), VALUE(i));
+		UT_ASSERTeq(ringbuf_count(rbuf), 0);
+	}
+
+	/* the time runs out on an empty buffer */
+	struct timespec abstime;
+	os_clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_nsec += 1000000;
+	if (abstime.tv_nsec >= 1000000000) {
+		abstime.tv_sec += 1;
+		abstime.tv_nsec -= 1000000000;
+	}
+	UT_ASSERTeq(ringbuf_dequeue_timed(rbuf, &abstime), NULL);
+	UT_ASSERTeq(errno, ETIMEDOUT);
+
+	UT_ASSERTeq(ringbuf_tryenqueue(rbuf, VALUE(7)), 0);
+	UT_ASSERTeq(ringbuf_dequeue_timed(rbuf, &abstime), VALUE(7));
+
+	ringbuf_stop(rbuf);
+	UT_ASSERTeq(ringbuf_dequeue(rbuf), NULL);
+	ringbuf_delete(rbuf);
+}
+
+/*
+ * ringbuf_test_bulk -- as many values as fit are enqueued at once, up to
+ * the requested number of them are dequeued at once, in order
+ */
+static void
+ringbuf_test_bulk(void)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_RINGBUF_SIZE);
+	UT_ASSERTne(rbuf, NULL);
+
+	void *in[TEST_RINGBUF_SIZE * 2];
+	void *out[TEST_RINGBUF_SIZE * 2];
+	for (uintptr_t i = 0; i < TEST_RINGBUF_SIZE * 2; ++i)
+		in[i] = VALUE(i);
+
+	UT_ASSERTeq(ringbuf_trydequeue_n(rbuf, out, TEST_RINGBUF_SIZE), 0);
+
+	/* only the values which fit are enqueued */
+	UT_ASSERTeq(ringbuf_tryenqueue_n(rbuf, in, TEST_BULK), TEST_BULK);
+	UT_ASSERTeq(ringbuf_tryenqueue_n(rbuf, in + TEST_BULK,
+		TEST_RINGBUF_SIZE), TEST_RINGBUF_SIZE - TEST_BULK);
+	UT_ASSERTeq(ringbuf_tryenqueue_n(rbuf, in, 1), 0);
+
+	UT_ASSERTeq(ringbuf_trydequeue_n(rbuf, out, 3), 3);
+	for (uintptr_t i = 0; i < 3; ++i)
+		UT_ASSERTeq(out[i], VALUE(i));
+
+	/* the freed slots are at the beginning of the next lap */
+	UT_ASSERTeq(ringbuf_tryenqueue_n(rbuf, in + TEST_RINGBUF_SIZE,
+		TEST_BULK), 3);
+
+	UT_ASSERTeq(ringbuf_trydequeue_n(rbuf, out, TEST_RINGBUF_SIZE * 2),
+		TEST_RINGBUF_SIZE);
+	for (uintptr_t i = 0; i < TEST_RINGBUF_SIZE; ++i)
+		UT_ASSERTeq(out[i], VALUE(i + 3));
+	UT_ASSERTeq(ringbuf_count(rbuf), 0);
+
+	UT_ASSERTeq(ringbuf_enqueue_n(rbuf, in, TEST_RINGBUF_SIZE), 0);
+	UT_ASSERTeq(ringbuf_trydequeue_n(rbuf, out, TEST_RINGBUF_SIZE),
+		TEST_RINGBUF_SIZE);
+
+	ringbuf_stop(rbuf);
+	UT_ASSERTeq(ringbuf_trydequeue_n(rbuf, out, 1), 0);
+	ringbuf_delete(rbuf);
+}
+
+/*
+ * producer -- enqueues its share of the values, blocking on a full buffer
+ */
+static void *
+producer(void *arg)
+{
+	struct test_ctx *ctx = arg;
+
+	void *values[TEST_BULK];
+
+	for (uintptr_t i = 0; i < TEST_NVALUES; ) {
+		if (ctx->mode == TEST_MODE_BULK) {
+			unsigned n = (unsigned)MIN(TEST_BULK,
+				TEST_NVALUES - i);
+			for (unsigned j = 0; j < n; ++j)
+				values[j] = VALUE(i + j);
+			ringbuf_enqueue_n(ctx->rbuf, values, n);
+			i += n;
+			continue;
+		}
+
+		if (ctx->mode != TEST_MODE_TRY ||
+				ringbuf_tryenqueue(ctx->rbuf, VALUE(i)) != 0)
+			ringbuf_enqueue(ctx->rbuf, VALUE(i));
+		i++;
+	}
+
+	return NULL;
+}
+
+/*
+ * consumer -- dequeues values until the buffer is stopped
+ */
+static void *
+consumer(void *arg)
+{
+	struct test_ctx *ctx = arg;
+	void *data[TEST_BULK];
+	unsigned n;
+
+	for (;;) {
+		if (ctx->mode != TEST_MODE_BULK || (n = ringbuf_trydequeue_n(
+				ctx->rbuf, data, TEST_BULK)) == 0) {
+			/* block until there's anything to dequeue */
+			if ((data[0] = ringbuf_dequeue(ctx->rbuf)) == NULL)
+				break;
+			n = 1;
+		}
+
+		for (unsigned i = 0; i < n; ++i)
+			ctx->sum += (uintptr_t)data[i];
+		ctx->count += n;
+	}
+
+	return NULL;
+}
+
+/*
+ * ringbuf_test_mpmc -- every value enqueued by multiple producers must be
+ * dequeued exactly once by multiple consumers
+ */
+static void
+ringbuf_test_mpmc(enum test_mode mode)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_RINGBUF_SIZE);
+	UT_ASSERTne(rbuf, NULL);
+
+	os_thread_t producers[TEST_NTHREADS];
+	os_thread_t consumers[TEST_NTHREADS];
+	struct test_ctx pctx[TEST_NTHREADS];
+	struct test_ctx cctx[TEST_NTHREADS];
+
+	for (size_t i = 0; i < TEST_NTHREADS; ++i) {
+		cctx[i] = (struct test_ctx){rbuf, 0, 0, mode};
+		os_thread_create(&consumers[i], NULL, consumer, &cctx[i]);
+	}
+	for (size_t i = 0; i < TEST_NTHREADS; ++i) {
+		pctx[i] = (struct test_ctx){rbuf, 0, 0, mode};
+		os_thread_create(&producers[i], NULL, producer, &pctx[i]);
+	}
+
+	for (size_t i = 0; i < TEST_NTHREADS; ++i)
+		os_thread_join(&producers[i], NULL);
+
+	/* waits until all the values are dequeued, then unblocks consumers */
+	ringbuf_stop(rbuf);
+
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	for (size_t i = 0; i < TEST_NTHREADS; ++i) {
+		os_thread_join(&consumers[i], NULL);
+		sum += cctx[i].sum;
+		count += cctx[i].count;
+	}
+
+	UT_ASSERTeq(count, (uint64_t)TEST_NVALUES * TEST_NTHREADS);
+	UT_ASSERTeq(sum, (uint64_t)TEST_NVALUES * (TEST_NVALUES + 1) / 2 *
+		TEST_NTHREADS);
+
+	ringbuf_delete(rbuf);
+}
+
+int
+main(void)
+{
+	ringbuf_test_basic();
+	ringbuf_test_bulk();
+	ringbuf_test_mpmc(TEST_MODE_BLOCKING);
+	ringbuf_test_mpmc(TEST_MODE_TRY);
+	ringbuf_test_mpmc(TEST_MODE_BULK);
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 2
+#define TEST_RINGBUF_SIZE 128
+#define TEST_SIZE (1 << 18)
+#define TEST_NCOUNTDOWNS 8
+#define TEST_NCOPIES 4
+#define TEST_NROUNDS 16
+#define TEST_SLEEP_TIME_NS 10000
+
+struct countdown_data {
+	uint64_t counter;
+};
+
+struct countdown_output {
+	uint64_t polls;
+};
+
+FUTURE(countdown_fut, struct countdown_data, struct countdown_output);
+
+/*
+ * countdown_task -- completes the future once its counter drops to zero,
+ * without any notifier
+ */
+static enum future_state
+countdown_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countdown_data *data = future_context_get_data(context);
+	struct countdown_output *output = future_context_get_output(context);
+	output->polls++;
+
+	return --data->counter == 0 ?
+		FUTURE_STATE_COMPLETE : FUTURE_STATE_RUNNING;
+}
+
+static struct countdown_fut
+countdown_async(uint64_t counter)
+{
+	struct countdown_fut fut = {.output.polls = 0};
+	FUTURE_INIT(&fut, countdown_task);
+	fut.data.counter = counter;
+
+	return fut;
+}
+
+/*
+ * runtime_with_policy -- creates a runtime with the given wait policy
+ */
+static struct runtime *
+runtime_with_policy(enum runtime_wait_policy policy, uint64_t spin_count)
+{
+	struct runtime_config *cfg = runtime_config_new();
+	UT_ASSERTne(cfg, NULL);
+	runtime_config_set_wait_policy(cfg, policy);
+	runtime_config_set_spin_count(cfg, spin_count);
+	runtime_config_set_sleep_time(cfg, TEST_SLEEP_TIME_NS);
+	struct runtime *r = runtime_new_ext(cfg);
+	runtime_config_delete(cfg);
+
+	return r;
+}
+
+/*
+ * test_invalid_policy -- a runtime can't be created with an unknown policy
+ */
+static void
+test_invalid_policy(void)
+{
+	UT_ASSERTeq(runtime_with_policy((enum runtime_wait_policy)100, 0),
+		NULL);
+}
+
+/*
+ * test_policy -- waits for futures which need many polls and for operations
+ * of the threads data movers using the waker and the poller notifiers
+ */
+static void
+test_policy(enum runtime_wait_policy policy, uint64_t spin_count,
+	struct vdm *waker_vdm, struct vdm *poller_vdm)
+{
+	struct runtime *r = runtime_with_policy(policy, spin_count);
+	UT_ASSERTne(r, NULL);
+
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc((size_t)TEST_SIZE * TEST_NCOPIES * 2);
+	UT_ASSERTne(dst, NULL);
+	for (size_t i = 0; i < TEST_SIZE; ++i)
+		src[i] = (char)(i % 251);
+
+	/* repeated, so that the adaptive policy has a history to go by */
+	for (unsigned round = 0; round < TEST_NROUNDS; ++round) {
+		memset(dst, 0, (size_t)TEST_SIZE * TEST_NCOPIES * 2);
+
+		struct countdown_fut countdowns[TEST_NCOUNTDOWNS];
+		struct vdm_operation_future copies[TEST_NCOPIES * 2];
+		struct future *futs[TEST_NCOUNTDOWNS + TEST_NCOPIES * 2];
+		size_t n = 0;
+
+		for (size_t i = 0; i < TEST_NCOUNTDOWNS; ++i) {
+			countdowns[i] = countdown_async(1 + i * 4);
+			futs[n++] = FUTURE_AS_RUNNABLE(&countdowns[i]);
+		}
+		for (size_t i = 0; i < TEST_NCOPIES * 2; ++i) {
+			struct vdm *vdm = i % 2 ? poller_vdm : waker_vdm;
+			copies[i] = vdm_memcpy(vdm, dst + i * TEST_SIZE, src,
+				TEST_SIZE, 0);
+			futs[n++] = FUTURE_AS_RUNNABLE(&copies[i]);
+		}
+
+		runtime_wait_multiple(r, futs, n);
+
+		for (size_t i = 0; i < TEST_NCOUNTDOWNS; ++i) {
+			UT_ASSERTeq(FUTURE_STATE(&countdowns[i]),
+				FUTURE_STATE_COMPLETE);
+			UT_ASSERTeq(FUTURE_OUTPUT(&countdowns[i])->polls,
+				1 + i * 4);
+		}
+		for (size_t i = 0; i < TEST_NCOPIES * 2; ++i) {
+			UT_ASSERTeq(FUTURE_OUTPUT(&copies[i])->result,
+				VDM_SUCCESS);
+			UT_ASSERTeq(memcmp(dst + i * TEST_SIZE, src,
+				TEST_SIZE), 0);
+		}
+	}
+
+	free(dst);
+	free(src);
+	runtime_delete(r);
+}
+
+int
+main(void)
+{
+	struct data_mover_threads *waker_dmt = data_mover_threads_new(
+		TEST_NTHREADS, TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(waker_dmt, NULL);
+	struct data_mover_threads *poller_dmt = data_mover_threads_new(
+		TEST_NTHREADS, TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_POLLER);
+	UT_ASSERTne(poller_dmt, NULL);
+	struct vdm *waker_vdm = data_mover_threads_get_vdm(waker_dmt);
+	struct vdm *poller_vdm = data_mover_threads_get_vdm(poller_dmt);
+
+	test_invalid_policy();
+
+	test_policy(RUNTIME_WAIT_BLOCK, 1000, waker_vdm, poller_vdm);
+	test_policy(RUNTIME_WAIT_HYBRID, 1000, waker_vdm, poller_vdm);
+	/* the futures are still polled before each sleep */
+	test_policy(RUNTIME_WAIT_HYBRID, 0, waker_vdm, poller_vdm);
+	test_policy(RUNTIME_WAIT_BUSY_POLL, 0, waker_vdm, poller_vdm);
+	test_policy(RUNTIME_WAIT_ADAPTIVE, 0, waker_vdm, poller_vdm);
+
+	data_mover_threads_delete(poller_dmt);
+	data_mover_threads_delete(waker_dmt);
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 2
+#define TEST_RINGBUF_SIZE 128
+#define TEST_SIZE (1 << 20)
+#define TEST_NCOPIES 8
+#define TEST_NCHAINS 8
+
+struct copy_twice_data {
+	FUTURE_CHAIN_ENTRY(struct vdm_operation_future, first);
+	FUTURE_CHAIN_ENTRY(struct vdm_operation_future, second);
+};
+
+struct copy_twice_output {
+	uint64_t unused;
+};
+
+FUTURE(copy_twice_fut, struct copy_twice_data, struct copy_twice_output);
+
+/*
+ * copy_twice -- copies src to tmp and then tmp to dest
+ */
+static struct copy_twice_fut
+copy_twice(struct vdm *vdm, char *dest, char *tmp, char *src, size_t n)
+{
+	struct copy_twice_fut fut = {.output.unused = 0};
+	FUTURE_CHAIN_ENTRY_INIT(&fut.data.first,
+		vdm_memcpy(vdm, tmp, src, n, 0), NULL, NULL);
+	FUTURE_CHAIN_ENTRY_INIT(&fut.data.second,
+		vdm_memcpy(vdm, dest, tmp, n, 0), NULL, NULL);
+	FUTURE_CHAIN_INIT(&fut);
+
+	return fut;
+}
+
+/*
+ * test_report -- a pending operation reports its word on every poll
+ */
+static void
+test_report(struct vdm *vdm, char *dest, char *src)
+{
+	struct vdm_operation_future fut = vdm_memcpy(vdm, dest, src,
+		TEST_SIZE, 0);
+
+	struct future_notifier n;
+	n.waker = (struct future_waker){NULL, NULL};
+	uint64_t *word = NULL;
+
+	for (;;) {
+		n.poller.ptr_to_monitor = NULL;
+		n.notifier_used = FUTURE_NOTIFIER_NONE;
+		if (future_poll(FUTURE_AS_RUNNABLE(&fut), &n) ==
+				FUTURE_STATE_COMPLETE)
+			break;
+
+		UT_ASSERTeq(n.notifier_used, FUTURE_NOTIFIER_POLLER);
+		UT_ASSERTne(n.poller.ptr_to_monitor, NULL);
+		if (word == NULL)
+			word = n.poller.ptr_to_monitor;
+		UT_ASSERTeq(n.poller.ptr_to_monitor, word);
+	}
+
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dest, src, TEST_SIZE), 0);
+}
+
+/*
+ * test_wait_single -- the runtime waits for the word of the only pending
+ * future
+ */
+static void
+test_wait_single(struct runtime *r, struct vdm *vdm, char *dest, char *src)
+{
+	memset(dest, 0, TEST_SIZE);
+
+	struct vdm_operation_future fut = vdm_memcpy(vdm, dest, src,
+		TEST_SIZE, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+
+	UT_ASSERTeq(FUTURE_STATE(&fut), FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dest, src, TEST_SIZE), 0);
+}
+
+/*
+ * test_wait_multiple -- the runtime watches the words of many futures,
+ * chained ones move on to operations with other words, whose previous ones
+ * are freed by then
+ */
+static void
+test_wait_multiple(struct runtime *r, struct vdm *vdm, char *src)
+{
+	size_t nbufs = TEST_NCOPIES + TEST_NCHAINS * 2;
+	char *bufs = malloc((size_t)TEST_SIZE * nbufs);
+	UT_ASSERTne(bufs, NULL);
+	memset(bufs, 0, (size_t)TEST_SIZE * nbufs);
+
+	struct vdm_operation_future copies[TEST_NCOPIES];
+	struct copy_twice_fut chains[TEST_NCHAINS];
+	struct future *futs[TEST_NCOPIES + TEST_NCHAINS];
+
+	for (size_t i = 0; i < TEST_NCOPIES; ++i) {
+		copies[i] = vdm_memcpy(vdm, bufs + i * TEST_SIZE, src,
+			TEST_SIZE, 0);
+		futs[i] = FUTURE_AS_RUNNABLE(&copies[i]);
+	}
+	for (size_t i = 0; i < TEST_NCHAINS; ++i) {
+		char *tmp = bufs + (TEST_NCOPIES + i * 2) * TEST_SIZE;
+		chains[i] = copy_twice(vdm, tmp + TEST_SIZE, tmp, src,
+			TEST_SIZE);
+		futs[TEST_NCOPIES + i] = FUTURE_AS_RUNNABLE(&chains[i]);
+	}
+
+	runtime_wait_multiple(r, futs, TEST_NCOPIES + TEST_NCHAINS);
+
+	for (size_t i = 0; i < TEST_NCOPIES; ++i)
+		UT_ASSERTeq(FUTURE_OUTPUT(&copies[i])->result, VDM_SUCCESS);
+	for (size_t i = 0; i < TEST_NCHAINS; ++i)
+		UT_ASSERTeq(FUTURE_STATE(&chains[i]), FUTURE_STATE_COMPLETE);
+	for (size_t i = 0; i < nbufs; ++i)
+		UT_ASSERTeq(memcmp(bufs + i * TEST_SIZE, src, TEST_SIZE), 0);
+
+	free(bufs);
+}
+
+int
+main(void)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_POLLER);
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dest = malloc(TEST_SIZE);
+	UT_ASSERTne(dest, NULL);
+	for (size_t i = 0; i < TEST_SIZE; ++i)
+		src[i] = (char)(i % 251);
+
+	test_report(vdm, dest, src);
+	test_wait_single(r, vdm, dest, src);
+	test_wait_multiple(r, vdm, src);
+
+	free(dest);
+	free(src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libminiasync.h"
+#include "core/os.h"
+#include "core/util.h"
+#include "test_helpers.h"
+
+#define TEST_NEXECUTORS 4
+#define TEST_NSUMS 512
+#define TEST_NCOPIES 128
+#define TEST_SUM_STEPS 16
+#define TEST_SUM_STEP_LEN 1000
+#define TEST_COPY_SIZE 4096
+#define TEST_GATE_TIME_NS 50000000ULL
+/* far fewer than an executor spinning on the future would make */
+#define TEST_GATE_MAX_POLLS 1000
+
+struct sum_data {
+	uint64_t next; /* the next number to be added */
+	uint64_t end;
+	uint64_t polling; /* set while the future is being polled */
+};
+
+struct sum_output {
+	uint64_t sum;
+};
+
+FUTURE(sum_fut, struct sum_data, struct sum_output);
+
+/*
+ * sum_task -- adds up a range of numbers, a part of it on each poll
+ */
+static enum future_state
+sum_task(struct future_context *context, struct future_notifier *notifier)
+{
+	struct sum_data *data = future_context_get_data(context);
+	struct sum_output *output = future_context_get_output(context);
+
+	/* a future must never be polled by two executors at once */
+	UT_ASSERTeq(util_bool_compare_and_swap64(&data->polling, 0, 1), 1);
+
+	uint64_t end = MIN(data->next + TEST_SUM_STEP_LEN, data->end);
+	for (; data->next < end; ++data->next)
+		output->sum += data->next;
+
+	util_atomic_store_explicit64(&data->polling, 0, memory_order_release);
+
+	return data->next == data->end ?
+		FUTURE_STATE_COMPLETE : FUTURE_STATE_RUNNING;
+}
+
+static struct sum_fut
+sum_async(uint64_t end)
+{
+	struct sum_fut fut = {.output.sum = 0};
+	FUTURE_INIT(&fut, sum_task);
+	fut.data.next = 0;
+	fut.data.end = end;
+	fut.data.polling = 0;
+
+	return fut;
+}
+
+/*
+ * test_no_executors -- a runtime without executor threads can't run spawned
+ * futures
+ */
+static void
+test_no_executors(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct sum_fut fut = sum_async(1);
+	UT_ASSERTeq(runtime_spawn(r, FUTURE_AS_RUNNABLE(&fut)), NULL);
+
+	runtime_delete(r);
+}
+
+/*
+ * test_spawn -- cpu-bound futures and memcpy futures of the threads data
+ * mover, which wait for their wakers, are all run by the executors
+ */
+static void
+test_spawn(void)
+{
+	struct runtime_config *cfg = runtime_config_new();
+	UT_ASSERTne(cfg, NULL);
+	runtime_config_set_nthreads(cfg, TEST_NEXECUTORS);
+	struct runtime *r = runtime_new_ext(cfg);
+	UT_ASSERTne(r, NULL);
+	runtime_config_delete(cfg);
+
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	size_t nfuts = TEST_NSUMS + TEST_NCOPIES;
+	struct sum_fut *sums = malloc(sizeof(*sums) * TEST_NSUMS);
+	UT_ASSERTne(sums, NULL);
+	struct vdm_operation_future *copies =
+		malloc(sizeof(*copies) * TEST_NCOPIES);
+	UT_ASSERTne(copies, NULL);
+	struct runtime_join_future *joins = malloc(sizeof(*joins) * nfuts);
+	UT_ASSERTne(joins, NULL);
+	struct future **futs = malloc(sizeof(*futs) * nfuts);
+	UT_ASSERTne(futs, NULL);
+	char *src = malloc(TEST_COPY_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc((size_t)TEST_COPY_SIZE * TEST_NCOPIES);
+	UT_ASSERTne(dst, NULL);
+
+	for (size_t i = 0; i < TEST_COPY_SIZE; ++i)
+		src[i] = (char)(i % 251);
+	memset(dst, 0, (size_t)TEST_COPY_SIZE * TEST_NCOPIES);
+
+	size_t n = 0;
+	for (size_t i = 0; i < nfuts; ++i) {
+		struct future *fut;
+		if (i % 5 == 0 && i / 5 < TEST_NCOPIES) {
+			size_t c = i / 5;
+			copies[c] = vdm_memcpy(vdm, dst + c * TEST_COPY_SIZE,
+				src, TEST_COPY_SIZE, 0);
+			fut = FUTURE_AS_RUNNABLE(&copies[c]);
+		} else {
+			sums[n] = sum_async(TEST_SUM_STEPS * TEST_SUM_STEP_LEN +
+				n);
+			fut = FUTURE_AS_RUNNABLE(&sums[n++]);
+		}
+
+		struct runtime_task *task = runtime_spawn(r, fut);
+		UT_ASSERTne(task, NULL);
+		joins[i] = runtime_join(task);
+		futs[i] = FUTURE_AS_RUNNABLE(&joins[i]);
+	}
+	UT_ASSERTeq(n, TEST_NSUMS);
+
+	runtime_wait_multiple(r, futs, nfuts);
+
+	for (size_t i = 0; i < nfuts; ++i)
+		UT_ASSERTne(FUTURE_OUTPUT(&joins[i])->fut, NULL);
+
+	for (size_t i = 0; i < TEST_NSUMS; ++i) {
+		uint64_t end = sums[i].data.end;
+		UT_ASSERTeq(FUTURE_STATE(&sums[i]), FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&sums[i])->sum, end * (end - 1) / 2);
+	}
+
+	for (size_t c = 0; c < TEST_NCOPIES; ++c) {
+		UT_ASSERTeq(FUTURE_STATE(&copies[c]), FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&copies[c])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst + c * TEST_COPY_SIZE, src,
+			TEST_COPY_SIZE), 0);
+	}
+
+	free(dst);
+	free(src);
+	free(futs);
+	free(joins);
+	free(copies);
+	free(sums);
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+struct gate_data {
+	uint64_t *open; /* set once the future may complete */
+};
+
+struct gate_output {
+	uint64_t polls;
+};
+
+FUTURE(gate_fut, struct gate_data, struct gate_output);
+
+/*
+ * gate_task -- completes the future once the gate is open, without any
+ * notifier
+ */
+static enum future_state
+gate_task(struct future_context *context, struct future_notifier *notifier)
+{
+	struct gate_data *data = future_context_get_data(context);
+	struct gate_output *output = future_context_get_output(context);
+	output->polls++;
+
+	uint64_t open;
+	util_atomic_load_explicit64(data->open, &open, memory_order_acquire);
+
+	return open ? FUTURE_STATE_COMPLETE : FUTURE_STATE_RUNNING;
+}
+
+static struct gate_fut
+gate_async(uint64_t *open)
+{
+	struct gate_fut fut = {.output.polls = 0};
+	FUTURE_INIT(&fut, gate_task);
+	fut.data.open = open;
+
+	return fut;
+}
+
+/*
+ * test_backoff -- a spawned future which can't wake itself up is polled
+ * again after a delay, not over and over by a spinning executor
+ */
+static void
+test_backoff(void)
+{
+	struct runtime_config *cfg = runtime_config_new();
+	UT_ASSERTne(cfg, NULL);
+	runtime_config_set_nthreads(cfg, 1);
+	struct runtime *r = runtime_new_ext(cfg);
+	UT_ASSERTne(r, NULL);
+	runtime_config_delete(cfg);
+
+	uint64_t open = 0;
+	struct gate_fut gate = gate_async(&open);
+	struct runtime_task *task = runtime_spawn(r, FUTURE_AS_RUNNABLE(&gate));
+	UT_ASSERTne(task, NULL);
+
+	struct timespec start;
+	struct timespec now;
+	os_clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		WAIT();
+		os_clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ULL +
+		(uint64_t)now.tv_nsec - (uint64_t)start.tv_nsec <
+		TEST_GATE_TIME_NS);
+	util_atomic_store_explicit64(&open, 1, memory_order_release);
+
+	struct runtime_join_future join = runtime_join(task);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&join));
+	UT_ASSERTeq(FUTURE_STATE(&gate), FUTURE_STATE_COMPLETE);
+	UT_ASSERTin(FUTURE_OUTPUT(&gate)->polls, 1, TEST_GATE_MAX_POLLS);
+
+	runtime_delete(r);
+}
+
+int
+main(void)
+{
+	test_no_executors();
+	test_spawn();
+	test_backoff();
+
+	return 0;
+}
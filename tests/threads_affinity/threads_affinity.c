@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/topology.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_RINGBUF_SIZE 32
+#define TEST_NOPS 64
+#define TEST_SIZE (1 << 12)
+
+/*
+ * test_memcpy -- runs a number of memcpy operations on the mover
+ */
+static void
+test_memcpy(struct data_mover_threads *dmt)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc((size_t)TEST_SIZE * TEST_NOPS);
+	UT_ASSERTne(dst, NULL);
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		src[j] = (char)(j % 251);
+
+	struct vdm_operation_future futs[TEST_NOPS];
+	struct future *runnable[TEST_NOPS];
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst + i * TEST_SIZE, src,
+			TEST_SIZE, 0);
+		runnable[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	runtime_wait_multiple(r, runnable, TEST_NOPS);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst + i * TEST_SIZE, src, TEST_SIZE), 0);
+	}
+
+	free(dst);
+	free(src);
+	runtime_delete(r);
+}
+
+/*
+ * test_affinity -- creates a mover with the given affinity policy and cpu set
+ * and checks that it executes operations
+ */
+static void
+test_affinity(enum data_mover_threads_affinity affinity, const size_t *cpus,
+	size_t ncpus)
+{
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, TEST_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_affinity(cfg, affinity);
+	UT_ASSERTeq(data_mover_threads_config_set_cpus(cfg, cpus, ncpus), 0);
+
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+
+	test_memcpy(dmt);
+
+	data_mover_threads_delete(dmt);
+}
+
+/*
+ * test_numa -- creates a numa aware mover with the given scheduling mode
+ * and affinity policy and checks that it executes operations
+ */
+static void
+test_numa(enum data_mover_threads_scheduling scheduling,
+	enum data_mover_threads_affinity affinity)
+{
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, TEST_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_scheduling(cfg, scheduling);
+	data_mover_threads_config_set_affinity(cfg, affinity);
+	data_mover_threads_config_set_numa_aware(cfg, 1);
+
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+
+	/* run twice, so that the second run uses the cached nodes */
+	test_memcpy(dmt);
+	test_memcpy(dmt);
+
+	data_mover_threads_delete(dmt);
+}
+
+/*
+ * test_mem_node -- the node of touched memory, if known, must be one
+ * of the nodes of the cpus
+ */
+static void
+test_mem_node(struct topology *topo)
+{
+	char *buf = malloc(TEST_SIZE);
+	UT_ASSERTne(buf, NULL);
+	memset(buf, 0, TEST_SIZE);
+
+	int node = topology_mem_node(buf);
+	if (node >= 0) {
+		size_t c;
+		for (c = 0; c < topo->ncpus; ++c) {
+			if (topo->cpus[c].node == (unsigned)node)
+				break;
+		}
+		UT_ASSERTne(c, topo->ncpus);
+	}
+
+	free(buf);
+}
+
+/*
+ * test_invalid -- creating a mover with an unknown affinity policy or
+ * without any usable cpus must fail
+ */
+static void
+test_invalid(void)
+{
+	size_t cpus[] = {1 << 20};
+
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+
+	data_mover_threads_config_set_affinity(cfg,
+		(enum data_mover_threads_affinity)100);
+	UT_ASSERTeq(data_mover_threads_new_ext(cfg), NULL);
+
+	data_mover_threads_config_set_affinity(cfg,
+		DATA_MOVER_THREADS_AFFINITY_COMPACT);
+	UT_ASSERTeq(data_mover_threads_config_set_cpus(cfg, cpus, 1), 0);
+	UT_ASSERTeq(data_mover_threads_new_ext(cfg), NULL);
+
+	data_mover_threads_config_delete(cfg);
+}
+
+int
+main(void)
+{
+	enum data_mover_threads_affinity policies[] = {
+		DATA_MOVER_THREADS_AFFINITY_NONE,
+		DATA_MOVER_THREADS_AFFINITY_COMPACT,
+		DATA_MOVER_THREADS_AFFINITY_SCATTER,
+		DATA_MOVER_THREADS_AFFINITY_PHYSICAL_CORES,
+		DATA_MOVER_THREADS_AFFINITY_AVOID_SMT,
+	};
+	struct topology *topo = topology_new();
+	UT_ASSERTne(topo, NULL);
+	size_t cpus[] = {topo->cpus[0].id};
+	test_mem_node(topo);
+	topology_delete(topo);
+
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+		test_affinity(policies[i], NULL, 0);
+		test_affinity(policies[i], cpus, 1);
+	}
+
+	test_numa(DATA_MOVER_THREADS_SCHEDULING_SHARED,
+		DATA_MOVER_THREADS_AFFINITY_NONE);
+	test_numa(DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING,
+		DATA_MOVER_THREADS_AFFINITY_COMPACT);
+
+	test_invalid();
+
+	return 0;
+}
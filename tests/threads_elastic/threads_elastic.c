@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libminiasync.h"
+#include "core/os.h"
+#include "core/util.h"
+#include "test_helpers.h"
+
+#define TEST_MIN_NTHREADS 1
+#define TEST_MAX_NTHREADS 4
+#define TEST_RINGBUF_SIZE 32
+#define TEST_NOPS 16
+#define TEST_SIZE 64
+#define TEST_IDLE_TIMEOUT 10 /* ms */
+#define TEST_GROW_DELAY 10 /* ms */
+#define TEST_LONG_GROW_DELAY 60000 /* ms, longer than any burst */
+
+/* the blocking memcpy holds the workers until this is set */
+static uint64_t release;
+
+/*
+ * blocking_memcpy -- memcpy that waits until the operations are released,
+ * so that every worker stays busy
+ */
+static void *
+blocking_memcpy(void *dst, const void *src, size_t n, unsigned flags)
+{
+	uint64_t released;
+	do {
+		util_atomic_load_explicit64(&release, &released,
+			memory_order_acquire);
+	} while (!released);
+
+	return memcpy(dst, src, n);
+}
+
+/*
+ * test_burst -- queues more operations than the workers can take, checks that
+ * the pool grows to its maximum size and shrinks back once it's idle
+ */
+static void
+test_burst(struct data_mover_threads *dmt, struct runtime *r)
+{
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	struct vdm_operation_future futs[TEST_NOPS];
+	char src[TEST_SIZE];
+	char dst[TEST_NOPS][TEST_SIZE];
+	memset(src, 'x', TEST_SIZE);
+	memset(dst, 0, sizeof(dst));
+
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), TEST_MIN_NTHREADS);
+
+	util_atomic_store_explicit64(&release, 0, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst[i], src, TEST_SIZE, 0);
+		future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL);
+	}
+
+	/* all the workers are busy and operations are still queued */
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), TEST_MAX_NTHREADS);
+
+	util_atomic_store_explicit64(&release, 1, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		struct future *fut = FUTURE_AS_RUNNABLE(&futs[i]);
+		if (future_poll(fut, NULL) != FUTURE_STATE_COMPLETE)
+			runtime_wait(r, fut);
+		UT_ASSERTeq(memcmp(dst[i], src, TEST_SIZE), 0);
+	}
+
+	/* idle workers exit, but not below the minimum */
+	while (data_mover_threads_get_nthreads(dmt) != TEST_MIN_NTHREADS)
+		WAIT();
+}
+
+/*
+ * elastic_new -- creates an elastic pool which adds a worker once
+ * the operations stay queued for grow_delay ms
+ */
+static struct data_mover_threads *
+elastic_new(uint64_t grow_delay)
+{
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads_range(cfg, TEST_MIN_NTHREADS,
+		TEST_MAX_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_grow_threshold(cfg, 1);
+	data_mover_threads_config_set_grow_delay(cfg, grow_delay);
+	data_mover_threads_config_set_idle_timeout(cfg, TEST_IDLE_TIMEOUT);
+
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+	data_mover_threads_set_memcpy_fn(dmt, blocking_memcpy);
+
+	return dmt;
+}
+
+/*
+ * elapsed_ms -- returns the time in milliseconds since start
+ */
+static uint64_t
+elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+	os_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000 +
+		(uint64_t)(now.tv_nsec / 1000000) -
+		(uint64_t)(start->tv_nsec / 1000000);
+}
+
+/*
+ * test_grow_delay -- a single short burst doesn't grow the pool, operations
+ * which stay queued for the grow delay do
+ */
+static void
+test_grow_delay(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	char src[TEST_SIZE];
+	char dst[TEST_NOPS + 1][TEST_SIZE];
+	memset(src, 'x', TEST_SIZE);
+	struct vdm_operation_future futs[TEST_NOPS + 1];
+
+	struct data_mover_threads *dmt = elastic_new(TEST_LONG_GROW_DELAY);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	util_atomic_store_explicit64(&release, 0, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst[i], src, TEST_SIZE, 0);
+		future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL);
+	}
+	util_atomic_store_explicit64(&release, 1, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i)
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&futs[i]));
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), TEST_MIN_NTHREADS);
+	data_mover_threads_delete(dmt);
+
+	dmt = elastic_new(TEST_GROW_DELAY);
+	vdm = data_mover_threads_get_vdm(dmt);
+	struct timespec start;
+	os_clock_gettime(CLOCK_MONOTONIC, &start);
+	util_atomic_store_explicit64(&release, 0, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst[i], src, TEST_SIZE, 0);
+		future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL);
+	}
+	if (elapsed_ms(&start) < TEST_GROW_DELAY)
+		UT_ASSERTeq(data_mover_threads_get_nthreads(dmt),
+			TEST_MIN_NTHREADS);
+
+	/* the operations are still queued once the delay is over */
+	os_clock_gettime(CLOCK_MONOTONIC, &start);
+	while (elapsed_ms(&start) <= TEST_GROW_DELAY)
+		WAIT();
+	futs[TEST_NOPS] = vdm_memcpy(vdm, dst[TEST_NOPS], src, TEST_SIZE, 0);
+	future_poll(FUTURE_AS_RUNNABLE(&futs[TEST_NOPS]), NULL);
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt),
+		TEST_MIN_NTHREADS + 1);
+
+	util_atomic_store_explicit64(&release, 1, memory_order_release);
+	for (size_t i = 0; i <= TEST_NOPS; ++i)
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&futs[i]));
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+/*
+ * test_elastic -- runs bursts of operations on an elastic pool
+ */
+static void
+test_elastic(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	/* a worker is added right away on each submission */
+	struct data_mover_threads *dmt = elastic_new(0);
+
+	/* the second burst reuses the slots of the retired workers */
+	test_burst(dmt, r);
+	test_burst(dmt, r);
+
+	/* statistics of all the slots stay available */
+	struct data_mover_threads_worker_stats stats;
+	UT_ASSERTeq(data_mover_threads_get_worker_stats(dmt,
+		TEST_MAX_NTHREADS - 1, &stats), 0);
+	UT_ASSERTne(stats.parks, 0);
+	UT_ASSERTeq(data_mover_threads_get_worker_stats(dmt,
+		TEST_MAX_NTHREADS, &stats), -1);
+
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+/*
+ * test_fixed -- pools which cannot be elastic start all of their workers
+ */
+static void
+test_fixed(void)
+{
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+
+	data_mover_threads_config_set_nthreads(cfg, TEST_MAX_NTHREADS);
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), TEST_MAX_NTHREADS);
+	data_mover_threads_delete(dmt);
+
+	data_mover_threads_config_set_nthreads_range(cfg, TEST_MIN_NTHREADS,
+		TEST_MAX_NTHREADS);
+	data_mover_threads_config_set_scheduling(cfg,
+		DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING);
+	dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), TEST_MAX_NTHREADS);
+	data_mover_threads_delete(dmt);
+
+	data_mover_threads_config_set_scheduling(cfg,
+		DATA_MOVER_THREADS_SCHEDULING_SHARED);
+	data_mover_threads_config_set_wait_policy(cfg,
+		DATA_MOVER_THREADS_WAIT_BUSY_POLL);
+	dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), TEST_MAX_NTHREADS);
+	data_mover_threads_delete(dmt);
+
+	/* the minimum must be positive and not above the maximum */
+	data_mover_threads_config_set_nthreads_range(cfg, 0, TEST_MAX_NTHREADS);
+	UT_ASSERTeq(data_mover_threads_new_ext(cfg), NULL);
+	data_mover_threads_config_set_nthreads_range(cfg, 2, 1);
+	UT_ASSERTeq(data_mover_threads_new_ext(cfg), NULL);
+
+	/* the default pool is bounded by the number of cpus */
+	data_mover_threads_config_set_wait_policy(cfg,
+		DATA_MOVER_THREADS_WAIT_BLOCK);
+	data_mover_threads_config_set_nthreads_range(cfg, 1, 0);
+	dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	UT_ASSERTeq(data_mover_threads_get_nthreads(dmt), 1);
+	data_mover_threads_delete(dmt);
+
+	data_mover_threads_config_delete(cfg);
+}
+
+int
+main(void)
+{
+	test_elastic();
+	test_grow_delay();
+	test_fixed();
+
+	return 0;
+}
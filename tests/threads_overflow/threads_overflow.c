@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/segqueue.h"
+#include "core/util.h"
+#include "test_helpers.h"
+
+#define TEST_SEGMENT_LEN 4
+#define TEST_RINGBUF_SIZE 2
+#define TEST_NOPS 16
+#define TEST_SIZE 64
+
+/* values pushed are 1..n, so that none of them is NULL */
+#define VALUE(i) ((void *)(uintptr_t)((i) + 1))
+
+/* the blocking memcpy holds the worker until this is set */
+static uint64_t release;
+
+/*
+ * blocking_memcpy -- memcpy that waits until the operations are released,
+ * so that the queue fills up
+ */
+static void *
+blocking_memcpy(void *dst, const void *src, size_t n, unsigned flags)
+{
+	uint64_t released;
+	do {
+		util_atomic_load_explicit64(&release, &released,
+			memory_order_acquire);
+	} while (!released);
+
+	return memcpy(dst, src, n);
+}
+
+/*
+ * test_segqueue -- values come out in the order they went in, the queue
+ * grows by segments up to its limit and frees the drained ones
+ */
+static void
+test_segqueue(void)
+{
+	struct segqueue *q = segqueue_new(TEST_SEGMENT_LEN, 2);
+	UT_ASSERTne(q, NULL);
+	UT_ASSERTeq(segqueue_pop(q), NULL);
+	UT_ASSERTeq(segqueue_nsegments(q), 0);
+
+	for (uintptr_t i = 0; i < TEST_SEGMENT_LEN * 2; ++i)
+		UT_ASSERTeq(segqueue_push(q, VALUE(i)), 0);
+	UT_ASSERTeq(segqueue_push(q, VALUE(0)), -1);
+	UT_ASSERTeq(segqueue_count(q), TEST_SEGMENT_LEN * 2);
+	UT_ASSERTeq(segqueue_nsegments(q), 2);
+
+	/* the first segment is freed once it's drained */
+	for (uintptr_t i = 0; i < TEST_SEGMENT_LEN; ++i)
+		UT_ASSERTeq(segqueue_pop(q), VALUE(i));
+	UT_ASSERTeq(segqueue_nsegments(q), 1);
+	UT_ASSERTeq(segqueue_push(q, VALUE(TEST_SEGMENT_LEN * 2)), 0);
+
+	for (uintptr_t i = TEST_SEGMENT_LEN; i <= TEST_SEGMENT_LEN * 2; ++i)
+		UT_ASSERTeq(segqueue_pop(q), VALUE(i));
+	UT_ASSERTeq(segqueue_pop(q), NULL);
+	UT_ASSERTeq(segqueue_count(q), 0);
+	UT_ASSERTeq(segqueue_nsegments(q), 0);
+
+	segqueue_delete(q);
+}
+
+/*
+ * test_overflow -- starts more operations than fit into the queue of
+ * the single, blocked worker, with the given overflow budget
+ */
+static void
+test_overflow(size_t overflow_size, int all_running)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, 1);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_overflow_size(cfg, overflow_size);
+
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+	data_mover_threads_set_memcpy_fn(dmt, blocking_memcpy);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	struct vdm_operation_future futs[TEST_NOPS];
+	char src[TEST_SIZE];
+	char dst[TEST_NOPS][TEST_SIZE];
+	memset(src, 'x', TEST_SIZE);
+	memset(dst, 0, sizeof(dst));
+
+	util_atomic_store_explicit64(&release, 0, memory_order_release);
+	size_t nidle = 0;
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst[i], src, TEST_SIZE, 0);
+		if (future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL) ==
+				FUTURE_STATE_IDLE)
+			nidle++;
+	}
+
+	/* operations that didn't fit were started only with enough budget */
+	if (all_running)
+		UT_ASSERTeq(nidle, 0);
+	else
+		UT_ASSERTne(nidle, 0);
+
+	util_atomic_store_explicit64(&release, 1, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		struct future *fut = FUTURE_AS_RUNNABLE(&futs[i]);
+		if (future_poll(fut, NULL) != FUTURE_STATE_COMPLETE)
+			runtime_wait(r, fut);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst[i], src, TEST_SIZE), 0);
+	}
+
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+int
+main(void)
+{
+	test_segqueue();
+
+	/* enough segments for all the operations */
+	test_overflow(TEST_NOPS * sizeof(void *), 1);
+
+	/* a single segment */
+	test_overflow(1, 0);
+
+	/* the overflow queue is disabled */
+	test_overflow(0, 0);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/util.h"
+#include "test_helpers.h"
+
+#define TEST_RINGBUF_SIZE 16
+#define TEST_NNORMAL 4 /* including the one blocking the worker */
+#define TEST_NPRIORITY 4
+#define TEST_NOPS (TEST_NNORMAL + TEST_NPRIORITY)
+#define TEST_SIZE 64
+#define TEST_NTHREADS 4
+#define TEST_CHUNK_SIZE 4096
+#define TEST_LARGE_SIZE (TEST_CHUNK_SIZE * TEST_NTHREADS)
+
+static char dst[TEST_NOPS][TEST_SIZE];
+
+/* the blocking memcpy holds the worker until this is set */
+static uint64_t release;
+static uint64_t started;
+
+/* indexes of the destinations in the order the operations were executed */
+static size_t order[TEST_NOPS];
+static uint64_t nexecuted;
+
+/*
+ * blocking_memcpy -- memcpy that records the order of operations and waits
+ * until they are released
+ */
+static void *
+blocking_memcpy(void *d, const void *src, size_t n, unsigned flags)
+{
+	util_atomic_store_explicit64(&started, 1, memory_order_release);
+
+	uint64_t released;
+	do {
+		util_atomic_load_explicit64(&release, &released,
+			memory_order_acquire);
+	} while (!released);
+
+	size_t i = (size_t)((char *)d - &dst[0][0]) / TEST_SIZE;
+	order[util_fetch_and_add64(&nexecuted, 1)] = i;
+
+	return memcpy(d, src, n);
+}
+
+/*
+ * test_order -- queues normal and priority operations behind one which
+ * blocks the single worker, checks the order in which they are executed
+ */
+static void
+test_order(size_t quota, const size_t *expected)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct data_mover_threads *dmt = data_mover_threads_new(1,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_set_memcpy_fn(dmt, blocking_memcpy);
+	data_mover_threads_set_priority_quota(dmt, quota);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	UT_ASSERTne(vdm_is_supported(vdm, VDM_F_PRIORITY), 0);
+
+	char src[TEST_SIZE];
+	memset(src, 'x', TEST_SIZE);
+	memset(dst, 0, sizeof(dst));
+	util_atomic_store_explicit64(&release, 0, memory_order_release);
+	util_atomic_store_explicit64(&started, 0, memory_order_release);
+	nexecuted = 0;
+
+	struct vdm_operation_future futs[TEST_NOPS];
+	futs[0] = vdm_memcpy(vdm, dst[0], src, TEST_SIZE, 0);
+	future_poll(FUTURE_AS_RUNNABLE(&futs[0]), NULL);
+
+	/* the worker is busy with the first operation */
+	uint64_t s;
+	do {
+		util_atomic_load_explicit64(&started, &s,
+			memory_order_acquire);
+	} while (!s);
+
+	/* normal operations first, the priority ones are queued last */
+	for (size_t i = 1; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst[i], src, TEST_SIZE,
+			i < TEST_NNORMAL ? 0 : VDM_F_PRIORITY);
+		UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL),
+			FUTURE_STATE_RUNNING);
+	}
+
+	util_atomic_store_explicit64(&release, 1, memory_order_release);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		struct future *fut = FUTURE_AS_RUNNABLE(&futs[i]);
+		if (future_poll(fut, NULL) != FUTURE_STATE_COMPLETE)
+			runtime_wait(r, fut);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst[i], src, TEST_SIZE), 0);
+	}
+
+	for (size_t i = 0; i < TEST_NOPS; ++i)
+		UT_ASSERTeq(order[i], expected[i]);
+
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+/*
+ * test_split -- large priority operations are split among the workers and
+ * priority batches are executed correctly
+ */
+static void
+test_split(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_set_chunk_size(dmt, TEST_CHUNK_SIZE);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_LARGE_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *buf = malloc(TEST_LARGE_SIZE);
+	UT_ASSERTne(buf, NULL);
+	for (size_t i = 0; i < TEST_LARGE_SIZE; ++i)
+		src[i] = (char)(i % 251);
+
+	struct vdm_operation_future fut = vdm_memcpy(vdm, buf, src,
+		TEST_LARGE_SIZE, VDM_F_PRIORITY);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(buf, src, TEST_LARGE_SIZE), 0);
+
+	struct vdm_operation ops[2];
+	struct vdm_operation_output outputs[2];
+	for (size_t i = 0; i < 2; ++i) {
+		memset(&ops[i], 0, sizeof(ops[i]));
+		ops[i].type = VDM_OPERATION_MEMSET;
+		ops[i].data.memset.str = buf + i * TEST_LARGE_SIZE / 2;
+		ops[i].data.memset.c = 'a' + (int)i;
+		ops[i].data.memset.n = TEST_LARGE_SIZE / 2;
+		ops[i].data.memset.flags = VDM_F_PRIORITY;
+	}
+	struct vdm_batch_future bfut = vdm_batch(vdm, ops, outputs, 2);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&bfut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&bfut)->result, VDM_SUCCESS);
+	for (size_t i = 0; i < TEST_LARGE_SIZE; ++i)
+		UT_ASSERTeq(buf[i], i < TEST_LARGE_SIZE / 2 ? 'a' : 'b');
+
+	free(buf);
+	free(src);
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+int
+main(void)
+{
+	/* strict priority */
+	size_t strict[TEST_NOPS] = {0, 4, 5, 6, 7, 1, 2, 3};
+	test_order(0, strict);
+
+	/* a normal operation after every two priority ones */
+	size_t quota[TEST_NOPS] = {0, 4, 5, 1, 6, 7, 2, 3};
+	test_order(2, quota);
+
+	/* the synchronous mover executes every operation right away */
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+	UT_ASSERTne(vdm_is_supported(data_mover_sync_get_vdm(dms),
+		VDM_F_PRIORITY), 0);
+	data_mover_sync_delete(dms);
+
+	test_split();
+
+	return 0;
+}
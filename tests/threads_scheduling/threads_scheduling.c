@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/os.h"
+#include "core/os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_NSUBMITTERS 3
+#define TEST_RINGBUF_SIZE 32
+#define TEST_NOPS 1000
+#define TEST_MAX_SIZE (1 << 14)
+
+struct submitter_args {
+	struct data_mover_threads *dmt;
+	int register_thread; /* set up the thread before its first operation */
+	unsigned seed;
+};
+
+/*
+ * submitter -- submits and verifies a number of memcpy operations of random
+ * sizes, there are more operations than the queues can hold at once
+ */
+static void *
+submitter(void *arg)
+{
+	struct submitter_args *args = arg;
+	struct vdm *vdm = data_mover_threads_get_vdm(args->dmt);
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	if (args->register_thread)
+		UT_ASSERTeq(data_mover_threads_register_thread(args->dmt), 0);
+
+	char *src = malloc(TEST_MAX_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc((size_t)TEST_MAX_SIZE * TEST_NOPS);
+	UT_ASSERTne(dst, NULL);
+	size_t *sizes = malloc(sizeof(size_t) * TEST_NOPS);
+	UT_ASSERTne(sizes, NULL);
+	struct vdm_operation_future *futs =
+		malloc(sizeof(struct vdm_operation_future) * TEST_NOPS);
+	UT_ASSERTne(futs, NULL);
+	struct future **runnable = malloc(sizeof(struct future *) * TEST_NOPS);
+	UT_ASSERTne(runnable, NULL);
+
+	for (size_t j = 0; j < TEST_MAX_SIZE; ++j)
+		src[j] = (char)os_rand_r(&args->seed);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		sizes[i] = (size_t)os_rand_r(&args->seed) % TEST_MAX_SIZE + 1;
+		futs[i] = vdm_memcpy(vdm, dst + i * TEST_MAX_SIZE, src,
+			sizes[i], 0);
+		runnable[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	runtime_wait_multiple(r, runnable, TEST_NOPS);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst + i * TEST_MAX_SIZE, src, sizes[i]), 0);
+	}
+
+	free(runnable);
+	free(futs);
+	free(sizes);
+	free(dst);
+	free(src);
+	runtime_delete(r);
+
+	return NULL;
+}
+
+/*
+ * test_scheduling -- runs multiple concurrent submitters against a mover
+ * with the given scheduling mode, placement and backing of operation data,
+ * the submitters register first if the data is pre-faulted
+ */
+static void
+test_scheduling(enum data_mover_threads_scheduling scheduling,
+	enum data_mover_threads_placement placement,
+	enum data_mover_threads_pages pages)
+{
+	int prefault = pages != DATA_MOVER_THREADS_PAGES_DEFAULT;
+
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, TEST_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_scheduling(cfg, scheduling);
+	data_mover_threads_config_set_placement(cfg, placement);
+	data_mover_threads_config_set_pages(cfg, pages, prefault);
+
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+
+	/* make sure that some of the operations are split */
+	data_mover_threads_set_chunk_size(dmt, TEST_MAX_SIZE / 4);
+
+	os_thread_t threads[TEST_NSUBMITTERS];
+	struct submitter_args args[TEST_NSUBMITTERS];
+	for (unsigned i = 0; i < TEST_NSUBMITTERS; ++i) {
+		args[i].dmt = dmt;
+		args[i].register_thread = prefault;
+		args[i].seed = i;
+		os_thread_create(&threads[i], NULL, submitter, &args[i]);
+	}
+
+	for (unsigned i = 0; i < TEST_NSUBMITTERS; ++i)
+		os_thread_join(&threads[i], NULL);
+
+	data_mover_threads_delete(dmt);
+}
+
+/*
+ * test_invalid_config -- creating a mover without worker threads must fail
+ */
+static void
+test_invalid_config(void)
+{
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, 0);
+	UT_ASSERTeq(data_mover_threads_new_ext(cfg), NULL);
+	data_mover_threads_config_delete(cfg);
+}
+
+int
+main(void)
+{
+	test_scheduling(DATA_MOVER_THREADS_SCHEDULING_SHARED,
+		DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN,
+		DATA_MOVER_THREADS_PAGES_DEFAULT);
+	test_scheduling(DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING,
+		DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN,
+		DATA_MOVER_THREADS_PAGES_DEFAULT);
+	test_scheduling(DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING,
+		DATA_MOVER_THREADS_PLACEMENT_LOCAL,
+		DATA_MOVER_THREADS_PAGES_DEFAULT);
+
+	/* huge pages might be unavailable, the next best ones are used then */
+	test_scheduling(DATA_MOVER_THREADS_SCHEDULING_SHARED,
+		DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN,
+		DATA_MOVER_THREADS_PAGES_TRANSPARENT_HUGE);
+	test_scheduling(DATA_MOVER_THREADS_SCHEDULING_SHARED,
+		DATA_MOVER_THREADS_PLACEMENT_ROUND_ROBIN,
+		DATA_MOVER_THREADS_PAGES_HUGETLB);
+	test_invalid_config();
+
+	return 0;
+}
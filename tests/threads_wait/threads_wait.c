@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 2
+#define TEST_RINGBUF_SIZE 32
+#define TEST_NOPS 256
+#define TEST_SIZE (1 << 12)
+#define TEST_SPIN_COUNT 16
+
+/*
+ * test_memcpy -- runs a number of memcpy operations on the mover
+ */
+static void
+test_memcpy(struct data_mover_threads *dmt)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc(TEST_SIZE);
+	UT_ASSERTne(dst, NULL);
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		src[j] = (char)(j % 251);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		memset(dst, 0, TEST_SIZE);
+		struct vdm_operation_future fut =
+			vdm_memcpy(vdm, dst, src, TEST_SIZE, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(dst, src, TEST_SIZE), 0);
+	}
+
+	free(dst);
+	free(src);
+	runtime_delete(r);
+}
+
+/*
+ * wait_for_parks -- waits until every worker blocked at least once
+ */
+static void
+wait_for_parks(struct data_mover_threads *dmt)
+{
+	struct data_mover_threads_worker_stats stats;
+
+	for (size_t w = 0; w < TEST_NTHREADS; ++w) {
+		do {
+			UT_ASSERTeq(data_mover_threads_get_worker_stats(dmt,
+				w, &stats), 0);
+		} while (stats.parks == 0);
+	}
+}
+
+/*
+ * test_wait_policy -- creates a mover with the given wait policy and checks
+ * that it executes operations and that the statistics of the workers match
+ * the policy
+ */
+static void
+test_wait_policy(enum data_mover_threads_wait_policy wait_policy)
+{
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, TEST_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_wait_policy(cfg, wait_policy);
+	data_mover_threads_config_set_spin_count(cfg, TEST_SPIN_COUNT);
+
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+
+	test_memcpy(dmt);
+
+	struct data_mover_threads_worker_stats stats;
+	switch (wait_policy) {
+		case DATA_MOVER_THREADS_WAIT_BLOCK:
+			wait_for_parks(dmt);
+			for (size_t w = 0; w < TEST_NTHREADS; ++w) {
+				data_mover_threads_get_worker_stats(dmt, w,
+					&stats);
+				UT_ASSERTeq(stats.spins, 0);
+			}
+			break;
+		case DATA_MOVER_THREADS_WAIT_SPIN_THEN_PARK:
+			/* a worker always spins before it parks */
+			wait_for_parks(dmt);
+			for (size_t w = 0; w < TEST_NTHREADS; ++w) {
+				data_mover_threads_get_worker_stats(dmt, w,
+					&stats);
+				UT_ASSERTin(stats.spins,
+					stats.parks * TEST_SPIN_COUNT,
+					UINT64_MAX);
+			}
+			break;
+		case DATA_MOVER_THREADS_WAIT_BUSY_POLL:
+			for (size_t w = 0; w < TEST_NTHREADS; ++w) {
+				data_mover_threads_get_worker_stats(dmt, w,
+					&stats);
+				UT_ASSERTeq(stats.parks, 0);
+				UT_ASSERTeq(stats.wakeups, 0);
+			}
+			break;
+		default:
+			UT_FATAL("unknown wait policy");
+	}
+
+	UT_ASSERTeq(data_mover_threads_get_worker_stats(dmt, TEST_NTHREADS,
+		&stats), -1);
+
+	data_mover_threads_delete(dmt);
+}
+
+int
+main(void)
+{
+	test_wait_policy(DATA_MOVER_THREADS_WAIT_BLOCK);
+	test_wait_policy(DATA_MOVER_THREADS_WAIT_SPIN_THEN_PARK);
+	test_wait_policy(DATA_MOVER_THREADS_WAIT_BUSY_POLL);
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_RINGBUF_SIZE 8
+#define TEST_NOPS 1000
+#define TEST_SIZE 256
+
+/*
+ * test_batch -- runs a batch of memcpy, memmove and memset operations on
+ * separate buffers and checks their results
+ */
+static void
+test_batch(struct vdm *vdm, size_t nops)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc(TEST_SIZE * (nops + 1));
+	UT_ASSERTne(dst, NULL);
+	struct vdm_operation *ops = malloc(sizeof(*ops) * (nops + 1));
+	UT_ASSERTne(ops, NULL);
+	struct vdm_operation_output *outputs =
+		malloc(sizeof(*outputs) * (nops + 1));
+	UT_ASSERTne(outputs, NULL);
+
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		src[j] = (char)(j % 251);
+	memset(dst, 0, TEST_SIZE * (nops + 1));
+
+	for (size_t i = 0; i < nops; ++i) {
+		char *d = dst + i * TEST_SIZE;
+		memset(&ops[i], 0, sizeof(ops[i]));
+		switch (i % 3) {
+			case 0:
+				ops[i].type = VDM_OPERATION_MEMCPY;
+				ops[i].data.memcpy.dest = d;
+				ops[i].data.memcpy.src = src;
+				ops[i].data.memcpy.n = TEST_SIZE;
+				break;
+			case 1:
+				ops[i].type = VDM_OPERATION_MEMMOVE;
+				ops[i].data.memmove.dest = d;
+				ops[i].data.memmove.src = src;
+				ops[i].data.memmove.n = TEST_SIZE;
+				break;
+			default:
+				ops[i].type = VDM_OPERATION_MEMSET;
+				ops[i].data.memset.str = d;
+				ops[i].data.memset.c = (int)i;
+				ops[i].data.memset.n = TEST_SIZE;
+				break;
+		}
+	}
+
+	struct vdm_batch_future fut = vdm_batch(vdm, ops, outputs, nops);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+
+	for (size_t i = 0; i < nops; ++i) {
+		char *d = dst + i * TEST_SIZE;
+		UT_ASSERTeq(outputs[i].result, VDM_SUCCESS);
+		UT_ASSERTeq(outputs[i].type, ops[i].type);
+		switch (ops[i].type) {
+			case VDM_OPERATION_MEMCPY:
+				UT_ASSERTeq(outputs[i].output.memcpy.dest, d);
+				UT_ASSERTeq(memcmp(d, src, TEST_SIZE), 0);
+				break;
+			case VDM_OPERATION_MEMMOVE:
+				UT_ASSERTeq(outputs[i].output.memmove.dest, d);
+				UT_ASSERTeq(memcmp(d, src, TEST_SIZE), 0);
+				break;
+			default:
+				UT_ASSERTeq(outputs[i].output.memset.str, d);
+				for (size_t j = 0; j < TEST_SIZE; ++j)
+					UT_ASSERTeq(d[j], (char)i);
+				break;
+		}
+	}
+
+	/* nothing beyond the batch is touched */
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		UT_ASSERTeq(dst[nops * TEST_SIZE + j], 0);
+
+	free(outputs);
+	free(ops);
+	free(dst);
+	free(src);
+	runtime_delete(r);
+}
+
+/*
+ * test_sizes -- runs batches of different sizes on the mover
+ */
+static void
+test_sizes(struct vdm *vdm)
+{
+	test_batch(vdm, 0);
+	test_batch(vdm, 1);
+	test_batch(vdm, TEST_NTHREADS + 1);
+	test_batch(vdm, TEST_NOPS);
+}
+
+/* the mover wrapped by the one which is busy every other time */
+static struct vdm *busy_base;
+static unsigned busy_calls;
+
+/*
+ * busy_operation_new -- creates an operation of the wrapped mover
+ */
+static void *
+busy_operation_new(struct vdm *vdm, const enum vdm_operation_type type)
+{
+	(void) vdm;
+
+	return busy_base->op_new(busy_base, type);
+}
+
+/*
+ * busy_operation_start -- leaves every other operation idle, as a mover with
+ * a full queue does
+ */
+static int
+busy_operation_start(void *data, const struct vdm_operation *operation,
+	struct future_notifier *n)
+{
+	if (busy_calls++ % 2 == 0) {
+		if (n)
+			n->notifier_used = FUTURE_NOTIFIER_NONE;
+		return 0;
+	}
+
+	return busy_base->op_start(data, operation, n);
+}
+
+int
+main(void)
+{
+	/* the threads mover executes batches natively */
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	test_sizes(data_mover_threads_get_vdm(dmt));
+	data_mover_threads_delete(dmt);
+
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, TEST_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_scheduling(cfg,
+		DATA_MOVER_THREADS_SCHEDULING_WORK_STEALING);
+	dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+	test_sizes(data_mover_threads_get_vdm(dmt));
+	data_mover_threads_delete(dmt);
+
+	/* the synchronous mover executes the operations one by one */
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+	test_sizes(data_mover_sync_get_vdm(dms));
+
+	/* operations left idle by the mover are started again */
+	busy_base = data_mover_sync_get_vdm(dms);
+	struct vdm busy = *busy_base;
+	busy.op_new = busy_operation_new;
+	busy.op_start = busy_operation_start;
+	busy.op_init = NULL;
+	test_sizes(&busy);
+	data_mover_sync_delete(dms);
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/flush.h"
+#include "core/memops.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_RINGBUF_SIZE 32
+#define TEST_CHUNK_SIZE 4096
+#define TEST_SIZE ((1 << 20) + 3)
+
+/*
+ * test_flush -- flushes ranges of different sizes and alignments, then
+ * writes durably to them, the data must stay intact
+ */
+static void
+test_flush(struct vdm *vdm)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	char *buf = malloc(TEST_SIZE);
+	UT_ASSERTne(buf, NULL);
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	for (size_t j = 0; j < TEST_SIZE; ++j) {
+		buf[j] = (char)(j % 251);
+		src[j] = (char)(j % 241);
+	}
+
+	size_t sizes[] = {0, 1, 63, 64, 65, TEST_CHUNK_SIZE * 3 + 1,
+		TEST_SIZE - 1};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		struct vdm_operation_future fut =
+			vdm_flush(vdm, buf + 1, sizes[i], 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->type, VDM_OPERATION_FLUSH);
+	}
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		UT_ASSERTeq(buf[j], (char)(j % 251));
+
+	if (vdm_is_supported(vdm, VDM_F_MEM_DURABLE)) {
+		struct vdm_operation_future fut = vdm_memcpy(vdm, buf, src,
+			TEST_SIZE, VDM_F_MEM_DURABLE);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(buf, src, TEST_SIZE), 0);
+
+		fut = vdm_memset(vdm, buf, 'x', TEST_SIZE, VDM_F_MEM_DURABLE);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		for (size_t j = 0; j < TEST_SIZE; ++j)
+			UT_ASSERTeq(buf[j], 'x');
+	}
+
+	free(src);
+	free(buf);
+	runtime_delete(r);
+}
+
+/*
+ * test_capabilities -- durable writes are supported wherever cache lines
+ * can be written back, cache bypassing wherever there are non-temporal
+ * stores
+ */
+static void
+test_capabilities(struct vdm *vdm)
+{
+	UT_ASSERTeq(vdm_is_supported(vdm, VDM_F_MEM_DURABLE), FLUSH_DURABLE);
+	UT_ASSERTeq(vdm_is_supported(vdm, VDM_F_NO_CACHE_HINT), MEMOPS_NT);
+	UT_ASSERTeq(vdm_is_supported(vdm, VDM_F_VALID_FLAGS),
+		FLUSH_DURABLE && MEMOPS_NT);
+}
+
+int
+main(void)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	test_capabilities(data_mover_threads_get_vdm(dmt));
+
+	/* large ranges are split among the workers */
+	data_mover_threads_set_chunk_size(dmt, TEST_CHUNK_SIZE);
+	test_flush(data_mover_threads_get_vdm(dmt));
+
+	/* small ones are flushed by the submitter */
+	data_mover_threads_set_inline_threshold(dmt, TEST_CHUNK_SIZE);
+	test_flush(data_mover_threads_get_vdm(dmt));
+	data_mover_threads_delete(dmt);
+
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+	test_capabilities(data_mover_sync_get_vdm(dms));
+	test_flush(data_mover_sync_get_vdm(dms));
+	data_mover_sync_delete(dms);
+
+	return 0;
+}
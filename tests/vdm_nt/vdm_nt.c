@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_RINGBUF_SIZE 32
+#define TEST_CHUNK_SIZE 4096
+#define TEST_SIZE ((1 << 16) + 7)
+#define TEST_SHIFT 37 /* distance of the overlapping ranges */
+
+/*
+ * fill -- fills the buffer with a pattern depending on the seed
+ */
+static void
+fill(char *buf, size_t n, unsigned seed)
+{
+	for (size_t j = 0; j < n; ++j)
+		buf[j] = (char)((j + seed) % 251);
+}
+
+/*
+ * test_ops -- runs memcpy, overlapping memmove in both directions and memset
+ * operations with the given flags on ranges of different sizes and
+ * alignments, the results must match the ones of the libc functions
+ */
+static void
+test_ops(struct vdm *vdm, unsigned flags)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	size_t len = TEST_SIZE + TEST_SHIFT + 64;
+	char *buf = malloc(len);
+	UT_ASSERTne(buf, NULL);
+	char *expected = malloc(len);
+	UT_ASSERTne(expected, NULL);
+	char *src = malloc(len);
+	UT_ASSERTne(src, NULL);
+	fill(src, len, 1);
+
+	size_t sizes[] = {0, 1, 255, 256, 257, TEST_CHUNK_SIZE * 3 + 13,
+		TEST_SIZE};
+	size_t offsets[] = {0, 1, 17, 63};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+	for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); ++o) {
+		size_t n = sizes[i];
+		char *dst = buf + offsets[o];
+
+		fill(buf, len, 2);
+		memcpy(expected, buf, len);
+		memcpy(expected + offsets[o], src + 3, n);
+		struct vdm_operation_future fut =
+			vdm_memcpy(vdm, dst, src + 3, n, flags);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(buf, expected, len), 0);
+
+		/* destination above the source */
+		fill(buf, len, 3);
+		memcpy(expected, buf, len);
+		memmove(expected + offsets[o] + TEST_SHIFT,
+			expected + offsets[o], n);
+		fut = vdm_memmove(vdm, dst + TEST_SHIFT, dst, n, flags);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(buf, expected, len), 0);
+
+		/* destination below the source */
+		fill(buf, len, 4);
+		memcpy(expected, buf, len);
+		memmove(expected + offsets[o],
+			expected + offsets[o] + TEST_SHIFT, n);
+		fut = vdm_memmove(vdm, dst, dst + TEST_SHIFT, n, flags);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(buf, expected, len), 0);
+
+		fill(buf, len, 5);
+		memcpy(expected, buf, len);
+		memset(expected + offsets[o], 'x', n);
+		fut = vdm_memset(vdm, dst, 'x', n, flags);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(buf, expected, len), 0);
+	}
+	}
+
+	free(src);
+	free(expected);
+	free(buf);
+	runtime_delete(r);
+}
+
+int
+main(void)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(TEST_NTHREADS,
+		TEST_RINGBUF_SIZE, FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	/* whole operations and ones split among the workers */
+	test_ops(vdm, VDM_F_NO_CACHE_HINT);
+	data_mover_threads_set_chunk_size(dmt, TEST_CHUNK_SIZE);
+	test_ops(vdm, VDM_F_NO_CACHE_HINT);
+	test_ops(vdm, VDM_F_NO_CACHE_HINT | VDM_F_MEM_DURABLE);
+
+	/* every operation bypasses the caches with the threshold that low */
+	data_mover_threads_set_nt_threshold(dmt, 1);
+	test_ops(vdm, 0);
+	data_mover_threads_delete(dmt);
+
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+	test_ops(data_mover_sync_get_vdm(dms), VDM_F_NO_CACHE_HINT);
+	data_mover_sync_set_nt_threshold(dms, 1);
+	test_ops(data_mover_sync_get_vdm(dms), 0);
+	data_mover_sync_set_nt_threshold(dms, 0);
+	test_ops(data_mover_sync_get_vdm(dms), 0);
+	data_mover_sync_delete(dms);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 2
+#define TEST_RINGBUF_SIZE 64
+/* more operations than a single buffer of the threads mover can hold */
+#define TEST_NOPS 16384
+#define TEST_SIZE 64
+
+/*
+ * test_state -- operations keep their state in the memory provided by
+ * the caller, so that none of them runs out of memory no matter how many
+ * of them are in flight, their results must be correct
+ */
+static void
+test_state(struct vdm *vdm)
+{
+	size_t state_size = vdm_operation_state_size(vdm);
+	UT_ASSERTne(state_size, 0);
+	size_t stride = (state_size + VDM_OPERATION_STATE_ALIGNMENT - 1) /
+		VDM_OPERATION_STATE_ALIGNMENT * VDM_OPERATION_STATE_ALIGNMENT;
+
+	char *mem = malloc(stride * TEST_NOPS + VDM_OPERATION_STATE_ALIGNMENT);
+	UT_ASSERTne(mem, NULL);
+	char *states = mem + VDM_OPERATION_STATE_ALIGNMENT -
+		(uintptr_t)mem % VDM_OPERATION_STATE_ALIGNMENT;
+
+	char *src = malloc(TEST_SIZE);
+	UT_ASSERTne(src, NULL);
+	char *dst = malloc((size_t)TEST_SIZE * TEST_NOPS);
+	UT_ASSERTne(dst, NULL);
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		src[j] = (char)j;
+	memset(dst, 0, (size_t)TEST_SIZE * TEST_NOPS);
+
+	struct vdm_operation_future *futs =
+		malloc(sizeof(struct vdm_operation_future) * TEST_NOPS);
+	UT_ASSERTne(futs, NULL);
+	struct future **runnable = malloc(sizeof(struct future *) * TEST_NOPS);
+	UT_ASSERTne(runnable, NULL);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		void *state = states + i * stride;
+		futs[i] = vdm_memcpy_state(vdm, dst + i * TEST_SIZE, src,
+			TEST_SIZE, 0, state);
+		UT_ASSERTeq(futs[i].data.data, state);
+		runnable[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	runtime_wait_multiple(r, runnable, TEST_NOPS);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->output.memcpy.dest,
+			dst + i * TEST_SIZE);
+		UT_ASSERTeq(memcmp(dst + i * TEST_SIZE, src, TEST_SIZE), 0);
+	}
+
+	/* the other operations and the state reused once they're complete */
+	struct vdm_operation_future fut = vdm_memmove_state(vdm, dst + 1, dst,
+		TEST_SIZE, 0, states);
+	UT_ASSERTeq(fut.data.data, states);
+	if (future_poll(FUTURE_AS_RUNNABLE(&fut), NULL) !=
+			FUTURE_STATE_COMPLETE)
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(memcmp(dst + 1, src, TEST_SIZE), 0);
+
+	fut = vdm_memset_state(vdm, dst, 'x', TEST_SIZE, 0, states);
+	if (future_poll(FUTURE_AS_RUNNABLE(&fut), NULL) !=
+			FUTURE_STATE_COMPLETE)
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	for (size_t j = 0; j < TEST_SIZE; ++j)
+		UT_ASSERTeq(dst[j], 'x');
+
+	fut = vdm_flush_state(vdm, dst, TEST_SIZE, 0, states);
+	if (future_poll(FUTURE_AS_RUNNABLE(&fut), NULL) !=
+			FUTURE_STATE_COMPLETE)
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+
+	/* without the memory, the mover allocates the state */
+	fut = vdm_memcpy_state(vdm, dst, src, TEST_SIZE, 0, NULL);
+	UT_ASSERTne(fut.data.data, NULL);
+	if (future_poll(FUTURE_AS_RUNNABLE(&fut), NULL) !=
+			FUTURE_STATE_COMPLETE)
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(memcmp(dst, src, TEST_SIZE), 0);
+
+	runtime_delete(r);
+	free(runnable);
+	free(futs);
+	free(dst);
+	free(src);
+	free(mem);
+}
+
+int
+main(void)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+	test_state(data_mover_sync_get_vdm(dms));
+	data_mover_sync_delete(dms);
+
+	struct data_mover_threads_config *cfg = data_mover_threads_config_new();
+	UT_ASSERTne(cfg, NULL);
+	data_mover_threads_config_set_nthreads(cfg, TEST_NTHREADS);
+	data_mover_threads_config_set_ringbuf_size(cfg, TEST_RINGBUF_SIZE);
+	data_mover_threads_config_set_max_buffers(cfg, 1);
+	struct data_mover_threads *dmt = data_mover_threads_new_ext(cfg);
+	UT_ASSERTne(dmt, NULL);
+	data_mover_threads_config_delete(cfg);
+
+	test_state(data_mover_threads_get_vdm(dmt));
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}